@@ -5,6 +5,7 @@ import 'dart:typed_data';
 import 'package:flutter_reactive_ble/flutter_reactive_ble.dart';
 
 import 'ble_constants.dart';
+import 'ble_decoder.dart';
 
 /// Maneja:
 ///  - conexión BLE
@@ -118,32 +119,18 @@ class BleConnection {
 
     // Procesar mientras haya suficientes bytes
     while (true) {
-      // Header mínimo = 11 bytes
-      if (_rxBuffer.length < 11) {
+      // Header mínimo = 6 bytes
+      if (_rxBuffer.length < 6) {
         return;
       }
 
       final data = Uint8List.fromList(_rxBuffer);
-      final bd = ByteData.sublistView(data);
 
-      int offset = 0;
-
-      // flags
-      offset += 1;
-
-      // timestamp uint64
-      offset += 8;
-
-      // counts
-      final countImu = bd.getUint8(offset++);
-      final countPulse = bd.getUint8(offset++);
-
-      // tamaño esperado completo
-      final expected =
-          1 + 8 + 2 + (countImu * 12) + (countPulse * 2);
+      // tamaño del paquete completo (el bloque IMU puede ir comprimido)
+      final expected = compactPacketLength(data);
 
       // No hay suficientes bytes aún
-      if (_rxBuffer.length < expected) {
+      if (expected == null) {
         return;
       }
 
@@ -9,4 +9,16 @@ class BleConstants {
 
   static final notifyCharacteristicUuid =
   Uuid.parse("e2cdab90-7856-3412-efcd-ab9078563412");
+
+  // Contadores de pérdidas del firmware (solo lectura)
+  static final statsCharacteristicUuid =
+  Uuid.parse("e3cdab90-7856-3412-efcd-ab9078563412");
+
+  // PHY / data length / intervalo del enlace (solo lectura)
+  static final linkCharacteristicUuid =
+  Uuid.parse("e4cdab90-7856-3412-efcd-ab9078563412");
+
+  // OTA v2: tramas sin respuesta + ACKs por notificación (ver ota.h)
+  static final otaCharacteristicUuid =
+  Uuid.parse("e5cdab90-7856-3412-efcd-ab9078563412");
 }
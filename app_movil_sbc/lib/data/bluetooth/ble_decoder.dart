@@ -1,9 +1,51 @@
 import 'dart:typed_data';
 import 'ble_packet.dart';
 
+/// Última epoch absoluta recibida del dispositivo. Los paquetes sin epoch
+/// llevan solo un delta de 16 bits respecto a ella.
+class BleTimebase {
+  int? epochMs;
+
+  void reset() => epochMs = null;
+}
+
 /// Parsea un paquete "compact" (formato que envía el ESP32).
 /// Devuelve BlePacket o null si está truncado o inválido.
-BlePacket? decodePacketCompact(Uint8List data) {
+/// Si se pasa [timebase], se actualiza con las epochs recibidas y se usa
+/// para reconstruir el timestamp absoluto.
+BlePacket? decodePacketCompact(Uint8List data, [BleTimebase? timebase]) {
+  final decoded = _decodeCompact(data);
+  if (decoded == null) return null;
+
+  final pkt = decoded.packet;
+  if (timebase == null) return pkt;
+
+  if (pkt.epochMs != null) timebase.epochMs = pkt.epochMs;
+
+  return BlePacket(
+    flags: pkt.flags,
+    seq: pkt.seq,
+    timestamp: (timebase.epochMs ?? 0) + pkt.tsDeltaMs,
+    tsDeltaMs: pkt.tsDeltaMs,
+    epochMs: pkt.epochMs,
+    imuSamples: pkt.imuSamples,
+    pulses: pkt.pulses,
+    pulseDtMs: pkt.pulseDtMs,
+  );
+}
+
+/// Longitud en bytes del primer paquete completo de [data], o null si aún
+/// está incompleto (para reensamblar fragmentos).
+int? compactPacketLength(Uint8List data) => _decodeCompact(data)?.end;
+
+class _Decoded {
+  final BlePacket packet;
+  final int end;
+
+  _Decoded(this.packet, this.end);
+}
+
+_Decoded? _decodeCompact(Uint8List data) {
   if (data.isEmpty) return null;
 
   final bd = ByteData.sublistView(data);
@@ -13,55 +55,169 @@ BlePacket? decodePacketCompact(Uint8List data) {
   final flags = bd.getUint8(idx);
   idx += 1;
 
-  if (idx + 8 > data.length) return null;
-  final timestampLow = bd.getUint32(idx, Endian.little);
-  final timestampHigh = bd.getUint32(idx + 4, Endian.little);
-  final timestamp = ((timestampHigh << 32) | timestampLow) & 0xFFFFFFFFFFFFFFFF;
-  idx += 8;
+  if (idx + 1 > data.length) return null;
+  final seq = bd.getUint8(idx);
+  idx += 1;
+
+  int? epoch;
+  if ((flags & BlePacketFlags.epoch) != 0) {
+    if (idx + 4 > data.length) return null;
+    epoch = bd.getUint32(idx, Endian.little);
+    idx += 4;
+  }
+
+  if (idx + 2 > data.length) return null;
+  final tsDelta = bd.getUint16(idx, Endian.little);
+  idx += 2;
 
   if (idx + 2 > data.length) return null;
   final imuCount = bd.getUint8(idx); idx += 1;
   final pulseCount = bd.getUint8(idx); idx += 1;
 
-  final neededForImu = imuCount * 12;
-  final neededForPulses = pulseCount * 2;
+  final hasDt = (flags & BlePacketFlags.sampleDt) != 0;
+  final dtLen = hasDt ? 2 : 0;
 
-  if (idx + neededForImu + neededForPulses > data.length) {
-    return null; // truncado
+  final List<ImuSample> imuList;
+  if ((flags & BlePacketFlags.imuDelta) != 0) {
+    // Bloque IMU comprimido (imu_codec.c en el firmware)
+    final block = _decodeImuDelta(data, idx, imuCount, hasDt);
+    if (block == null) return null; // truncado
+    imuList = block.samples;
+    idx = block.end;
+  } else {
+    final neededForImu = imuCount * (12 + dtLen);
+    if (idx + neededForImu > data.length) {
+      return null; // truncado
+    }
+
+    imuList = <ImuSample>[];
+    for (int s = 0; s < imuCount; s++) {
+      int dt = 0;
+      if (dtLen > 0) {
+        dt = bd.getUint16(idx, Endian.little); idx += 2;
+      }
+      final ax = bd.getInt16(idx, Endian.little); idx += 2;
+      final ay = bd.getInt16(idx, Endian.little); idx += 2;
+      final az = bd.getInt16(idx, Endian.little); idx += 2;
+      final gx = bd.getInt16(idx, Endian.little); idx += 2;
+      final gy = bd.getInt16(idx, Endian.little); idx += 2;
+      final gz = bd.getInt16(idx, Endian.little); idx += 2;
+
+      imuList.add(
+        ImuSample(
+          ax: ax,
+          ay: ay,
+          az: az,
+          gx: gx,
+          gy: gy,
+          gz: gz,
+          dtMs: dt,
+        ),
+      );
+    }
   }
 
-  final imuList = <ImuSample>[];
-  for (int s = 0; s < imuCount; s++) {
-    final ax = bd.getInt16(idx, Endian.little); idx += 2;
-    final ay = bd.getInt16(idx, Endian.little); idx += 2;
-    final az = bd.getInt16(idx, Endian.little); idx += 2;
-    final gx = bd.getInt16(idx, Endian.little); idx += 2;
-    final gy = bd.getInt16(idx, Endian.little); idx += 2;
-    final gz = bd.getInt16(idx, Endian.little); idx += 2;
-
-    imuList.add(
-      ImuSample(
-        ax: ax,
-        ay: ay,
-        az: az,
-        gx: gx,
-        gy: gy,
-        gz: gz,
-      ),
-    );
+  final neededForPulses = pulseCount * (2 + dtLen);
+  if (idx + neededForPulses > data.length) {
+    return null; // truncado
   }
 
   final pulses = <int>[];
+  final pulseDt = <int>[];
   for (int p = 0; p < pulseCount; p++) {
+    if (dtLen > 0) {
+      pulseDt.add(bd.getUint16(idx, Endian.little));
+      idx += 2;
+    }
     final v = bd.getUint16(idx, Endian.little);
     idx += 2;
     pulses.add(v);
   }
 
-  return BlePacket(
+  final packet = BlePacket(
     flags: flags,
-    timestamp: timestamp,
+    seq: seq,
+    timestamp: (epoch ?? 0) + tsDelta,
+    tsDeltaMs: tsDelta,
+    epochMs: epoch,
     imuSamples: imuList,
     pulses: pulses,
+    pulseDtMs: pulseDt,
   );
+  return _Decoded(packet, idx);
+}
+
+class _ImuBlock {
+  final List<ImuSample> samples;
+  final int end;
+
+  _ImuBlock(this.samples, this.end);
+}
+
+/// Lee un varint LEB128 de hasta 16 bits. Devuelve [valor, nuevoIdx] o null.
+List<int>? _readVarint(Uint8List data, int idx) {
+  int acc = 0;
+  for (int i = 0; i < 3; i++) {
+    if (idx + i >= data.length) return null;
+    final b = data[idx + i];
+    acc |= (b & 0x7F) << (7 * i);
+    if ((b & 0x80) == 0) {
+      if (acc > 0xFFFF) return null;
+      return [acc, idx + i + 1];
+    }
+  }
+  return null;
+}
+
+int _toInt16(int v) {
+  v &= 0xFFFF;
+  return v >= 0x8000 ? v - 0x10000 : v;
+}
+
+/// Decodifica un bloque IMU delta + zig-zag varint (PM_FLAG_IMU_DELTA).
+_ImuBlock? _decodeImuDelta(Uint8List data, int idx, int count, bool hasDt) {
+  final bd = ByteData.sublistView(data);
+  final samples = <ImuSample>[];
+  var prev = List<int>.filled(6, 0);
+  int prevDt = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (hasDt) {
+      final r = _readVarint(data, idx);
+      if (r == null) return null;
+      prevDt = (i == 0) ? r[0] : (prevDt + r[0]) & 0xFFFF;
+      idx = r[1];
+    }
+
+    final cur = List<int>.filled(6, 0);
+    if (i == 0) {
+      if (idx + 12 > data.length) return null;
+      for (int a = 0; a < 6; a++) {
+        cur[a] = bd.getInt16(idx, Endian.little);
+        idx += 2;
+      }
+    } else {
+      for (int a = 0; a < 6; a++) {
+        final r = _readVarint(data, idx);
+        if (r == null) return null;
+        final z = r[0];
+        final delta = (z >> 1) ^ -(z & 1);
+        cur[a] = _toInt16(prev[a] + delta);
+        idx = r[1];
+      }
+    }
+
+    samples.add(ImuSample(
+      ax: cur[0],
+      ay: cur[1],
+      az: cur[2],
+      gx: cur[3],
+      gy: cur[4],
+      gz: cur[5],
+      dtMs: prevDt,
+    ));
+    prev = cur;
+  }
+
+  return _ImuBlock(samples, idx);
 }
@@ -34,6 +34,14 @@ class BleManager extends ChangeNotifier {
   Stream<bool> get connectionStatusStream =>
       _connectionStatusController.stream;
 
+  // Base de tiempos del enlace (epoch + deltas)
+  final BleTimebase _timebase = BleTimebase();
+
+  // Pérdidas detectadas por huecos en el número de secuencia
+  int? _lastSeq;
+  int _lostPackets = 0;
+  int get lostPackets => _lostPackets;
+
   // Heartbeat tracking
   int _latestHeartRate = 0;
   int get latestHeartRate => _latestHeartRate;
@@ -80,6 +88,9 @@ class BleManager extends ChangeNotifier {
     await disconnect();
 
     connectedDevice = device;
+    _timebase.reset();
+    _lastSeq = null;
+    _lostPackets = 0;
 
     _connSub = _ble
         .connectToDevice(
@@ -140,9 +151,14 @@ class BleManager extends ChangeNotifier {
   // PACKET PROCESSING
   // ---------------------------------------------------------
   void _handleIncoming(Uint8List bytes) {
-    final packet = decodePacketCompact(bytes);
+    final packet = decodePacketCompact(bytes, _timebase);
     if (packet == null) return;
 
+    if (_lastSeq != null) {
+      _lostPackets += (packet.seq - _lastSeq! - 1) & 0xFF;
+    }
+    _lastSeq = packet.seq;
+
     _rawPacketController.add(packet);
 
     final model = SensorDataModel.instance;
@@ -172,6 +188,66 @@ class BleManager extends ChangeNotifier {
     await _ble.writeCharacteristicWithResponse(characteristic, value: data);
   }
 
+  /// Lee los contadores de pérdidas del firmware (ver pm_stats_serialize).
+  Future<List<int>> readStats() async {
+    if (connectedDevice == null) {
+      throw Exception("Device not connected");
+    }
+
+    final characteristic = QualifiedCharacteristic(
+      serviceId: BleConstants.serviceUuid,
+      characteristicId: BleConstants.statsCharacteristicUuid,
+      deviceId: connectedDevice!.id,
+    );
+
+    return await _ble.readCharacteristic(characteristic);
+  }
+
+  /// Lee los parámetros del enlace negociados (ver bluetooth_link_serialize).
+  Future<List<int>> readLinkInfo() async {
+    if (connectedDevice == null) {
+      throw Exception("Device not connected");
+    }
+
+    final characteristic = QualifiedCharacteristic(
+      serviceId: BleConstants.serviceUuid,
+      characteristicId: BleConstants.linkCharacteristicUuid,
+      deviceId: connectedDevice!.id,
+    );
+
+    return await _ble.readCharacteristic(characteristic);
+  }
+
+  /// Trama OTA v2 (write without response, ver ota.h del firmware).
+  Future<void> writeOtaFrame(Uint8List frame) async {
+    if (connectedDevice == null) {
+      throw Exception("Device not connected");
+    }
+
+    final characteristic = QualifiedCharacteristic(
+      serviceId: BleConstants.serviceUuid,
+      characteristicId: BleConstants.otaCharacteristicUuid,
+      deviceId: connectedDevice!.id,
+    );
+
+    await _ble.writeCharacteristicWithoutResponse(characteristic, value: frame);
+  }
+
+  /// Respuestas OTA v2 del firmware (BEGIN_RSP / ACK / END_RSP).
+  Stream<List<int>> otaResponses() {
+    if (connectedDevice == null) {
+      throw Exception("Device not connected");
+    }
+
+    final characteristic = QualifiedCharacteristic(
+      serviceId: BleConstants.serviceUuid,
+      characteristicId: BleConstants.otaCharacteristicUuid,
+      deviceId: connectedDevice!.id,
+    );
+
+    return _ble.subscribeToCharacteristic(characteristic);
+  }
+
   Future<void> send(String text) async {
     await write(Uint8List.fromList(text.codeUnits));
   }
@@ -1,9 +1,23 @@
 import 'dart:typed_data';
 
+import 'ble_decoder.dart';
+
+/// Bits de flags del paquete compacto (ver packet_manager.h)
+class BlePacketFlags {
+  static const int imu = 0x80;
+  static const int pulse = 0x40;
+  static const int sampleDt = 0x20;
+  static const int imuDelta = 0x10;
+  static const int epoch = 0x08;
+}
+
 class ImuSample {
   final int ax, ay, az;
   final int gx, gy, gz;
 
+  /// ms respecto al timestamp del paquete (0 si el paquete no lleva dt)
+  final int dtMs;
+
   ImuSample({
     required this.ax,
     required this.ay,
@@ -11,91 +25,46 @@ class ImuSample {
     required this.gx,
     required this.gy,
     required this.gz,
+    this.dtMs = 0,
   });
 }
 
 class BlePacket {
   final int flags;
+
+  /// número de secuencia (uint8, +1 por paquete)
+  final int seq;
+
+  /// ms de dispositivo: epoch + delta (solo absoluto si se conoce la epoch)
   final int timestamp;
+
+  /// delta de 16 bits respecto a la última epoch
+  final int tsDeltaMs;
+
+  /// epoch absoluta, solo en los paquetes que la llevan
+  final int? epochMs;
   final List<ImuSample> imuSamples;
   final List<int> pulses;
 
+  /// ms de cada pulso respecto al timestamp del paquete
+  final List<int> pulseDtMs;
+
   BlePacket({
     required this.flags,
+    this.seq = 0,
     required this.timestamp,
+    this.tsDeltaMs = 0,
+    this.epochMs,
     required this.imuSamples,
     required this.pulses,
+    this.pulseDtMs = const [],
   });
 
   factory BlePacket.fromBytes(Uint8List bytes) {
-    int offset = 0;
-
-    final flags = bytes[offset];
-    offset += 1;
-
-    // timestamp uint64 LE
-    final ts = _readUint64(bytes, offset);
-    offset += 8;
-
-    final imuCount = bytes[offset];
-    offset += 1;
-
-    final pulseCount = bytes[offset];
-    offset += 1;
-
-    // Parse IMU samples
-    final imuSamples = <ImuSample>[];
-    for (int i = 0; i < imuCount; i++) {
-      final ax = _readInt16(bytes, offset);
-      final ay = _readInt16(bytes, offset + 2);
-      final az = _readInt16(bytes, offset + 4);
-      final gx = _readInt16(bytes, offset + 6);
-      final gy = _readInt16(bytes, offset + 8);
-      final gz = _readInt16(bytes, offset + 10);
-      offset += 12;
-
-      imuSamples.add(ImuSample(
-        ax: ax,
-        ay: ay,
-        az: az,
-        gx: gx,
-        gy: gy,
-        gz: gz,
-      ));
-    }
-
-    // Pulses uint16
-    final pulses = <int>[];
-    for (int i = 0; i < pulseCount; i++) {
-      final p = _readUint16(bytes, offset);
-      pulses.add(p);
-      offset += 2;
+    final packet = decodePacketCompact(bytes);
+    if (packet == null) {
+      throw const FormatException("Paquete compacto truncado o inválido");
     }
-
-    return BlePacket(
-      flags: flags,
-      timestamp: ts,
-      imuSamples: imuSamples,
-      pulses: pulses,
-    );
-  }
-
-  // =======================
-  // LE READ HELPERS
-  // =======================
-
-  static int _readInt16(Uint8List data, int offset) {
-    return ByteData.sublistView(data, offset, offset + 2)
-        .getInt16(0, Endian.little);
-  }
-
-  static int _readUint16(Uint8List data, int offset) {
-    return ByteData.sublistView(data, offset, offset + 2)
-        .getUint16(0, Endian.little);
-  }
-
-  static int _readUint64(Uint8List data, int offset) {
-    final bd = ByteData.sublistView(data, offset, offset + 8);
-    return bd.getUint64(0, Endian.little);
+    return packet;
   }
 }
@@ -1,67 +1,263 @@
 import 'dart:typed_data';
 import 'dart:async';
+import 'dart:math';
+import 'package:crypto/crypto.dart';
 import '../data/bluetooth/ble_manager.dart';
 
+/// OTA v2 (ver utils/ota/ota.h del firmware): tramas con número de
+/// secuencia por write without response y ACKs acumulados por notificación.
+/// Se mantienen hasta `window` tramas sin confirmar; ante un hueco o un
+/// timeout se reenvía desde la primera sin confirmar (go-back-N).
+///
+/// Si el fichero viene de tools/ota_pack o tools/ota_delta (cabecera
+/// "OTAZ"), se manda tal cual con los flags de la cabecera y el firmware lo
+/// descomprime y/o aplica el parche contra la imagen en ejecución.
+///
+/// Las imágenes sin empaquetar llevan un image_id (FNV-1a del fichero): si
+/// la transferencia se corta, al reintentar con el mismo fichero el firmware
+/// contesta en BEGIN_RSP desde qué byte seguir. Por eso ante timeouts o
+/// desconexiones no se manda ABORT (solo cuando el firmware rechaza algo).
+///
+/// También llevan en el BEGIN su SHA-256: el firmware lo va calculando al
+/// escribir y rechaza la imagen en END si no coincide. Los parches delta ya
+/// traen el hash de la imagen final dentro.
 class OtaBleService {
   final BleManager ble;
 
   OtaBleService(this.ble);
 
+  // Tipos de trama
+  static const int _begin = 0x01;
+  static const int _data = 0x02;
+  static const int _end = 0x03;
+  static const int _abort = 0x04;
+  static const int _beginRsp = 0x81;
+  static const int _ack = 0x82;
+  static const int _endRsp = 0x84;
+
+  // Estados (ota_status_t)
+  static const int _stOk = 0;
+  static const int _stBadSeq = 3;
+  static const int _stOverflow = 8;
+
+  // Flags de BEGIN
+  static const int _flagDeflate = 0x01;
+  static const int _flagDelta = 0x02;
+
+  // Cabecera "OTAZ": versión, wbits, flags (v2; en v1 siempre deflate),
+  // reservado, u32 tamaño de la imagen final
+  static const int _packHeader = 12;
+
+  static const int _ackEvery = 8;
+  static const int _dataHeader = 3;
+  static const int _beginLen = 11;
+  static const int _beginShaLen = _beginLen + 32;
+  static const Duration _ackTimeout = Duration(seconds: 2);
+  static const Duration _endTimeout = Duration(seconds: 10);
+  static const int _maxRetries = 8;
+
   Future<void> startOta(
       Uint8List firmware, {
         required Function(double) onProgress,
         required Function(String) onStatus,
       }) async {
+    if (ble.connectedDevice == null) {
+      onStatus("❌ Dispositivo no conectado");
+      return;
+    }
+
+    // Solicitar MTU grande (el firmware prefiere 256)
+    int mtu = 23;
     try {
-      if (ble.connectedDevice == null) {
-        onStatus("❌ Dispositivo no conectado");
-        return;
-      }
+      mtu = await ble.requestMtu(247);
+      onStatus("📶 MTU negociado: $mtu");
+    } catch (_) {
+      onStatus("⚠️ No se pudo solicitar MTU grande, se usará valor por defecto");
+    }
 
-      // Solicitar MTU seguro
-      int mtu = 23;
-      try {
-        mtu = await ble.requestMtu(200); // MTU recomendado para Android
-        onStatus("📶 MTU negociado: $mtu");
-      } catch (_) {
-        onStatus("⚠️ No se pudo solicitar MTU grande, se usará valor por defecto");
-      }
+    // Imagen empaquetada: se manda el cuerpo, BEGIN lleva el tamaño final
+    int imageSize = firmware.length;
+    int flags = 0;
+    if (_isPacked(firmware)) {
+      flags = firmware[4] == 1 ? _flagDeflate : firmware[6];
+      imageSize = ByteData.sublistView(firmware, 8, 12).getUint32(0, Endian.little);
+      firmware = Uint8List.sublistView(firmware, _packHeader);
+      final kind = (flags & _flagDelta) != 0 ? "Parche delta" : "Imagen comprimida";
+      onStatus("🗜️ $kind: ${firmware.length} B para una imagen de $imageSize B");
+    }
 
-      final chunkSize = mtu - 3; // ATT header
+    final rsp = _OtaResponses(ble.otaResponses());
+    try {
+      final total = firmware.length;
 
-      // Iniciar OTA
-      onStatus("🚀 Enviando comando OTA_BEGIN...");
-      await ble.send("OTA_BEGIN");
-      await Future.delayed(const Duration(milliseconds: 300));
+      onStatus("🚀 Iniciando sesión OTA...");
+      // El SHA-256 solo se conoce de la imagen sin empaquetar, y la trama
+      // tiene que caber en una escritura (MTU - 3)
+      final withSha = flags == 0 && mtu - 3 >= _beginShaLen;
+      final begin = ByteData(withSha ? _beginShaLen : _beginLen)
+        ..setUint8(0, _begin)
+        ..setUint32(1, imageSize, Endian.little)
+        ..setUint8(5, _ackEvery)
+        ..setUint8(6, flags)
+        ..setUint32(7, _imageId(firmware), Endian.little);
+      final frame = begin.buffer.asUint8List();
+      if (withSha) frame.setAll(_beginLen, sha256.convert(firmware).bytes);
+      await ble.writeOtaFrame(frame);
 
-      final total = firmware.length;
-      int sent = 0;
+      final br = await rsp.next(_beginRsp, _endTimeout);
+      if (br == null || br.length < 5) throw Exception("Sin respuesta a BEGIN");
+      if (br[1] != _stOk) throw _OtaRejected("BEGIN rechazado (estado ${br[1]})");
+      if (flags != 0 && (br.length < 6 || (br[5] & flags) != flags)) {
+        throw _OtaRejected("El firmware no acepta este tipo de imagen (flags $flags)");
+      }
+      final maxData = br[2] | (br[3] << 8);
+      final window = max(1, br[4]);
 
-      onStatus("📦 Enviando firmware...");
+      // Reanudación: el firmware ya tiene los primeros `offset` bytes
+      final offset = br.length >= 10
+          ? ByteData.sublistView(Uint8List.fromList(br), 6, 10).getUint32(0, Endian.little)
+          : 0;
+      if (offset > 0 && offset < total) {
+        onStatus("⏯️ Reanudando desde ${offset ~/ 1024} KB");
+        firmware = Uint8List.sublistView(firmware, offset);
+      }
+      final done = total - firmware.length;
 
-      while (sent < total) {
+      // ATT: MTU - 3 de cabecera, y 3 más de la trama
+      final chunk = min(mtu - 3 - _dataHeader, maxData);
+      final frames = (firmware.length + chunk - 1) ~/ chunk;
+
+      onStatus("📦 Enviando firmware ($frames tramas, ventana $window)...");
+      int base = 0; // primera trama sin confirmar
+      int next = 0; // siguiente trama a enviar
+      int retries = 0;
+
+      while (base < frames) {
         if (ble.connectedDevice == null) {
-          onStatus("❌ Dispositivo desconectado durante OTA");
-          return;
+          throw Exception("Dispositivo desconectado durante OTA");
         }
 
-        final end = (sent + chunkSize > total) ? total : sent + chunkSize;
-        final chunk = firmware.sublist(sent, end);
+        while (next < frames && next - base < window) {
+          await ble.writeOtaFrame(_dataFrame(firmware, next, chunk));
+          next++;
+        }
+
+        final r = await rsp.next(_ack, _ackTimeout);
+        if (r == null || r.length < 8) {
+          // ACK perdido o tramas perdidas: reenviar desde base
+          if (++retries > _maxRetries) throw Exception("OTA sin ACK");
+          next = base;
+          continue;
+        }
 
-        await ble.write(chunk);
-        sent = end;
+        final status = r[1];
+        final seq16 = r[2] | (r[3] << 8);
+        final acked = base + ((seq16 - base) & 0xFFFF);
 
-        onProgress(sent / total);
-        await Future.delayed(const Duration(milliseconds: 50)); // espera entre chunks
+        if (status == _stOk) {
+          if (acked > base && acked <= next) {
+            base = acked;
+            retries = 0;
+            onProgress(min(done + base * chunk, total) / total);
+          }
+        } else if (status == _stBadSeq || status == _stOverflow) {
+          // acked = trama que espera el receptor
+          if (++retries > _maxRetries) throw Exception("Demasiados reenvíos");
+          if (acked >= base && acked < next) next = acked;
+        } else {
+          throw _OtaRejected("OTA rechazada (estado $status)");
+        }
       }
 
-      onStatus("✅ Enviando comando OTA_END...");
-      await ble.send("OTA_END");
+      onStatus("✅ Finalizando OTA...");
+      await ble.writeOtaFrame(Uint8List.fromList([_end]));
+      final er = await rsp.next(_endRsp, _endTimeout);
+      if (er == null || er.length < 2) throw Exception("Sin respuesta a END");
+      if (er[1] != _stOk) throw _OtaRejected("Imagen rechazada (estado ${er[1]})");
 
       onStatus("🔥 OTA completada. Reiniciando ESP32...");
     } catch (e) {
       onStatus("❌ Error durante OTA: $e");
+      if (e is _OtaRejected) {
+        try {
+          await ble.writeOtaFrame(Uint8List.fromList([_abort]));
+        } catch (_) {}
+      }
       rethrow;
+    } finally {
+      await rsp.cancel();
+    }
+  }
+
+  /// FNV-1a de 32 bits (nunca 0: 0 = sesión no reanudable)
+  static int _imageId(Uint8List f) {
+    int h = 0x811C9DC5;
+    for (final b in f) {
+      h = ((h ^ b) * 0x01000193) & 0xFFFFFFFF;
+    }
+    return h == 0 ? 1 : h;
+  }
+
+  static bool _isPacked(Uint8List f) =>
+      f.length > _packHeader &&
+      f[0] == 0x4F && f[1] == 0x54 && f[2] == 0x41 && f[3] == 0x5A && // "OTAZ"
+      (f[4] == 1 || f[4] == 2);
+
+  Uint8List _dataFrame(Uint8List firmware, int index, int chunk) {
+    final start = index * chunk;
+    final end = min(start + chunk, firmware.length);
+    final frame = Uint8List(_dataHeader + end - start);
+    frame[0] = _data;
+    frame[1] = index & 0xFF;
+    frame[2] = (index >> 8) & 0xFF;
+    frame.setRange(_dataHeader, frame.length, firmware, start);
+    return frame;
+  }
+}
+
+/// El firmware rechazó la sesión: no tiene sentido reanudarla.
+class _OtaRejected implements Exception {
+  final String message;
+  _OtaRejected(this.message);
+
+  @override
+  String toString() => message;
+}
+
+/// Cola de respuestas del firmware para esperarlas por tipo.
+class _OtaResponses {
+  final List<List<int>> _pending = [];
+  Completer<void>? _wake;
+  late final StreamSubscription<List<int>> _sub;
+
+  _OtaResponses(Stream<List<int>> stream) {
+    _sub = stream.listen((data) {
+      if (data.isEmpty) return;
+      _pending.add(data);
+      _wake?.complete();
+      _wake = null;
+    });
+  }
+
+  /// Siguiente respuesta de [type] (descarta las de otros tipos) o null.
+  Future<List<int>?> next(int type, Duration timeout) async {
+    final deadline = DateTime.now().add(timeout);
+    while (true) {
+      while (_pending.isNotEmpty) {
+        final r = _pending.removeAt(0);
+        if (r[0] == type) return r;
+      }
+      final left = deadline.difference(DateTime.now());
+      if (left <= Duration.zero) return null;
+      _wake = Completer<void>();
+      try {
+        await _wake!.future.timeout(left);
+      } on TimeoutException {
+        _wake = null;
+        return null;
+      }
     }
   }
+
+  Future<void> cancel() => _sub.cancel();
 }
@@ -1,19 +1,23 @@
 // main.c
 #include "bluetooth.h"
 #include "utils/packet_manager.h"
+#include "utils/ota/ota.h"
 
+#include "sensors/sensor_acq.h"
 #include "sensors/mpu6050.h"
 #include "sensors/pulse_sensor.h"
+#include "sensors/simulador_imu.h"
+#include "sensors/simulador_pulso.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
-#include "esp_timer.h"
-
-#include <math.h>
 
 static const char *TAG = "MAIN";
 
+// 1 = simuladores en lugar de sensores reales (mismo camino hasta BLE)
+#define USE_SIMULATED_SENSORS 0
+
 // ===========================================
 // CONFIGURACIÓN I2C (puedes cambiarlo libremente)
 // ===========================================
@@ -22,42 +26,46 @@ static const char *TAG = "MAIN";
 #define I2C_SCL_PIN         22
 #define I2C_CLOCK_HZ        400000   // 400 kHz modo FAST
 
-// Frecuencia de lectura IMU
-#define IMU_PERIOD_MS       50       // 20 Hz reales
-
-void imu_reader_task(void *arg) {
-    mpu6050_data_t imu;
-
-    while (1) {
-        if (mpu6050_get_latest(&imu, pdMS_TO_TICKS(20)) == ESP_OK) {
-
-            // Escalar a formato compacto x100 (Opción A)
-            int16_t ax_i = (int16_t)lrintf(imu.accel_x * 100.0f);
-            int16_t ay_i = (int16_t)lrintf(imu.accel_y * 100.0f);
-            int16_t az_i = (int16_t)lrintf(imu.accel_z * 100.0f);
-
-            int16_t gx_i = (int16_t)lrintf(imu.gyro_x * 100.0f);
-            int16_t gy_i = (int16_t)lrintf(imu.gyro_y * 100.0f);
-            int16_t gz_i = (int16_t)lrintf(imu.gyro_z * 100.0f);
-
-            uint64_t ts = esp_timer_get_time() / 1000ULL;
-
-            pm_feed_imu_compact(ax_i, ay_i, az_i, gx_i, gy_i, gz_i, ts);
-
-            ESP_LOGD(TAG,
-                     "IMU REAL → ax:%d ay:%d az:%d | gx:%d gy:%d gz:%d ts:%llu",
-                     ax_i, ay_i, az_i, gx_i, gy_i, gz_i,
-                     (unsigned long long)ts);
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(IMU_PERIOD_MS));
-    }
-}
+// Muestreo IMU (FIFO del MPU6050): respiración y balistocardiografía
+#define IMU_SAMPLE_RATE_HZ  200
+
+// Pin INT del MPU6050 (GPIO_NUM_NC = sondeo). Con INT cada muestra lleva
+// el tiempo exacto de su data-ready.
+#define IMU_INT_PIN         GPIO_NUM_NC
+
+#if USE_SIMULATED_SENSORS
+#define IMU_SOURCE          (&mpu6050_sim_source)
+#define IMU_CONFIG          NULL
+#define PULSE_SOURCE        (&pulse_sensor_sim_source)
+#define IMU_RECALIBRATE     NULL
+#else
+static const mpu6050_config_t s_imu_cfg = {
+    .i2c_port = I2C_PORT,
+    .sda = I2C_SDA_PIN,
+    .scl = I2C_SCL_PIN,
+    .clk_hz = I2C_CLOCK_HZ,
+    .sample_rate_hz = IMU_SAMPLE_RATE_HZ,
+    .int_pin = IMU_INT_PIN,
+    .samples_per_wake = 0,
+    // x e y del sensor intercambiados respecto a la placa
+    .conv = {
+        .accel_fs = IMU_ACCEL_FS_2G,
+        .gyro_fs = IMU_GYRO_FS_250,
+        .accel_unit = IMU_ACCEL_CMS2,
+        .gyro_unit = IMU_GYRO_CDPS,
+        .axis = {2, 1, 3},
+    },
+};
+#define IMU_SOURCE          (&mpu6050_source)
+#define IMU_CONFIG          (&s_imu_cfg)
+#define PULSE_SOURCE        (&pulse_sensor_source)
+#define IMU_RECALIBRATE     mpu6050_request_calibration   // BLE_IMU_CAL
+#endif
 
 
 void app_main(void) {
     ESP_LOGI(TAG, "==============================");
-    ESP_LOGI(TAG, "    🚀 MODO SENSORES REALES");
+    ESP_LOGI(TAG, "    🚀 MODO %s", USE_SIMULATED_SENSORS ? "SIMULADO" : "SENSORES REALES");
     ESP_LOGI(TAG, "==============================");
 
     // Reducir ruido BLE
@@ -65,6 +73,11 @@ void app_main(void) {
     esp_log_level_set("bt_hci", ESP_LOG_NONE);
     esp_log_level_set("ble_hs", ESP_LOG_NONE);
 
+    ESP_LOGI(TAG, "➡ Inicializando OTA...");
+    if (ota_init() != ESP_OK) {
+        ESP_LOGE(TAG, "ota_init() failed");
+    }
+
     ESP_LOGI(TAG, "➡ Inicializando Bluetooth...");
     bluetooth_init();
 
@@ -74,42 +87,30 @@ void app_main(void) {
     }
 
     // ===========================================
-    //  INICIALIZAR IMU REAL (I2C1)
+    //  FUENTES DE DATOS (reales o simuladas)
     // ===========================================
-    ESP_LOGI(TAG, "➡ Inicializando IMU real MPU6050...");
-
-    esp_err_t imu_err = mpu6050_start(
-            I2C_PORT,
-            I2C_SDA_PIN,
-            I2C_SCL_PIN,
-            I2C_CLOCK_HZ,
-            IMU_PERIOD_MS,
-            4096,
-            6);
-
+    ESP_LOGI(TAG, "➡ Inicializando IMU (%s)...", IMU_SOURCE->name);
+    esp_err_t imu_err = sensor_acq_start(IMU_SOURCE, IMU_CONFIG, 4096, 6);
     if (imu_err == ESP_OK) {
-        ESP_LOGI(TAG, "MPU6050 inicializada OK");
-        ESP_LOGI(TAG, "Calibrando IMU...");
-        if (mpu6050_calibrate(200) != ESP_OK) {
-            ESP_LOGW(TAG, "Calibrado IMU fallido (pero seguimos)");
-        }
-        xTaskCreate(imu_reader_task, "imu_reader_task", 4096, NULL, 5, NULL);
+        ESP_LOGI(TAG, "IMU inicializada OK");
+        bluetooth_set_imu_cal_handler(IMU_RECALIBRATE);
     } else {
         ESP_LOGW(TAG, "IMU no disponible (error %s). Seguimos solo con pulso.",
                  esp_err_to_name(imu_err));
     }
 
-    // ===========================================
-    //   INICIALIZAR SENSOR REAL DE PULSO (ADC)
-    // ===========================================
-    ESP_LOGI(TAG, "➡ Inicializando sensor de pulso real...");
-    pulse_sensor_start();  // <-- Usa el código real que ya tienes
+    ESP_LOGI(TAG, "➡ Inicializando sensor de pulso (%s)...", PULSE_SOURCE->name);
+    esp_err_t pulse_err = sensor_acq_start(PULSE_SOURCE, NULL, 4096, 5);
+    if (pulse_err != ESP_OK) {
+        ESP_LOGW(TAG, "Pulso no disponible (error %s)", esp_err_to_name(pulse_err));
+    }
 
     // ===========================================
     //  MAIN LOOP (solo debug)
     // ===========================================
     while (1) {
-        ESP_LOGI(TAG, "Sistema funcionando (sensores reales)...");
+        ESP_LOGI(TAG, "Sistema funcionando (%s)...",
+                 USE_SIMULATED_SENSORS ? "sensores simulados" : "sensores reales");
         vTaskDelay(pdMS_TO_TICKS(3000));
     }
 }
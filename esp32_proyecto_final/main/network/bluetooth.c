@@ -1,11 +1,18 @@
 #include "../utils/ota/ota.h"
+#include "../utils/packet_manager.h"
 #include "bluetooth.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
 #include "nvs_flash.h"
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
+#include <stdio.h>
 #include <string.h>
 
 static const char *TAG = "BLE_BIDIRECTIONAL";
@@ -15,18 +22,369 @@ static struct ble_gap_adv_params adv_params;
 
 /* Buffers */
 static char device_message[64] = "Hola desde ESP32 NimBLE!";
-static char received_message[64] = "";
 
 /* Handle de la característica de notificación */
 static uint16_t notify_handle;
 
-/* Guardamos el handle de conexión actual para usar en notificaciones */
-static int16_t g_conn_handle = -1;
+/* Característica OTA v2: handle y cliente de la sesión (respuestas y
+ * suspensión si se desconecta; también para v1) */
+static uint16_t ota_handle;
+static volatile uint16_t s_ota_conn = BLE_HS_CONN_HANDLE_NONE;
+
+/* Autoprueba de ingesta OTA (BLE_OTA_TEST): mientras corre, la tarea de la
+ * prueba es la única productora del pool OTA y se rechazan las escrituras
+ * OTA de los clientes. */
+#define BT_OTA_TEST_MAX_KIB  1024
+static TaskHandle_t s_ota_test_task;
+static volatile bool s_ota_test_active;
+static size_t s_ota_test_bytes;
+static esp_err_t bluetooth_ota_test_start(size_t bytes);
+
+/* Estado por conexión (varios centrales a la vez: móvil + registrador).
+ *
+ * Control de flujo: ble_gattc_notify_custom no espera al aire; si el
+ * controlador no tiene buffers ACL libres, NimBLE deja el mbuf en la cola de
+ * la conexión y solo lo libera cuando sale. Cada peer tiene un pool de mbufs
+ * propio (un bloque por notificación), así que los bloques ocupados que no
+ * están en retry[] son exactamente sus notificaciones en vuelo; los créditos
+ * vuelven al liberarse los mbuf transmitidos y un peer lento no agota el
+ * pool msys ni frena a los demás. Sin créditos, el paquete espera en retry[]. */
+#ifdef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define BT_MAX_PEERS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#else
+#define BT_MAX_PEERS 3
+#endif
+#define BT_PEER_MAX_IN_FLIGHT 4    /* notificaciones en vuelo por peer */
+#define BT_NOTIFY_RETRY_LEN   2    /* paquetes construidos esperando crédito */
+#define BT_PEER_TX_BLOCKS     (BT_PEER_MAX_IN_FLIGHT + BT_NOTIFY_RETRY_LEN)
+#define BT_PEER_TX_BLOCK_SIZE 320  /* os_mbuf + pkthdr + cabeceras + MTU 256 */
+#define BT_NOTIFY_LEADING     16   /* hueco para cabeceras HCI ACL + L2CAP + ATT */
+
+/* Canal L2CAP CoC (opcional): NimBLE trocea cada SDU en K-frames copiando a
+ * mbufs msys y libera el nuestro al terminar, así que el bloque del pool del
+ * peer vuelve antes; lo que limita lo que va en vuelo son los créditos L2CAP
+ * del cliente (ble_l2cap_send devuelve BLE_HS_ESTALLED al agotarlos y llega
+ * TX_UNSTALLED cuando manda más). La telemetría se limita al mismo tamaño que
+ * una notificación para que quepa en un bloque del pool. */
+#if defined(CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM) && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0
+#define BT_COC_ENABLED 1
+#else
+#define BT_COC_ENABLED 0
+#endif
+#ifdef CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU
+#define BT_COC_TELEMETRY_MAX  (CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU - 3)
+#else
+#define BT_COC_TELEMETRY_MAX  244
+#endif
+#define BT_BULK_TIMEOUT_MS    2000 /* sin avance del enlace: se aborta el envío */
+
+typedef struct {
+  bool in_use;
+  bool subscribed;               /* CCCD de notificaciones activado */
+  uint16_t conn_handle;
+  uint16_t mtu;
+  uint8_t retry_head;
+  uint8_t retry_count;
+  struct os_mbuf *retry[BT_NOTIFY_RETRY_LEN];
+  uint32_t dropped;              /* paquetes perdidos con el retry lleno */
+  bt_link_info_t link;
+  struct ble_l2cap_chan *coc;    /* canal L2CAP abierto por el cliente o NULL */
+  uint16_t coc_mtu;              /* SDU máximo que acepta el cliente */
+  bool coc_stalled;              /* sin créditos L2CAP hasta TX_UNSTALLED */
+  uint32_t coc_unstalls;         /* TX_UNSTALLED recibidos (ver coc_send) */
+  struct os_mempool tx_mp;
+  struct os_mbuf_pool tx_pool;
+} bt_peer_t;
+
+static bt_peer_t s_peers[BT_MAX_PEERS];
+static os_membuf_t s_peer_tx_mem[BT_MAX_PEERS]
+                                [OS_MEMPOOL_SIZE(BT_PEER_TX_BLOCKS, BT_PEER_TX_BLOCK_SIZE)];
+static portMUX_TYPE s_peers_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_notify_tx_fail = 0;
+
+static volatile bt_transport_t s_transport = BT_TRANSPORT_NOTIFY;
+/* Serializa ble_l2cap_send con el cierre del canal (el puntero del canal no
+ * puede usarse fuera de la tarea del host sin esto) */
+static SemaphoreHandle_t s_coc_lock;
+static TaskHandle_t s_coc_waiter;           /* envío bloqueado esperando créditos */
+
+/* Recalibrado de la IMU (BLE_IMU_CAL): lo registra main */
+static volatile bt_imu_cal_fn_t s_imu_cal_fn;
+
+/* Medida de throughput (bluetooth_benchmark_start) */
+#define BT_BENCH_CHUNK     BT_L2CAP_COC_MTU
+#define BT_BENCH_MAX_BYTES (1024 * 1024)
+static TaskHandle_t s_bench_task;
+static volatile bool s_bench_active;
+static bt_transport_t s_bench_transport;
+static size_t s_bench_bytes;
+
+/* Ajuste del enlace tras conectar: PHY, data length y parámetros de conexión
+ * según el perfil activo. Lo conseguido se guarda en bt_peer_t.link. */
+#define BT_LINK_TX_OCTETS 251    /* máximo LL payload (data length extension) */
+#define BT_LINK_TX_TIME   2120   /* us para 251 bytes en 1M PHY */
+
+typedef struct {
+  uint16_t itvl_min;             /* unidades de 1.25 ms */
+  uint16_t itvl_max;
+  uint16_t latency;              /* eventos que el periférico puede saltarse */
+  uint16_t supervision_timeout;  /* unidades de 10 ms */
+} bt_conn_profile_t;
+
+static const bt_conn_profile_t s_profiles[] = {
+  /* STREAMING: 60-75 ms con latencia 4, para toda la noche */
+  [BT_LINK_PROFILE_STREAMING] = { 48, 60, 4, 600 },
+  /* BULK: 7.5-15 ms sin latencia, para OTA o volcados */
+  [BT_LINK_PROFILE_BULK]      = { 6, 12, 0, 400 },
+};
+
+static volatile bt_link_profile_t s_link_profile = BT_LINK_PROFILE_STREAMING;
 
 /* UUIDs personalizados (128-bit) */
 #define SERVICE_UUID       BLE_UUID128_DECLARE(0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xEF,0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xEF)
 #define CHAR_WRITE_UUID    BLE_UUID128_DECLARE(0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xEF,0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xE1)
 #define CHAR_NOTIFY_UUID   BLE_UUID128_DECLARE(0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xEF,0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xE2)
+#define CHAR_STATS_UUID    BLE_UUID128_DECLARE(0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xEF,0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xE3)
+#define CHAR_LINK_UUID     BLE_UUID128_DECLARE(0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xEF,0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xE4)
+#define CHAR_OTA_UUID      BLE_UUID128_DECLARE(0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xEF,0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xE5)
+
+/* ------------------------------------------------------ */
+/* Tabla de peers (llamar con s_peers_lock tomado)        */
+/* ------------------------------------------------------ */
+static bt_peer_t *peer_find(uint16_t conn_handle) {
+  for (int i = 0; i < BT_MAX_PEERS; i++) {
+    if (s_peers[i].in_use && s_peers[i].conn_handle == conn_handle) return &s_peers[i];
+  }
+  return NULL;
+}
+
+static bt_peer_t *peer_add(uint16_t conn_handle) {
+  for (int i = 0; i < BT_MAX_PEERS; i++) {
+    bt_peer_t *p = &s_peers[i];
+    if (p->in_use) continue;
+    p->in_use = true;
+    p->subscribed = false;
+    p->conn_handle = conn_handle;
+    p->mtu = 23;
+    p->dropped = 0;
+    p->coc = NULL;
+    p->coc_mtu = 0;
+    p->coc_stalled = false;
+    p->coc_unstalls = 0;
+    memset(&p->link, 0, sizeof(p->link));
+    p->link.connected = true;
+    p->link.tx_phy = 1;
+    p->link.rx_phy = 1;
+    p->link.tx_octets = 27;      /* valores por defecto del LL hasta que cambien */
+    p->link.rx_octets = 27;
+    p->link.profile = s_link_profile;
+    return p;
+  }
+  return NULL;
+}
+
+/* Saca los paquetes retenidos del peer; se liberan fuera del lock */
+static int peer_take_retry(bt_peer_t *p, struct os_mbuf **out) {
+  int n = 0;
+  while (p->retry_count) {
+    out[n++] = p->retry[p->retry_head];
+    p->retry_head = (p->retry_head + 1) % BT_NOTIFY_RETRY_LEN;
+    p->retry_count--;
+  }
+  p->retry_head = 0;
+  return n;
+}
+
+/* Notificaciones que el peer puede tener aún en vuelo. held = mbufs de su
+ * pool que tenemos en la mano y todavía no se han entregado a NimBLE. */
+static inline int peer_credits(const bt_peer_t *p, int held) {
+  int in_flight = BT_PEER_TX_BLOCKS - p->tx_mp.mp_num_free - p->retry_count - held;
+  return BT_PEER_MAX_IN_FLIGHT - in_flight;
+}
+
+/* La telemetría de este peer va por su canal L2CAP */
+static inline bool peer_uses_coc(const bt_peer_t *p) {
+  return s_transport == BT_TRANSPORT_L2CAP && p->coc != NULL;
+}
+
+/* El peer recibe telemetría: notificaciones activadas o canal L2CAP */
+static inline bool peer_receives(const bt_peer_t *p) {
+  return p->in_use && (p->subscribed || peer_uses_coc(p));
+}
+
+/* Payload máximo de un paquete de telemetría para el peer */
+static inline uint16_t peer_payload_max(const bt_peer_t *p) {
+  if (peer_uses_coc(p)) {
+    return (p->coc_mtu < BT_COC_TELEMETRY_MAX) ? p->coc_mtu : BT_COC_TELEMETRY_MAX;
+  }
+  return p->mtu - 3;
+}
+
+/* Puede entregar ya un paquete (créditos propios y, por L2CAP, del canal) */
+static inline bool peer_tx_open(const bt_peer_t *p, int held) {
+  if (peer_uses_coc(p) && p->coc_stalled) return false;
+  return peer_credits(p, held) > 0;
+}
+
+/* ------------------------------------------------------ */
+/* Ajuste del enlace (PHY, data length, intervalo)        */
+/* ------------------------------------------------------ */
+static void link_refresh_params(uint16_t conn_handle) {
+  struct ble_gap_conn_desc desc;
+  if (ble_gap_conn_find(conn_handle, &desc) != 0) return;
+
+  portENTER_CRITICAL(&s_peers_lock);
+  bt_peer_t *p = peer_find(conn_handle);
+  if (p) {
+    p->link.conn_itvl = desc.conn_itvl;
+    p->link.conn_latency = desc.conn_latency;
+    p->link.supervision_timeout = desc.supervision_timeout;
+  }
+  portEXIT_CRITICAL(&s_peers_lock);
+
+  ESP_LOGI(TAG, "Enlace %u: intervalo %u.%02u ms, latencia %u, timeout %u ms",
+           conn_handle, desc.conn_itvl * 125 / 100, desc.conn_itvl * 125 % 100,
+           desc.conn_latency, desc.supervision_timeout * 10);
+}
+
+static void link_apply_profile(uint16_t conn_handle, bt_link_profile_t profile) {
+  const bt_conn_profile_t *p = &s_profiles[profile];
+  struct ble_gap_upd_params params = {
+    .itvl_min = p->itvl_min,
+    .itvl_max = p->itvl_max,
+    .latency = p->latency,
+    .supervision_timeout = p->supervision_timeout,
+    .min_ce_len = 0,
+    .max_ce_len = 0,
+  };
+  int rc = ble_gap_update_params(conn_handle, &params);
+  if (rc != 0) {
+    ESP_LOGW(TAG, "ble_gap_update_params rc=%d", rc);
+  }
+}
+
+static void link_tune(uint16_t conn_handle) {
+  int rc;
+
+#if CONFIG_BT_NIMBLE_LL_CFG_FEAT_LE_2M_PHY
+  rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                   BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+  if (rc != 0) {
+    ESP_LOGW(TAG, "ble_gap_set_prefered_le_phy rc=%d", rc);
+  }
+#endif
+  /* El ESP32 clásico (controlador 4.2) no tiene 2M PHY: se queda en 1M */
+
+  rc = ble_gap_set_data_len(conn_handle, BT_LINK_TX_OCTETS, BT_LINK_TX_TIME);
+  if (rc != 0) {
+    ESP_LOGW(TAG, "ble_gap_set_data_len rc=%d", rc);
+  }
+
+  link_apply_profile(conn_handle, s_link_profile);
+  link_refresh_params(conn_handle);
+}
+
+/* ------------------------------------------------------ */
+/* Comandos del cliente                                   */
+/* ------------------------------------------------------ */
+static bool parse_transport(const char *name, bt_transport_t *out) {
+  if (strcmp(name, "NOTIFY") == 0) {
+    *out = BT_TRANSPORT_NOTIFY;
+  } else if (strcmp(name, "L2CAP") == 0) {
+    *out = BT_TRANSPORT_L2CAP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/* Los fragmentos llegan como cadena de mbufs (ATT o SDU L2CAP); la OTA los
+ * copia directamente a su pool, sin buffer intermedio ni truncado. */
+static int mbuf_copy(const void *src, size_t off, size_t len, uint8_t *dst) {
+  return os_mbuf_copydata((const struct os_mbuf *)src, (int)off, (int)len, dst);
+}
+
+/* "BLE_TRANSPORT NOTIFY|L2CAP", "BLE_BENCH NOTIFY|L2CAP [KiB]",
+ * "BLE_OTA_TEST [KiB]" y "BLE_IMU_CAL [muestras]" (IMU en reposo).
+ * Devuelve false si no es un comando BLE_* (se pasa a la OTA). */
+static bool bt_command(struct os_mbuf *om) {
+  char cmd[32];
+  size_t len = OS_MBUF_PKTLEN(om);
+  if (len < 4 || len >= sizeof(cmd) || os_mbuf_cmpf(om, 0, "BLE_", 4) != 0) return false;
+  os_mbuf_copydata(om, 0, len, cmd);
+  cmd[len] = '\0';
+  ESP_LOGI(TAG, "📩 Comando del cliente: %s", cmd);
+
+  char name[8];
+  unsigned kib = 64;
+  bt_transport_t t;
+  if (sscanf(cmd, "BLE_TRANSPORT %7s", name) == 1 && parse_transport(name, &t)) {
+    esp_err_t err = bluetooth_set_transport(t);
+    ESP_LOGI(TAG, "Transporte %s: %s", name, esp_err_to_name(err));
+  } else if (sscanf(cmd, "BLE_BENCH %7s %u", name, &kib) >= 1 && parse_transport(name, &t)) {
+    esp_err_t err = bluetooth_benchmark_start(t, (size_t)kib * 1024);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Benchmark %s: %s", name, esp_err_to_name(err));
+  } else if (strncmp(cmd, "BLE_OTA_TEST", 12) == 0) {
+    sscanf(cmd + 12, "%u", &kib);
+    esp_err_t err = bluetooth_ota_test_start((size_t)kib * 1024);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Prueba OTA: %s", esp_err_to_name(err));
+  } else if (strncmp(cmd, "BLE_IMU_CAL", 11) == 0) {
+    unsigned samples = 0;
+    sscanf(cmd + 11, "%u", &samples);
+    bt_imu_cal_fn_t fn = s_imu_cal_fn;
+    esp_err_t err = fn ? fn(samples) : ESP_ERR_NOT_SUPPORTED;
+    if (err != ESP_OK) ESP_LOGW(TAG, "Calibrado IMU: %s", esp_err_to_name(err));
+  } else {
+    ESP_LOGW(TAG, "Comando desconocido: %s", cmd);
+  }
+  return true;
+}
+
+/* La OTA va con intervalo corto; al terminar se vuelve al perfil lento */
+static void ota_follow_profile(bool ota_was_active) {
+  if (ota_is_in_progress() != ota_was_active) {
+    bluetooth_set_link_profile(ota_was_active ? BT_LINK_PROFILE_STREAMING
+                                              : BT_LINK_PROFILE_BULK);
+  }
+}
+
+/* Escritura del cliente (característica de escritura o canal L2CAP).
+ * om sigue siendo de quien llama. */
+static void client_write(uint16_t conn_handle, struct os_mbuf *om) {
+  if (!ota_is_in_progress() && bt_command(om)) return;
+  if (s_ota_test_active) {
+    ESP_LOGW(TAG, "Escritura OTA rechazada: prueba de ingesta en curso");
+    return;
+  }
+
+  bool ota_was_active = ota_is_in_progress();
+  if (ota_was_active && conn_handle != s_ota_conn) {
+    ESP_LOGW(TAG, "Escritura OTA de %u rechazada: la sesión es de %u", conn_handle, s_ota_conn);
+    return;
+  }
+  ota_process_chunk_from(om, OS_MBUF_PKTLEN(om), mbuf_copy);
+  if (!ota_was_active && ota_is_in_progress()) s_ota_conn = conn_handle;
+  ota_follow_profile(ota_was_active);
+}
+
+static void ota_reply_to(uint16_t conn, const uint8_t *data, size_t len) {
+  if (conn == BLE_HS_CONN_HANDLE_NONE || ota_handle == 0) return;
+
+  struct os_mbuf *om = ble_hs_mbuf_from_flat(data, len);
+  if (!om) {
+    ESP_LOGW(TAG, "Sin mbuf para la respuesta OTA");
+    return;
+  }
+  int rc = ble_gattc_notify_custom(conn, ota_handle, om);
+  if (rc != 0) {
+    ESP_LOGW(TAG, "Respuesta OTA a %u rc=%d", conn, rc);
+  }
+}
+
+/* Respuestas OTA v2: notificación al cliente de la sesión */
+static void ota_reply(const uint8_t *data, size_t len) {
+  ota_reply_to(s_ota_conn, data, len);
+}
 
 /* ------------------------------------------------------ */
 /* Callback de lectura/escritura                          */
@@ -38,20 +396,68 @@ static int gatt_char_access_cb(uint16_t conn_handle, uint16_t attr_handle,
     os_mbuf_append(ctxt->om, device_message, strlen(device_message));
     ESP_LOGI(TAG, "Cliente leyó mensaje: %s", device_message);
   }
-  /* Si es escritura: copiamos en received_message */
+  /* Si es escritura: comando o fragmento OTA, leído del mbuf tal cual */
   else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
-    int len = OS_MBUF_PKTLEN(ctxt->om);
-    if (len > sizeof(received_message) - 1) len = sizeof(received_message) - 1;
-    os_mbuf_copydata(ctxt->om, 0, len, received_message);
-    received_message[len] = '\0';
-    ESP_LOGI(TAG, "📩 Mensaje recibido del cliente: %s", received_message);
+    client_write(conn_handle, ctxt->om);
+  }
+  return 0;
+}
+
+/* Tramas OTA v2 (write without response) */
+static int gatt_ota_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg) {
+  if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) return BLE_ATT_ERR_UNLIKELY;
 
-  ota_process_chunk((uint8_t *)received_message, len);
+  uint16_t len = OS_MBUF_PKTLEN(ctxt->om);
+  if (len > OTA_BLOCK_SIZE) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  if (s_ota_test_active) return BLE_ATT_ERR_UNLIKELY;
 
+  /* Con varios clientes conectados la sesión es de quien la abrió: las
+   * tramas de otro no entran en ella ni le roban las respuestas (ni la
+   * suspensión al desconectarse, que mira s_ota_conn) */
+  bool ota_was_active = ota_is_in_progress();
+  if (ota_was_active && conn_handle != s_ota_conn) {
+    uint8_t type = 0;
+    os_mbuf_copydata(ctxt->om, 0, 1, &type);
+    if (type != OTA_V2_DATA && type != OTA_V2_ABORT) {
+      uint8_t msg[2] = { (uint8_t)(type | 0x80), OTA_ST_BUSY };
+      ota_reply_to(conn_handle, msg, sizeof(msg));
+    }
+    return 0;
   }
+  s_ota_conn = conn_handle;   /* sin sesión: respuestas a quien pregunta */
+
+  ota_process_frame_from(ctxt->om, len, mbuf_copy);
+  ota_follow_profile(ota_was_active);
   return 0;
 }
 
+/* Lectura de contadores de pérdidas del packet manager (pm_stats_serialize) */
+static int gatt_stats_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                                struct ble_gatt_access_ctxt *ctxt, void *arg) {
+  if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) return BLE_ATT_ERR_UNLIKELY;
+
+  uint8_t buf[PM_STATS_WIRE_LEN];
+  int len = pm_stats_serialize(buf, sizeof(buf));
+  if (len < 0) return BLE_ATT_ERR_UNLIKELY;
+
+  int rc = os_mbuf_append(ctxt->om, buf, len);
+  return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+/* Lectura de los parámetros del enlace conseguidos (bluetooth_link_serialize) */
+static int gatt_link_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg) {
+  if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) return BLE_ATT_ERR_UNLIKELY;
+
+  uint8_t buf[BT_LINK_WIRE_LEN];
+  int len = bluetooth_link_serialize(conn_handle, buf, sizeof(buf));
+  if (len < 0) return BLE_ATT_ERR_UNLIKELY;
+
+  int rc = os_mbuf_append(ctxt->om, buf, len);
+  return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
 /* ------------------------------------------------------ */
 /* Servicio GATT personalizado                            */
 /* ------------------------------------------------------ */
@@ -73,6 +479,25 @@ static const struct ble_gatt_svc_def gatt_svr_defs[] = {
         .val_handle = &notify_handle,
         .flags = BLE_GATT_CHR_F_NOTIFY,
       },
+      {
+        /* Contadores de pérdidas/errores del enlace (solo lectura) */
+        .uuid = CHAR_STATS_UUID,
+        .access_cb = gatt_stats_access_cb,
+        .flags = BLE_GATT_CHR_F_READ,
+      },
+      {
+        /* PHY / data length / intervalo conseguidos (solo lectura) */
+        .uuid = CHAR_LINK_UUID,
+        .access_cb = gatt_link_access_cb,
+        .flags = BLE_GATT_CHR_F_READ,
+      },
+      {
+        /* OTA v2: tramas con seq (sin respuesta) y ACKs por notificación */
+        .uuid = CHAR_OTA_UUID,
+        .access_cb = gatt_ota_access_cb,
+        .val_handle = &ota_handle,
+        .flags = BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY,
+      },
       {0}
     },
   },
@@ -82,29 +507,334 @@ static const struct ble_gatt_svc_def gatt_svr_defs[] = {
 /* ------------------------------------------------------ */
 /* GAP event handler                                      */
 /* ------------------------------------------------------ */
+static int ble_gap_event(struct ble_gap_event *event, void *arg);
+
+static void advertise_if_room(void) {
+  int used = 0;
+  portENTER_CRITICAL(&s_peers_lock);
+  for (int i = 0; i < BT_MAX_PEERS; i++) used += s_peers[i].in_use;
+  portEXIT_CRITICAL(&s_peers_lock);
+
+  if (used < BT_MAX_PEERS && !ble_gap_adv_active()) {
+    ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER, &adv_params,
+                      ble_gap_event, NULL);
+  }
+}
+
+/* El packet manager solo construye paquetes si alguien los recibe (y no
+ * hay una medida de throughput ocupando el enlace) */
+static void update_transmit(void) {
+  bool any = false;
+  portENTER_CRITICAL(&s_peers_lock);
+  for (int i = 0; i < BT_MAX_PEERS; i++) {
+    any |= peer_receives(&s_peers[i]);
+  }
+  portEXIT_CRITICAL(&s_peers_lock);
+  pm_set_transmit(any && !s_bench_active);
+}
+
+/* ------------------------------------------------------ */
+/* Canal L2CAP CoC                                        */
+/* ------------------------------------------------------ */
+static void coc_wake_waiter(void) {
+  TaskHandle_t waiter = s_coc_waiter;
+  if (waiter) xTaskNotifyGive(waiter);
+}
+
+/* Olvida el canal del peer. Espera a que no haya un ble_l2cap_send en curso
+ * con él; el timeout evita un interbloqueo si NimBLE nos llama con su lock
+ * tomado y el envío está esperando ese lock. */
+static void coc_forget(uint16_t conn_handle) {
+  bool locked = s_coc_lock && xSemaphoreTake(s_coc_lock, pdMS_TO_TICKS(100)) == pdTRUE;
+  portENTER_CRITICAL(&s_peers_lock);
+  bt_peer_t *p = peer_find(conn_handle);
+  if (p) {
+    p->coc = NULL;
+    p->coc_mtu = 0;
+    p->coc_stalled = false;
+  }
+  portEXIT_CRITICAL(&s_peers_lock);
+  if (locked) xSemaphoreGive(s_coc_lock);
+  coc_wake_waiter();
+}
+
+/* Manda un SDU por el canal del peer. Consume om salvo si devuelve
+ * ESP_ERR_NOT_FOUND (sin canal: el llamante puede usar notify). */
+static esp_err_t coc_send(uint16_t conn_handle, struct os_mbuf *om) {
+  if (!s_coc_lock) return ESP_ERR_NOT_FOUND;
+  xSemaphoreTake(s_coc_lock, portMAX_DELAY);
+
+  portENTER_CRITICAL(&s_peers_lock);
+  bt_peer_t *p = peer_find(conn_handle);
+  struct ble_l2cap_chan *chan = p ? p->coc : NULL;
+  uint32_t unstalls = p ? p->coc_unstalls : 0;
+  portEXIT_CRITICAL(&s_peers_lock);
+
+  if (!chan) {
+    xSemaphoreGive(s_coc_lock);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  int rc = ble_l2cap_send(chan, om);
+  if (rc == BLE_HS_ESTALLED) {
+    /* el SDU queda en cola de NimBLE; si TX_UNSTALLED llegó mientras
+     * tanto, no hay que marcar el canal como bloqueado */
+    portENTER_CRITICAL(&s_peers_lock);
+    p = peer_find(conn_handle);
+    if (p && p->coc == chan && p->coc_unstalls == unstalls) p->coc_stalled = true;
+    portEXIT_CRITICAL(&s_peers_lock);
+  }
+  xSemaphoreGive(s_coc_lock);
+
+  if (rc == 0 || rc == BLE_HS_ESTALLED) return ESP_OK;
+  /* EBADDATA (SDU > MTU del cliente) y EBUSY se rechazan antes de tomar el
+   * mbuf; en el resto de errores NimBLE ya lo liberó */
+  if (rc == BLE_HS_EBADDATA || rc == BLE_HS_EBUSY) os_mbuf_free_chain(om);
+  ESP_LOGE(TAG, "ble_l2cap_send a %u rc=%d", conn_handle, rc);
+  return ESP_FAIL;
+}
+
+/* Espera a que el canal del peer tenga créditos */
+static esp_err_t coc_wait_unstalled(uint16_t conn_handle) {
+  for (;;) {
+    portENTER_CRITICAL(&s_peers_lock);
+    bt_peer_t *p = peer_find(conn_handle);
+    bool open = p && p->coc;
+    bool stalled = open && p->coc_stalled;
+    portEXIT_CRITICAL(&s_peers_lock);
+
+    if (!open) return ESP_ERR_INVALID_STATE;
+    if (!stalled) return ESP_OK;
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BT_BULK_TIMEOUT_MS)) == 0) {
+      return ESP_ERR_TIMEOUT;
+    }
+  }
+}
+
+#if BT_COC_ENABLED
+/* Entrega a NimBLE un mbuf vacío para el siguiente SDU entrante */
+static int coc_rx_ready(struct ble_l2cap_chan *chan) {
+  struct os_mbuf *sdu = os_msys_get_pkthdr(0, 0);
+  if (!sdu) return BLE_HS_ENOMEM;
+  int rc = ble_l2cap_recv_ready(chan, sdu);
+  if (rc != 0) os_mbuf_free_chain(sdu);
+  return rc;
+}
+
+static int coc_event(struct ble_l2cap_event *event, void *arg) {
+  switch (event->type) {
+    case BLE_L2CAP_EVENT_COC_ACCEPT: {
+      /* un canal por cliente */
+      portENTER_CRITICAL(&s_peers_lock);
+      bt_peer_t *p = peer_find(event->accept.conn_handle);
+      bool busy = !p || p->coc;
+      portEXIT_CRITICAL(&s_peers_lock);
+      if (busy) return BLE_HS_EALREADY;
+      return coc_rx_ready(event->accept.chan);
+    }
+
+    case BLE_L2CAP_EVENT_COC_CONNECTED: {
+      uint16_t conn = event->connect.conn_handle;
+      if (event->connect.status != 0) {
+        ESP_LOGW(TAG, "Canal L2CAP %u fallido (%d)", conn, event->connect.status);
+        break;
+      }
+      struct ble_l2cap_chan_info info;
+      uint16_t mtu = BT_L2CAP_COC_MTU;
+      if (ble_l2cap_get_chan_info(event->connect.chan, &info) == 0) mtu = info.peer_coc_mtu;
+
+      portENTER_CRITICAL(&s_peers_lock);
+      bt_peer_t *p = peer_find(conn);
+      if (p) {
+        p->coc = event->connect.chan;
+        p->coc_mtu = mtu;
+        p->coc_stalled = false;
+      }
+      portEXIT_CRITICAL(&s_peers_lock);
+
+      if (!p) {
+        ble_l2cap_disconnect(event->connect.chan);
+        break;
+      }
+      ESP_LOGI(TAG, "Canal L2CAP abierto con %u (SDU %u bytes)", conn, mtu);
+      if (s_transport == BT_TRANSPORT_L2CAP) pm_request_epoch();
+      update_transmit();
+      break;
+    }
+
+    case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+      coc_forget(event->disconnect.conn_handle);
+      ESP_LOGI(TAG, "Canal L2CAP cerrado con %u", event->disconnect.conn_handle);
+      update_transmit();
+      break;
+
+    case BLE_L2CAP_EVENT_COC_DATA_RECEIVED: {
+      /* Un SDU del cliente equivale a una escritura en la característica */
+      struct os_mbuf *sdu = event->receive.sdu_rx;
+      if (sdu) {
+        client_write(event->receive.conn_handle, sdu);
+        os_mbuf_free_chain(sdu);
+      }
+      coc_rx_ready(event->receive.chan);
+      break;
+    }
+
+    case BLE_L2CAP_EVENT_COC_TX_UNSTALLED: {
+      portENTER_CRITICAL(&s_peers_lock);
+      bt_peer_t *p = peer_find(event->tx_unstalled.conn_handle);
+      if (p) {
+        p->coc_stalled = false;
+        p->coc_unstalls++;
+      }
+      portEXIT_CRITICAL(&s_peers_lock);
+      coc_wake_waiter();
+      break;
+    }
+
+    default:
+      break;
+  }
+  return 0;
+}
+#endif
+
 static int ble_gap_event(struct ble_gap_event *event, void *arg) {
   switch (event->type) {
     case BLE_GAP_EVENT_CONNECT:
       if (event->connect.status == 0) {
-        /* Guardamos el handle de la conexión para usarlo en notificaciones */
-        g_conn_handle = event->connect.conn_handle;
-        ESP_LOGI(TAG, "✅ Cliente conectado (handle=%d).", g_conn_handle);
+        uint16_t conn = event->connect.conn_handle;
+        uint16_t mtu = ble_att_mtu(conn);
+        portENTER_CRITICAL(&s_peers_lock);
+        bt_peer_t *p = peer_add(conn);
+        if (p && mtu >= 23) p->mtu = mtu;
+        portEXIT_CRITICAL(&s_peers_lock);
+
+        if (!p) {
+          ESP_LOGW(TAG, "Sin hueco para el cliente %u, desconectando", conn);
+          ble_gap_terminate(conn, BLE_ERR_REM_USER_CONN_TERM);
+          break;
+        }
+        ESP_LOGI(TAG, "✅ Cliente conectado (handle=%d).", conn);
+        link_tune(conn);
       } else {
         ESP_LOGI(TAG, "❌ Fallo de conexión, reiniciando advertising...");
-        g_conn_handle = -1;
-        ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER, &adv_params,
-                          ble_gap_event, NULL);
       }
+      /* Seguir anunciando mientras queden conexiones libres */
+      advertise_if_room();
+      break;
+
+    case BLE_GAP_EVENT_SUBSCRIBE:
+      /* CCCD de la característica de telemetría */
+      if (event->subscribe.attr_handle == notify_handle) {
+        portENTER_CRITICAL(&s_peers_lock);
+        bt_peer_t *p = peer_find(event->subscribe.conn_handle);
+        if (p) p->subscribed = event->subscribe.cur_notify;
+        portEXIT_CRITICAL(&s_peers_lock);
+        ESP_LOGI(TAG, "Cliente %u %s notificaciones", event->subscribe.conn_handle,
+                 event->subscribe.cur_notify ? "activa" : "desactiva");
+
+        /* El suscriptor nuevo necesita una epoch para interpretar los deltas */
+        if (event->subscribe.cur_notify && !event->subscribe.prev_notify) {
+          pm_request_epoch();
+        }
+        update_transmit();
+      }
+      break;
+
+    case BLE_GAP_EVENT_MTU: {
+      portENTER_CRITICAL(&s_peers_lock);
+      bt_peer_t *p = peer_find(event->mtu.conn_handle);
+      if (p) p->mtu = event->mtu.value;
+      portEXIT_CRITICAL(&s_peers_lock);
+      ESP_LOGI(TAG, "MTU %u: %u", event->mtu.conn_handle, event->mtu.value);
+      break;
+    }
+
+    case BLE_GAP_EVENT_CONN_UPDATE:
+      if (event->conn_update.status == 0) {
+        link_refresh_params(event->conn_update.conn_handle);
+      } else {
+        ESP_LOGW(TAG, "Actualización de parámetros rechazada (%d)", event->conn_update.status);
+      }
+      break;
+
+#if CONFIG_BT_NIMBLE_LL_CFG_FEAT_LE_2M_PHY
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+      if (event->phy_updated.status == 0) {
+        portENTER_CRITICAL(&s_peers_lock);
+        bt_peer_t *p = peer_find(event->phy_updated.conn_handle);
+        if (p) {
+          p->link.tx_phy = event->phy_updated.tx_phy;
+          p->link.rx_phy = event->phy_updated.rx_phy;
+        }
+        portEXIT_CRITICAL(&s_peers_lock);
+        ESP_LOGI(TAG, "PHY tx=%uM rx=%uM", event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+      }
+      break;
+#endif
+
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+    case BLE_GAP_EVENT_DATA_LEN_CHG: {
+      portENTER_CRITICAL(&s_peers_lock);
+      bt_peer_t *p = peer_find(event->data_len_chg.conn_handle);
+      if (p) {
+        p->link.tx_octets = event->data_len_chg.max_tx_octets;
+        p->link.rx_octets = event->data_len_chg.max_rx_octets;
+      }
+      portEXIT_CRITICAL(&s_peers_lock);
+      ESP_LOGI(TAG, "Data length tx=%u rx=%u bytes",
+               event->data_len_chg.max_tx_octets, event->data_len_chg.max_rx_octets);
       break;
+    }
+#endif
 
-    case BLE_GAP_EVENT_DISCONNECT:
-      ESP_LOGI(TAG, "🔌 Cliente desconectado. Reiniciando advertising...");
-      /* limpiar handle */
-      g_conn_handle = -1;
-      ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER, &adv_params,
-                        ble_gap_event, NULL);
+    case BLE_GAP_EVENT_NOTIFY_TX:
+      /* Para notificaciones NimBLE lo emite al encolar el PDU; solo cuenta fallos */
+      if (!event->notify_tx.indication && event->notify_tx.status != 0) {
+        s_notify_tx_fail++;
+        ESP_LOGD(TAG, "NOTIFY_TX fallido status=%d", event->notify_tx.status);
+      }
       break;
 
+    case BLE_GAP_EVENT_DISCONNECT: {
+      ESP_LOGI(TAG, "🔌 Cliente %u desconectado. Reiniciando advertising...",
+               event->disconnect.conn.conn_handle);
+      /* liberar el hueco y lo que tuviera retenido */
+      struct os_mbuf *stale[BT_NOTIFY_RETRY_LEN];
+      int n = 0;
+      uint32_t dropped = 0;
+      portENTER_CRITICAL(&s_peers_lock);
+      bt_peer_t *p = peer_find(event->disconnect.conn.conn_handle);
+      if (p) {
+        dropped = p->dropped;
+        n = peer_take_retry(p, stale);
+        p->in_use = false;
+        p->subscribed = false;
+        p->link.connected = false;
+      }
+      portEXIT_CRITICAL(&s_peers_lock);
+      for (int i = 0; i < n; i++) os_mbuf_free_chain(stale[i]);
+      update_transmit();
+
+      /* OTA a medias: se suspende (reanudable) para no dejarla ocupada.
+       * s_ota_conn es siempre quien abrió la sesión (gatt_ota_access_cb no
+       * deja que otro cliente lo cambie con ella abierta), así que la
+       * desconexión de otro no la toca y la del dueño siempre la suspende */
+      if (event->disconnect.conn.conn_handle == s_ota_conn) {
+        s_ota_conn = BLE_HS_CONN_HANDLE_NONE;
+        bool ota_was_active = ota_is_in_progress();
+        if (!s_ota_test_active) ota_link_lost();
+        ota_follow_profile(ota_was_active);
+      }
+      if (dropped) {
+        ESP_LOGI(TAG, "Cliente %u: %lu notificaciones descartadas",
+                 event->disconnect.conn.conn_handle, (unsigned long)dropped);
+      }
+
+      advertise_if_room();
+      break;
+    }
+
     default:
       break;
   }
@@ -163,13 +893,21 @@ void send_notification(uint16_t conn_handle, const char *msg) {
   ESP_LOGI(TAG, "📤 Notificación enviada (handle %u): %s", conn_handle, msg);
 }
 
-/* Conveniencia: notificar al cliente conectado (si existe) */
+/* Conveniencia: notificar a todos los clientes conectados (si existen) */
 void send_notification_to_connected(const char *msg) {
-  if (g_conn_handle < 0) {
+  uint16_t conns[BT_MAX_PEERS];
+  int n = 0;
+  portENTER_CRITICAL(&s_peers_lock);
+  for (int i = 0; i < BT_MAX_PEERS; i++) {
+    if (s_peers[i].in_use) conns[n++] = s_peers[i].conn_handle;
+  }
+  portEXIT_CRITICAL(&s_peers_lock);
+
+  if (n == 0) {
     ESP_LOGW(TAG, "No hay cliente conectado para notificar.");
     return;
   }
-  send_notification((uint16_t)g_conn_handle, msg);
+  for (int i = 0; i < n; i++) send_notification(conns[i], msg);
 }
 
 /* ------------------------------------------------------ */
@@ -199,42 +937,725 @@ void bluetooth_init(void) {
   ble_svc_gap_init();
   ble_svc_gatt_init();
 
+  /* Pool de notificaciones de cada hueco de conexión */
+  for (int i = 0; i < BT_MAX_PEERS; i++) {
+    bt_peer_t *p = &s_peers[i];
+    os_mempool_init(&p->tx_mp, BT_PEER_TX_BLOCKS, BT_PEER_TX_BLOCK_SIZE,
+                    s_peer_tx_mem[i], "bt_peer_tx");
+    os_mbuf_pool_init(&p->tx_pool, &p->tx_mp, BT_PEER_TX_BLOCK_SIZE, BT_PEER_TX_BLOCKS);
+  }
+
+  s_coc_lock = xSemaphoreCreateMutex();
+  ota_set_reply_cb(ota_reply);
+#if BT_COC_ENABLED
+  /* Canal L2CAP opcional; sin él todo sigue por notificaciones */
+  int rc = ble_l2cap_create_server(BT_L2CAP_PSM, BT_L2CAP_COC_MTU, coc_event, NULL);
+  if (rc != 0) {
+    ESP_LOGW(TAG, "ble_l2cap_create_server rc=%d", rc);
+  }
+#endif
+
   /* Registrar servicios GATT definidos */
   ble_gatts_count_cfg(gatt_svr_defs);
   ble_gatts_add_svcs(gatt_svr_defs);
 
   nimble_port_freertos_init(ble_host_task);
 }
-void send_notification_binary(const uint8_t *data, uint16_t len) {
-    if (g_conn_handle < 0) {
-        ESP_LOGW(TAG, "No hay cliente conectado para notificar binario.");
-        return;
+/* Handles suscritos (copia para usar fuera del lock) */
+static int subscribed_peers(uint16_t *conns, uint16_t *mtus) {
+  int n = 0;
+  portENTER_CRITICAL(&s_peers_lock);
+  for (int i = 0; i < BT_MAX_PEERS; i++) {
+    if (s_peers[i].in_use && s_peers[i].subscribed) {
+      conns[n] = s_peers[i].conn_handle;
+      mtus[n] = s_peers[i].mtu;
+      n++;
     }
+  }
+  portEXIT_CRITICAL(&s_peers_lock);
+  return n;
+}
 
+esp_err_t send_notification_binary(const uint8_t *data, uint16_t len) {
     if (notify_handle == 0) {
         ESP_LOGW(TAG, "notify_handle == 0. ¿Se inicializó la característica?");
-        return;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint16_t conns[BT_MAX_PEERS], mtus[BT_MAX_PEERS];
+    int n = subscribed_peers(conns, mtus);
+    if (n == 0) {
+        ESP_LOGD(TAG, "No hay cliente suscrito para notificar binario.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t result = ESP_OK;
+    for (int i = 0; i < n; i++) {
+        uint16_t chunk = mtus[i] - 3;  // MTU payload capacity de este peer
+
+        for (uint16_t offset = 0; offset < len; offset += chunk) {
+            uint16_t size = (len - offset > chunk) ? chunk : (len - offset);
+
+            struct os_mbuf *om = ble_hs_mbuf_from_flat(data + offset, size);
+            if (!om) {
+                ESP_LOGE(TAG, "Fallo creando mbuf");
+                result = ESP_ERR_NO_MEM;   // este peer se queda sin el resto; los demás no
+                break;
+            }
+
+            int rc = ble_gattc_notify_custom(conns[i], notify_handle, om);
+            if (rc != 0) {
+                ESP_LOGE(TAG, "Error enviando chunk rc=%d", rc);
+                result = ESP_FAIL;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+/* Peers que reciben telemetría y menor payload entre ellos */
+static int receiving_peers(uint16_t *payload_min) {
+  int n = 0;
+  uint16_t min = 0;
+  portENTER_CRITICAL(&s_peers_lock);
+  for (int i = 0; i < BT_MAX_PEERS; i++) {
+    if (!peer_receives(&s_peers[i])) continue;
+    uint16_t cap = peer_payload_max(&s_peers[i]);
+    if (n == 0 || cap < min) min = cap;
+    n++;
+  }
+  portEXIT_CRITICAL(&s_peers_lock);
+  if (payload_min) *payload_min = min;
+  return n;
+}
+
+/* Peer en cuyo pool conviene construir el siguiente paquete: el primero
+ * que reciba y pueda entregar ya o, si no, uno que aún pueda retenerlo. */
+static bt_peer_t *primary_peer(void) {
+    bt_peer_t *best = NULL;
+    for (int i = 0; i < BT_MAX_PEERS; i++) {
+        bt_peer_t *p = &s_peers[i];
+        if (!peer_receives(p)) continue;
+        if (p->retry_count == 0 && peer_tx_open(p, 0)) return p;
+        if (!best && p->retry_count < BT_NOTIFY_RETRY_LEN) best = p;
+    }
+    return best;
+}
+
+static struct os_mbuf *peer_mbuf_get(bt_peer_t *p) {
+    struct os_mbuf *om = os_mbuf_get_pkthdr(&p->tx_pool, 0);
+    if (om) om->om_data += BT_NOTIFY_LEADING;
+    return om;
+}
+
+struct os_mbuf *bluetooth_notify_mbuf_alloc(uint16_t *max_len) {
+    struct os_mbuf *om = NULL;
+
+    portENTER_CRITICAL(&s_peers_lock);
+    bt_peer_t *p = primary_peer();
+    if (p) om = peer_mbuf_get(p);
+    portEXIT_CRITICAL(&s_peers_lock);
+
+    /* sin nadie que reciba: mbuf del pool msys (el envío se descartará) */
+    if (!om) om = ble_hs_mbuf_att_pkt();
+    if (!om) {
+        ESP_LOGE(TAG, "Fallo creando mbuf");
+        return NULL;
+    }
+    if (max_len) *max_len = bluetooth_get_att_mtu() - 3;
+    return om;
+}
+
+int bluetooth_notify_credits(void) {
+    int best = 0;
+    portENTER_CRITICAL(&s_peers_lock);
+    for (int i = 0; i < BT_MAX_PEERS; i++) {
+        bt_peer_t *p = &s_peers[i];
+        if (!peer_receives(p) || p->retry_count) continue;
+        if (peer_uses_coc(p) && p->coc_stalled) continue;
+        int c = peer_credits(p, 0);
+        if (c > best) best = c;
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return best;
+}
+
+static esp_err_t notify_now(uint16_t conn_handle, struct os_mbuf *om) {
+    /* ble_gattc_notify_custom consume el mbuf siempre */
+    int rc = ble_gattc_notify_custom(conn_handle, notify_handle, om);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Error enviando notificación a %u rc=%d", conn_handle, rc);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* Entrega om al peer por su camino (consume om). Si el canal L2CAP se
+ * cerró entre medias, sale por notificación. */
+static esp_err_t peer_deliver(uint16_t conn_handle, struct os_mbuf *om, bool coc) {
+    if (coc) {
+        esp_err_t err = coc_send(conn_handle, om);
+        if (err != ESP_ERR_NOT_FOUND) return err;
+    }
+    return notify_now(conn_handle, om);
+}
+
+int bluetooth_notify_flush(void) {
+    int pending = 0;
+
+    for (int i = 0; i < BT_MAX_PEERS; i++) {
+        for (;;) {
+            struct os_mbuf *om = NULL;
+            portENTER_CRITICAL(&s_peers_lock);
+            bt_peer_t *p = &s_peers[i];
+            uint16_t conn = p->conn_handle;
+            bool coc = peer_uses_coc(p);
+            if (p->in_use && p->retry_count && peer_tx_open(p, 0)) {
+                om = p->retry[p->retry_head];
+                p->retry_head = (p->retry_head + 1) % BT_NOTIFY_RETRY_LEN;
+                p->retry_count--;
+            } else if (p->in_use) {
+                pending += p->retry_count;
+            }
+            portEXIT_CRITICAL(&s_peers_lock);
+
+            if (!om) break;
+            peer_deliver(conn, om, coc);
+        }
+    }
+    return pending;
+}
+
+bool bluetooth_notify_ready(void) {
+    bluetooth_notify_flush();
+
+    if (receiving_peers(NULL) == 0) return true;   /* se descartará */
+    return bluetooth_notify_credits() > 0;
+}
+
+/* Entrega m (del pool de p) al peer: devuelve m si hay que notificarlo ya,
+ * NULL si quedó retenido. Con el retry lleno se cuenta la pérdida y m
+ * vuelve en *drop para liberarlo fuera del lock. Llamar con s_peers_lock. */
+static struct os_mbuf *peer_offer(bt_peer_t *p, struct os_mbuf *m, bool *ok,
+                                  struct os_mbuf **drop) {
+    if (p->retry_count == 0 && peer_tx_open(p, 1)) {
+        *ok = true;
+        return m;
+    }
+    if (p->retry_count < BT_NOTIFY_RETRY_LEN) {
+        p->retry[(p->retry_head + p->retry_count) % BT_NOTIFY_RETRY_LEN] = m;
+        p->retry_count++;
+        *ok = true;
+        return NULL;
+    }
+    p->dropped++;
+    *drop = m;
+    return NULL;
+}
+
+esp_err_t send_notification_mbuf(struct os_mbuf *om) {
+    if (notify_handle == 0) {
+        os_mbuf_free_chain(om);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* en orden: primero lo retenido */
+    bluetooth_notify_flush();
+
+    /* Destinatarios tal como estaban al mirar la tabla */
+    struct {
+        int slot;                 /* índice en s_peers */
+        uint16_t conn;
+        uint16_t payload_max;
+        bool owner;               /* om es de su pool */
+        struct os_mbuf *m;        /* su copia (o om) */
+    } rx[BT_MAX_PEERS];
+    int n_rx = 0;
+
+    uint16_t len = OS_MBUF_PKTLEN(om);
+    struct os_mbuf *out[BT_MAX_PEERS];
+    uint16_t conns[BT_MAX_PEERS];
+    bool coc[BT_MAX_PEERS];
+    struct os_mbuf *drop[BT_MAX_PEERS + 1];
+    int n_out = 0, n_drop = 0;
+    bool ok = false;
+
+    /* 1) Con el lock solo se apunta quién recibe */
+    portENTER_CRITICAL(&s_peers_lock);
+    for (int i = 0; i < BT_MAX_PEERS; i++) {
+        bt_peer_t *p = &s_peers[i];
+        if (!peer_receives(p)) continue;
+        rx[n_rx].slot = i;
+        rx[n_rx].conn = p->conn_handle;
+        rx[n_rx].payload_max = peer_payload_max(p);
+        rx[n_rx].owner = om->om_omp == &p->tx_pool;
+        rx[n_rx].m = NULL;
+        n_rx++;
     }
+    portEXIT_CRITICAL(&s_peers_lock);
 
-    uint16_t mtu = ble_att_mtu(g_conn_handle);
-    if (mtu < 23) mtu = 23;
+    if (n_rx == 0) {
+        os_mbuf_free_chain(om);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* 2) Sin lock: una copia en el pool de cada peer; el dueño del pool de
+     * om se queda con el original. El paquete ya viene ajustado al menor
+     * payload de todos (si cambió el MTU a mitad, ese peer lo pierde). Los
+     * pools son fijos por hueco, así que reservar aquí es seguro. */
+    bool om_used = false;
+    for (int k = 0; k < n_rx; k++) {
+        if (rx[k].owner) {
+            rx[k].m = om;
+            om_used = true;
+            continue;
+        }
+        if (len > rx[k].payload_max) continue;
+        struct os_mbuf *m = peer_mbuf_get(&s_peers[rx[k].slot]);
+        if (m && os_mbuf_appendfrom(m, om, 0, len) != 0) {
+            os_mbuf_free_chain(m);
+            m = NULL;
+        }
+        rx[k].m = m;
+    }
+    if (!om_used) drop[n_drop++] = om;   /* ya copiado en todos */
 
-    uint16_t chunk = mtu - 3;  // MTU payload capacity
+    /* 3) Con el lock otra vez: a la cola de cada peer, o a la basura si se
+     * desconectó entre medias o no hubo copia. Los frees, al salir. */
+    portENTER_CRITICAL(&s_peers_lock);
+    for (int k = 0; k < n_rx; k++) {
+        bt_peer_t *p = &s_peers[rx[k].slot];
+        struct os_mbuf *m = rx[k].m;
+        if (!p->in_use || p->conn_handle != rx[k].conn || !peer_receives(p)) {
+            if (m) drop[n_drop++] = m;
+            continue;
+        }
+        if (m && len > peer_payload_max(p)) {   /* cambió el transporte */
+            drop[n_drop++] = m;
+            m = NULL;
+        }
+        if (!m) {
+            p->dropped++;
+            continue;
+        }
+        struct os_mbuf *lost = NULL;
+        m = peer_offer(p, m, &ok, &lost);
+        if (lost) drop[n_drop++] = lost;
+        if (m) {
+            conns[n_out] = rx[k].conn;
+            coc[n_out] = peer_uses_coc(p);
+            out[n_out++] = m;
+        }
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+
+    for (int i = 0; i < n_drop; i++) os_mbuf_free_chain(drop[i]);
+    for (int i = 0; i < n_out; i++) peer_deliver(conns[i], out[i], coc[i]);
+
+    return ok ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+uint32_t bluetooth_notify_tx_failures(void) {
+    return s_notify_tx_fail;
+}
+
+uint16_t bluetooth_get_att_mtu(void) {
+    /* el paquete tiene que caber entero en el peer con menor payload (por
+     * L2CAP, el SDU del canal acotado a BT_COC_TELEMETRY_MAX) */
+    uint16_t payload;
+    if (receiving_peers(&payload) == 0) return 23;
+    return (payload < 20) ? 23 : payload + 3;
+}
 
-    for (uint16_t offset = 0; offset < len; offset += chunk) {
-        uint16_t size = (len - offset > chunk) ? chunk : (len - offset);
+void bluetooth_set_link_profile(bt_link_profile_t profile) {
+    if (profile > BT_LINK_PROFILE_BULK) return;
+    s_link_profile = profile;
 
-        struct os_mbuf *om = ble_hs_mbuf_from_flat(data + offset, size);
+    uint16_t conns[BT_MAX_PEERS];
+    int n = 0;
+    portENTER_CRITICAL(&s_peers_lock);
+    for (int i = 0; i < BT_MAX_PEERS; i++) {
+        if (!s_peers[i].in_use) continue;
+        s_peers[i].link.profile = profile;
+        conns[n++] = s_peers[i].conn_handle;
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+
+    /* sin clientes se aplica en la próxima conexión */
+    for (int i = 0; i < n; i++) link_apply_profile(conns[i], profile);
+}
+
+bool bluetooth_get_link_info(uint16_t conn_handle, bt_link_info_t *out) {
+    if (!out) return false;
+    bool found = false;
+    portENTER_CRITICAL(&s_peers_lock);
+    bt_peer_t *p = peer_find(conn_handle);
+    if (p) {
+        *out = p->link;
+        out->mtu = p->mtu;
+        out->transport = peer_uses_coc(p) ? BT_TRANSPORT_L2CAP : BT_TRANSPORT_NOTIFY;
+        out->coc_mtu = p->coc ? p->coc_mtu : 0;
+        found = true;
+    } else {
+        memset(out, 0, sizeof(*out));
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return found;
+}
+
+int bluetooth_link_serialize(uint16_t conn_handle, uint8_t *out, size_t max_len) {
+    if (!out || max_len < BT_LINK_WIRE_LEN) return -1;
+
+    bt_link_info_t li;
+    bluetooth_get_link_info(conn_handle, &li);
+    int off = 0;
+    out[off++] = BT_LINK_WIRE_VERSION;
+    out[off++] = li.connected ? 1 : 0;
+    out[off++] = (uint8_t)li.profile;
+    out[off++] = li.tx_phy;
+    out[off++] = li.rx_phy;
+    const uint16_t v[] = { li.mtu, li.tx_octets, li.rx_octets,
+                           li.conn_itvl, li.conn_latency, li.supervision_timeout };
+    for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++) {
+        out[off++] = (uint8_t)(v[i] & 0xFF);
+        out[off++] = (uint8_t)(v[i] >> 8);
+    }
+    out[off++] = (uint8_t)li.transport;
+    out[off++] = (uint8_t)(li.coc_mtu & 0xFF);
+    out[off++] = (uint8_t)(li.coc_mtu >> 8);
+    return off;
+}
+
+esp_err_t bluetooth_set_transport(bt_transport_t transport) {
+    if (transport > BT_TRANSPORT_L2CAP) return ESP_ERR_INVALID_ARG;
+#if !BT_COC_ENABLED
+    if (transport == BT_TRANSPORT_L2CAP) return ESP_ERR_NOT_SUPPORTED;
+#endif
+    if (transport == s_transport) return ESP_OK;
+
+    s_transport = transport;
+    /* los clientes que cambian de camino necesitan una epoch nueva; lo que
+     * quede retenido sale por el camino nuevo (mismo tamaño de paquete) */
+    pm_request_epoch();
+    update_transmit();
+    return ESP_OK;
+}
+
+bt_transport_t bluetooth_get_transport(void) {
+    return s_transport;
+}
+
+/* ------------------------------------------------------ */
+/* Envío de bloques grandes                               */
+/* ------------------------------------------------------ */
+
+/* Notificaciones de MTU - 3 desde el pool del peer, al ritmo de sus créditos.
+ * Se sondea cada tick: con 4 en vuelo y 100 Hz el techo queda por encima de
+ * lo que da notify en 1M PHY. */
+static esp_err_t bulk_send_notify(uint16_t conn_handle, const uint8_t *data, size_t len) {
+    size_t off = 0;
+    TickType_t waited = 0;
+
+    while (off < len) {
+        struct os_mbuf *m = NULL;
+        uint16_t chunk = 0;
+        portENTER_CRITICAL(&s_peers_lock);
+        bt_peer_t *p = peer_find(conn_handle);
+        if (p) {
+            chunk = p->mtu - 3;
+            if (p->retry_count == 0 && peer_credits(p, 0) > 0) m = peer_mbuf_get(p);
+        }
+        portEXIT_CRITICAL(&s_peers_lock);
+
+        if (!p) return ESP_ERR_INVALID_STATE;
+        if (!m) {
+            if (waited++ * portTICK_PERIOD_MS >= BT_BULK_TIMEOUT_MS) return ESP_ERR_TIMEOUT;
+            vTaskDelay(1);
+            continue;
+        }
+        waited = 0;
+
+        uint16_t n = (len - off > chunk) ? chunk : (uint16_t)(len - off);
+        if (os_mbuf_append(m, data + off, n) != 0) {
+            os_mbuf_free_chain(m);
+            return ESP_ERR_NO_MEM;
+        }
+        if (notify_now(conn_handle, m) != ESP_OK) return ESP_FAIL;
+        off += n;
+    }
+    return ESP_OK;
+}
+
+/* SDUs de hasta el MTU CoC del cliente; al agotar sus créditos se espera a
+ * TX_UNSTALLED */
+static esp_err_t bulk_send_coc(uint16_t conn_handle, const uint8_t *data, size_t len) {
+    esp_err_t err = ESP_OK;
+    size_t off = 0;
+
+    s_coc_waiter = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);            /* descarta avisos viejos */
+
+    while (off < len) {
+        err = coc_wait_unstalled(conn_handle);
+        if (err != ESP_OK) break;
+
+        portENTER_CRITICAL(&s_peers_lock);
+        bt_peer_t *p = peer_find(conn_handle);
+        uint16_t sdu = (p && p->coc) ? p->coc_mtu : 0;
+        portEXIT_CRITICAL(&s_peers_lock);
+        if (sdu == 0) {
+            err = ESP_ERR_INVALID_STATE;
+            break;
+        }
+
+        size_t n = (len - off > sdu) ? sdu : len - off;
+        struct os_mbuf *om = os_msys_get_pkthdr(0, 0);
+        if (om && os_mbuf_append(om, data + off, n) != 0) {
+            os_mbuf_free_chain(om);
+            om = NULL;
+        }
         if (!om) {
-            ESP_LOGE(TAG, "Fallo creando mbuf");
-            return;
+            err = ESP_ERR_NO_MEM;
+            break;
         }
 
-        int rc = ble_gattc_notify_custom(g_conn_handle, notify_handle, om);
-        if (rc != 0) {
-            ESP_LOGE(TAG, "Error enviando chunk rc=%d", rc);
-            return;
+        err = coc_send(conn_handle, om);
+        if (err == ESP_ERR_NOT_FOUND) {
+            os_mbuf_free_chain(om);
+            err = ESP_ERR_INVALID_STATE;
+        }
+        if (err != ESP_OK) break;
+        off += n;
+    }
+
+    s_coc_waiter = NULL;
+    return err;
+}
+
+esp_err_t bluetooth_bulk_send(uint16_t conn_handle, const uint8_t *data, size_t len) {
+    if (!data && len) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_peers_lock);
+    bt_peer_t *p = peer_find(conn_handle);
+    bool found = p != NULL;
+    bool coc = p && peer_uses_coc(p);
+    portEXIT_CRITICAL(&s_peers_lock);
+
+    if (!found) return ESP_ERR_INVALID_STATE;
+    return coc ? bulk_send_coc(conn_handle, data, len)
+               : bulk_send_notify(conn_handle, data, len);
+}
+
+/* ------------------------------------------------------ */
+/* Medida de throughput notify vs L2CAP                   */
+/* ------------------------------------------------------ */
+
+/* Primer cliente que puede recibir por el camino pedido */
+static bool bench_peer(bt_transport_t transport, uint16_t *conn_handle) {
+    bool found = false;
+    portENTER_CRITICAL(&s_peers_lock);
+    for (int i = 0; i < BT_MAX_PEERS && !found; i++) {
+        bt_peer_t *p = &s_peers[i];
+        if (!p->in_use) continue;
+        if (transport == BT_TRANSPORT_L2CAP ? p->coc != NULL : p->subscribed) {
+            *conn_handle = p->conn_handle;
+            found = true;
         }
     }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return found;
 }
 
+/* El tiempo se toma hasta que NimBLE acepta el último bloque: lo que queda
+ * en vuelo está acotado por los créditos, despreciable frente al total. */
+static void bench_task(void *param) {
+    static uint8_t pattern[BT_BENCH_CHUNK];
+    const char *name = (s_bench_transport == BT_TRANSPORT_L2CAP) ? "L2CAP" : "NOTIFY";
+    size_t total = s_bench_bytes;
+    size_t sent = 0;
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    uint16_t conn = 0;
+
+    for (size_t i = 0; i < sizeof(pattern); i++) pattern[i] = (uint8_t)i;
+
+    if (bench_peer(s_bench_transport, &conn)) {
+        int64_t t0 = esp_timer_get_time();
+        err = ESP_OK;
+        while (sent < total && err == ESP_OK) {
+            size_t n = (total - sent > sizeof(pattern)) ? sizeof(pattern) : total - sent;
+            err = (s_bench_transport == BT_TRANSPORT_L2CAP)
+                      ? bulk_send_coc(conn, pattern, n)
+                      : bulk_send_notify(conn, pattern, n);
+            if (err == ESP_OK) sent += n;
+        }
+        int64_t dt_us = esp_timer_get_time() - t0;
+        uint32_t rate = (dt_us > 0) ? (uint32_t)((int64_t)sent * 1000000 / dt_us) : 0;
+
+        char msg[64];
+        snprintf(msg, sizeof(msg), "BENCH %s %u B %lu ms %lu B/s", name, (unsigned)sent,
+                 (unsigned long)(dt_us / 1000), (unsigned long)rate);
+        ESP_LOGI(TAG, "%s (%s)", msg, esp_err_to_name(err));
+        send_notification(conn, msg);
+    } else {
+        ESP_LOGW(TAG, "Benchmark %s: ningún cliente puede recibir por ese camino", name);
+    }
+
+    s_bench_active = false;
+    update_transmit();
+    s_bench_task = NULL;
+    vTaskDelete(NULL);
+}
+
+void bluetooth_set_imu_cal_handler(bt_imu_cal_fn_t fn) {
+    s_imu_cal_fn = fn;
+}
+
+esp_err_t bluetooth_benchmark_start(bt_transport_t transport, size_t bytes) {
+    if (transport > BT_TRANSPORT_L2CAP || bytes == 0) return ESP_ERR_INVALID_ARG;
+    if (s_bench_task) return ESP_ERR_INVALID_STATE;
+    if (bytes > BT_BENCH_MAX_BYTES) bytes = BT_BENCH_MAX_BYTES;
+
+    s_bench_transport = transport;
+    s_bench_bytes = bytes;
+    s_bench_active = true;
+    update_transmit();                       /* la telemetría no compite */
+
+    if (xTaskCreate(bench_task, "ble_bench", 3072, NULL, 5, &s_bench_task) != pdPASS) {
+        s_bench_task = NULL;
+        s_bench_active = false;
+        update_transmit();
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* ------------------------------------------------------ */
+/* Autoprueba de ingesta OTA por mbufs                    */
+/* ------------------------------------------------------ */
+
+/* Imagen sintética: empieza por el magic de imagen (esp_ota_write rechaza
+ * otra cosa en el primer byte) y sigue un patrón no periódico en 256. */
+static inline uint8_t ota_test_byte(size_t i) {
+    return (i == 0) ? 0xE9 : (uint8_t)(i * 31u + (i >> 9));
+}
+
+/* Trama v2 en una cadena de mbufs del msys, como la entregaría NimBLE tras
+ * reensamblar una escritura larga (varios bloques por trama). */
+static struct os_mbuf *ota_test_frame(const uint8_t *hdr, size_t hdr_len,
+                                      size_t off, size_t len) {
+    struct os_mbuf *om = os_msys_get_pkthdr(0, 0);
+    if (!om) return NULL;
+    if (os_mbuf_append(om, hdr, hdr_len) != 0) goto fail;
+
+    uint8_t tmp[64];
+    while (len > 0) {
+        size_t n = (len > sizeof(tmp)) ? sizeof(tmp) : len;
+        for (size_t i = 0; i < n; i++) tmp[i] = ota_test_byte(off + i);
+        if (os_mbuf_append(om, tmp, n) != 0) goto fail;
+        off += n;
+        len -= n;
+    }
+    return om;
+
+fail:
+    os_mbuf_free_chain(om);
+    return NULL;
+}
+
+/* Manda una imagen conocida por el mismo camino que las escrituras BLE
+ * (ota_process_frame_from sobre mbufs, tramas de OTA_V2_MAX_DATA), espera a
+ * la tarea escritora, relee la partición y compara su SHA-256 con el de la
+ * imagen. Al final aborta la sesión: la partición de arranque no cambia. */
+static void ota_test_task(void *param) {
+    size_t total = s_ota_test_bytes;
+    size_t sent = 0;
+    uint16_t seq = 0;
+    bool ok = false;
+    uint8_t expect[32], got[32];
+    mbedtls_sha256_context ctx;
+
+    /* Hash esperado antes de medir */
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    for (size_t off = 0; off < total; ) {
+        uint8_t tmp[64];
+        size_t n = (total - off > sizeof(tmp)) ? sizeof(tmp) : total - off;
+        for (size_t i = 0; i < n; i++) tmp[i] = ota_test_byte(off + i);
+        mbedtls_sha256_update(&ctx, tmp, n);
+        off += n;
+    }
+    mbedtls_sha256_finish(&ctx, expect);
+    mbedtls_sha256_free(&ctx);
+
+    int64_t t0 = esp_timer_get_time();
+    uint8_t begin[6] = { OTA_V2_BEGIN, (uint8_t)total, (uint8_t)(total >> 8),
+                         (uint8_t)(total >> 16), (uint8_t)(total >> 24), OTA_V2_ACK_EVERY };
+    struct os_mbuf *om = ota_test_frame(begin, sizeof(begin), 0, 0);
+    if (om) {
+        ota_process_frame_from(om, OS_MBUF_PKTLEN(om), mbuf_copy);
+        os_mbuf_free_chain(om);
+    }
+
+    while (ota_is_in_progress() && sent < total) {
+        /* El ritmo lo marca el pool, como la ventana del cliente */
+        if (ota_pool_free() == 0) {
+            vTaskDelay(1);
+            continue;
+        }
+        size_t n = (total - sent > OTA_V2_MAX_DATA) ? OTA_V2_MAX_DATA : total - sent;
+        uint8_t hdr[OTA_V2_DATA_HDR] = { OTA_V2_DATA, (uint8_t)seq, (uint8_t)(seq >> 8) };
+        om = ota_test_frame(hdr, sizeof(hdr), sent, n);
+        if (!om) {
+            vTaskDelay(1);                   /* msys agotado: reintentar */
+            continue;
+        }
+        ota_process_frame_from(om, OS_MBUF_PKTLEN(om), mbuf_copy);
+        os_mbuf_free_chain(om);
+        sent += n;
+        seq++;
+    }
+
+    size_t written = 0;
+    esp_err_t err = ota_wait_idle(30000, &written);
+    int64_t dt_us = esp_timer_get_time() - t0;
+    if (err == ESP_OK && written == total) {
+        err = ota_partition_sha256(total, got);
+        ok = (err == ESP_OK) && memcmp(expect, got, sizeof(got)) == 0;
+    }
+
+    uint8_t abort_frame = OTA_V2_ABORT;
+    om = ota_test_frame(&abort_frame, 1, 0, 0);
+    if (om) {
+        ota_process_frame_from(om, OS_MBUF_PKTLEN(om), mbuf_copy);
+        os_mbuf_free_chain(om);
+    }
+    ota_wait_idle(5000, NULL);
+
+    uint32_t rate = (dt_us > 0) ? (uint32_t)((int64_t)written * 1000000 / dt_us) : 0;
+    char msg[64];
+    snprintf(msg, sizeof(msg), "OTA_TEST %u B %lu ms %lu B/s SHA %s", (unsigned)written,
+             (unsigned long)(dt_us / 1000), (unsigned long)rate, ok ? "OK" : "FAIL");
+    ESP_LOGI(TAG, "%s (%s)", msg, esp_err_to_name(err));
+    send_notification_to_connected(msg);
+
+    s_ota_test_active = false;
+    s_ota_test_task = NULL;
+    vTaskDelete(NULL);
+}
+
+static esp_err_t bluetooth_ota_test_start(size_t bytes) {
+    if (bytes == 0) return ESP_ERR_INVALID_ARG;
+    if (s_ota_test_task || ota_is_in_progress()) return ESP_ERR_INVALID_STATE;
+    if (bytes > BT_OTA_TEST_MAX_KIB * 1024) bytes = BT_OTA_TEST_MAX_KIB * 1024;
+
+    s_ota_test_bytes = bytes;
+    s_ota_test_active = true;
+    s_ota_conn = BLE_HS_CONN_HANDLE_NONE;    /* respuestas v2 de la prueba: a nadie */
+    if (xTaskCreate(ota_test_task, "ble_ota_test", 4096, NULL, 5, &s_ota_test_task) != pdPASS) {
+        s_ota_test_task = NULL;
+        s_ota_test_active = false;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
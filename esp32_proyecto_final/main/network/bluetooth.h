@@ -1,6 +1,8 @@
 #ifndef BLUETOOTH_H
 #define BLUETOOTH_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
 #include "host/ble_hs.h"
 
@@ -17,7 +19,7 @@ void bluetooth_init(void);
  */
 void send_notification(uint16_t conn_handle, const char *msg);
 /**
- * @brief Envía una notificación al cliente conectado (si existe).
+ * @brief Envía una notificación a todos los clientes conectados (si existen).
  */
 void send_notification_to_connected(const char *msg);
 
@@ -25,7 +27,179 @@ void send_notification_to_connected(const char *msg);
  * @brief Tarea principal del host BLE. No debe llamarse directamente.
  */
 void ble_host_task(void *param);
-void send_notification_binary(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Envía un bloque binario por notificación a cada cliente suscrito,
+ *        troceado a su MTU - 3.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE si no hay cliente, ESP_ERR_NO_MEM
+ *         si no hay mbuf o ESP_FAIL si falla ble_gattc_notify_custom.
+ */
+esp_err_t send_notification_binary(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Reserva un mbuf vacío para construir una notificación en su sitio
+ *        (os_mbuf_extend / os_mbuf_append). Sale del pool de envío del
+ *        cliente suscrito que pueda notificar antes (o del pool msys si no
+ *        hay nadie suscrito).
+ *
+ * @param[out] max_len Payload máximo: el menor de los clientes que reciben
+ *                     (MTU - 3, o el SDU del canal L2CAP acotado).
+ * @return mbuf o NULL si el pool está agotado.
+ */
+struct os_mbuf *bluetooth_notify_mbuf_alloc(uint16_t *max_len);
+
+/**
+ * @brief Notifica un mbuf ya construido a todos los clientes suscritos sin
+ *        volver a serializarlo (copia en el pool de cada uno). El mbuf pasa
+ *        a ser de NimBLE, de un buffer de reintento o se libera en todos los casos.
+ *
+ * Si un cliente no tiene créditos el paquete queda retenido para él y sale
+ * en una llamada posterior a bluetooth_notify_flush / send_notification_mbuf.
+ * Solo debe llamarse desde una tarea (la del packet manager).
+ *
+ * @return ESP_OK si al menos un cliente lo notificó o retuvo,
+ *         ESP_ERR_INVALID_STATE si no hay nadie suscrito, ESP_ERR_NO_MEM si
+ *         todos tenían el buffer de reintento lleno.
+ */
+esp_err_t send_notification_mbuf(struct os_mbuf *om);
+
+/**
+ * @brief Notificaciones que pueden salir ya hacia el cliente suscrito más
+ *        desahogado (en vuelo por debajo de su límite y nada retenido).
+ */
+int bluetooth_notify_credits(void);
+
+/**
+ * @brief Envía los paquetes retenidos de cada cliente mientras tenga
+ *        créditos. Devuelve cuántos siguen retenidos en total.
+ */
+int bluetooth_notify_flush(void);
+
+/**
+ * @brief true si algún cliente suscrito puede notificar ya (o no hay
+ *        ninguno): el productor puede construir el siguiente paquete.
+ */
+bool bluetooth_notify_ready(void);
+
+/**
+ * @brief Eventos BLE_GAP_EVENT_NOTIFY_TX con error desde el arranque.
+ */
+uint32_t bluetooth_notify_tx_failures(void);
+
+/**
+ * @brief Devuelve el menor ATT MTU de los clientes que reciben telemetría
+ *        (23 si no hay ninguno). Una notificación admite MTU - 3 bytes; para
+ *        un cliente por L2CAP cuenta su SDU + 3.
+ */
+uint16_t bluetooth_get_att_mtu(void);
+
+/**
+ * @brief Perfil de parámetros de conexión que se pide al central.
+ */
+typedef enum {
+  BT_LINK_PROFILE_STREAMING = 0, /**< Intervalo lento con latencia (monitorización nocturna) */
+  BT_LINK_PROFILE_BULK,          /**< Intervalo rápido sin latencia (OTA, volcados) */
+} bt_link_profile_t;
+
+/**
+ * @brief Camino por el que sale la telemetría hacia cada cliente.
+ */
+typedef enum {
+  BT_TRANSPORT_NOTIFY = 0, /**< Notificaciones GATT (siempre disponible) */
+  BT_TRANSPORT_L2CAP,      /**< Canal L2CAP CoC si el cliente lo abrió; si no, notify */
+} bt_transport_t;
+
+/* Canal L2CAP orientado a conexión (CoC): el cliente lo abre contra este PSM
+ * (rango dinámico LE). Un SDU por paquete, con control de flujo por
+ * créditos del propio L2CAP. Requiere CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0. */
+#define BT_L2CAP_PSM     0x0080
+#define BT_L2CAP_COC_MTU 512     /**< SDU máximo en ambos sentidos */
+
+/**
+ * @brief Estado del enlace conseguido tras la negociación.
+ */
+typedef struct {
+  bool connected;
+  bt_link_profile_t profile;
+  uint8_t tx_phy;                /**< 1 = 1M, 2 = 2M, 3 = Coded */
+  uint8_t rx_phy;
+  uint16_t mtu;                  /**< ATT MTU */
+  uint16_t tx_octets;            /**< LL payload máximo (data length) */
+  uint16_t rx_octets;
+  uint16_t conn_itvl;            /**< unidades de 1.25 ms */
+  uint16_t conn_latency;
+  uint16_t supervision_timeout;  /**< unidades de 10 ms */
+  bt_transport_t transport;      /**< camino efectivo de la telemetría */
+  uint16_t coc_mtu;              /**< SDU máximo del canal L2CAP (0 = sin canal) */
+} bt_link_info_t;
+
+/* Serialización para la característica de enlace (GATT):
+ *  byte0: versión, byte1: connected, byte2: profile, byte3: tx_phy,
+ *  byte4: rx_phy y después uint16 LE: mtu, tx_octets, rx_octets,
+ *  conn_itvl, conn_latency, supervision_timeout. La v2 añade al final
+ *  transport (uint8) y coc_mtu (uint16 LE). */
+#define BT_LINK_WIRE_VERSION 2
+#define BT_LINK_WIRE_LEN     (5 + 6 * 2 + 1 + 2)
+
+/**
+ * @brief Cambia el perfil de conexión. A los clientes conectados se les pide
+ *        ya (ble_gap_update_params); a los nuevos, al conectar.
+ */
+void bluetooth_set_link_profile(bt_link_profile_t profile);
+
+/**
+ * @brief Copia el estado del enlace con un cliente (PHY, data length,
+ *        intervalo...). false si conn_handle no está conectado.
+ */
+bool bluetooth_get_link_info(uint16_t conn_handle, bt_link_info_t *out);
+
+/**
+ * @brief Serializa bluetooth_get_link_info (ver BT_LINK_WIRE_*).
+ *        Devuelve longitud o -1.
+ */
+int bluetooth_link_serialize(uint16_t conn_handle, uint8_t *out, size_t max_len);
+
+/**
+ * @brief Elige el camino de la telemetría. Con BT_TRANSPORT_L2CAP los
+ *        clientes con canal CoC abierto reciben los paquetes por él (aunque
+ *        no estén suscritos); el resto sigue con notificaciones.
+ *
+ * @return ESP_ERR_NOT_SUPPORTED si el firmware se compiló sin CoC.
+ */
+esp_err_t bluetooth_set_transport(bt_transport_t transport);
+
+bt_transport_t bluetooth_get_transport(void);
+
+/**
+ * @brief Envía un bloque grande a un cliente esperando al control de flujo
+ *        (bloqueante). Por su canal L2CAP en SDUs de hasta su MTU CoC si
+ *        el transporte es BT_TRANSPORT_L2CAP y lo tiene abierto; si no, por
+ *        notificaciones de MTU - 3. No llamar desde la tarea del host BLE.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE si el cliente se fue,
+ *         ESP_ERR_TIMEOUT si el enlace no avanza, ESP_ERR_NO_MEM o ESP_FAIL.
+ */
+esp_err_t bluetooth_bulk_send(uint16_t conn_handle, const uint8_t *data, size_t len);
+
+/**
+ * @brief Mide el throughput de un camino: pausa la telemetría, manda bytes
+ *        de patrón al primer cliente que pueda recibirlos por ese camino
+ *        (tarea aparte) y registra / notifica el resultado en bytes/s.
+ *        Desde el cliente: "BLE_BENCH NOTIFY|L2CAP [KiB]".
+ *
+ * @return ESP_ERR_INVALID_STATE si ya hay una medida en curso.
+ */
+esp_err_t bluetooth_benchmark_start(bt_transport_t transport, size_t bytes);
+
+/**
+ * @brief Quién atiende "BLE_IMU_CAL [muestras]" (recalibrar la IMU en
+ *        reposo; 0 = muestras por defecto). La capa BLE no conoce el
+ *        sensor: lo registra main según la fuente en uso. NULL = el
+ *        comando contesta que no está disponible.
+ */
+typedef esp_err_t (*bt_imu_cal_fn_t)(size_t samples);
+void bluetooth_set_imu_cal_handler(bt_imu_cal_fn_t fn);
 
 #endif // BLUETOOTH_H
 
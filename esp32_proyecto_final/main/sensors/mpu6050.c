@@ -3,32 +3,135 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
-#include <math.h>
+#include "driver/gpio.h"
+#include "esp_intr_alloc.h"
+#include <stdatomic.h>
 #include "esp_timer.h"
+#include "nvs.h"
+#include <time.h>
 
-#include "utils/packet_manager.h"   // ⭐ IMPORTANTE
+#include "utils/packet_manager.h"   // pm_imu_sample_t
+#include "utils/imu_fixed.h"
+#include "utils/seqlock.h"
+#include "utils/gyro_bias.h"
 
 #define MPU6050_ADDR             0x68
-#define MPU6050_REG_PWR_MGMT1    0x6B
+#define MPU6050_REG_SMPLRT_DIV   0x19
+#define MPU6050_REG_CONFIG       0x1A
+#define MPU6050_REG_GYRO_CONFIG  0x1B
+#define MPU6050_REG_ACCEL_CONFIG 0x1C
+#define MPU6050_REG_FIFO_EN      0x23
+#define MPU6050_REG_INT_PIN_CFG  0x37
+#define MPU6050_REG_INT_ENABLE   0x38
 #define MPU6050_REG_ACCEL_XOUT_H 0x3B
+#define MPU6050_REG_USER_CTRL    0x6A
+#define MPU6050_REG_PWR_MGMT1    0x6B
+#define MPU6050_REG_FIFO_COUNTH  0x72
+#define MPU6050_REG_FIFO_R_W     0x74
+
+#define MPU6050_CLK_PLL_XGYRO    0x01   // PWR_MGMT1: reloj del giróscopo X (más estable que el RC interno)
+#define MPU6050_FIFO_ACCEL_TEMP_GYRO 0xF8   // FIFO_EN: temp + gx,gy,gz + accel
+#define MPU6050_USER_FIFO_EN     0x40
+#define MPU6050_USER_FIFO_RESET  0x04
+#define MPU6050_INT_PIN_PULSE    0x00   // INT_PIN_CFG: activo alto, push-pull, pulso de 50 us
+#define MPU6050_INT_DATA_RDY_EN  0x01
+
+// Con DLPF activo el giróscopo muestrea a 1 kHz: tasa = 1 kHz / (1 + SMPLRT_DIV)
+#define MPU6050_GYRO_RATE_HZ     1000
+#define MPU6050_RATE_MIN_HZ      4
+#define MPU6050_FIFO_SIZE        1024
+
+// En la FIFO cada muestra es el mismo bloque de 14 bytes que la lectura
+// de registros desde ACCEL_XOUT_H: accel(6) temp(2) gyro(6)
+#define MPU6050_SAMPLE_LEN       14
+#define MPU6050_FIFO_MAX_SAMPLES (MPU6050_FIFO_SIZE / MPU6050_SAMPLE_LEN)
+
+// Ráfagas: como mucho cada 50 ms y con la FIFO a un tercio como máximo
+#define MPU6050_BURST_MAX_MS     50
+
+// Modo INT: tiempos de los últimos flancos (potencia de 2, >= FIFO entera)
+#define MPU6050_EDGE_RING        128
+
+// Calibración en NVS (blob mpu6050_calibration_t)
+#define MPU6050_NVS_NS           "imu"
+#define MPU6050_NVS_CAL          "cal"
+#define MPU6050_CAL_SAMPLES      200
+#define MPU6050_CAL_SAMPLES_MAX  (4 * MPU6050_CAL_SAMPLES)   // más, y el reposo no se sostiene
+// Oscilación máxima del giróscopo para dar la medida por hecha en reposo
+#define MPU6050_CAL_MAX_SPAN_DPS 4.0f
 
-#define ACCEL_SCALE 16384.0f
-#define GYRO_SCALE  131.0f
 #define G_TO_MS2    9.80665f
 
 static const char *TAG = "MPU6050";
 
 static i2c_port_t s_i2c_port;
 static TaskHandle_t s_task = NULL;
-static SemaphoreHandle_t s_mutex = NULL;
-
-static mpu6050_data_t s_last = {0};
-
-static int16_t s_offset_ax = 0, s_offset_ay = 0, s_offset_az = 0;
-static int16_t s_offset_gx = 0, s_offset_gy = 0, s_offset_gz = 0;
-
-static uint32_t s_period_ms = 200;
+static bool s_ready = false;
+
+// Última muestra en float: la publica la tarea lectora sin esperar nunca y
+// get_latest la copia desde cualquier core (seqlock.h)
+static seqlock_t s_last;
+#define MPU6050_LATEST_TRIES 16
+
+// Offsets de calibrado en LSB, ejes del sensor (ax..gz)
+static int16_t s_offset[IMU_FIXED_AXES] = {0};
+
+// Calibración vigente (cargada o medida) y medida en curso. s_cal solo lo
+// toca quien calibra: mpu6050_calibrate antes de start o la tarea lectora
+// tras mpu6050_request_calibration (s_cal_request = muestras pedidas).
+typedef struct {
+    int64_t sum[IMU_FIXED_AXES];
+    int16_t gmin[3], gmax[3];
+    uint32_t n, target;
+} cal_acc_t;
+static cal_acc_t s_cal;
+static _Atomic uint32_t s_cal_request;
+static mpu6050_calibration_t s_cal_info;
+static bool s_cal_valid = false;
+
+// Guardado en NVS de lo calibrado en marcha, fuera de la tarea lectora: un
+// commit que cambia de página y borra un sector puede tardar más de lo que
+// aguanta la FIFO (73 muestras: 365 ms a 200 Hz, 73 ms a 1 kHz)
+#define MPU6050_SAVE_STACK 3072
+#define MPU6050_SAVE_PRIO  1
+static portMUX_TYPE s_save_lock = portMUX_INITIALIZER_UNLOCKED;
+static mpu6050_calibration_t s_save_rec;
+static bool s_save_pending = false;
+static bool s_save_running = false;
+
+// Sesgo del giróscopo seguido en marcha (gyro_bias.h): parte de la
+// calibración y lo corrige la tarea lectora en cada reposo. s_gyro_off es
+// el aplicado, en LSB con fracción (para mpu_convert).
+static gyro_bias_t s_gb;
+static float s_gyro_off[3];
+
+// Conversión por muestra en punto fijo (imu_fixed.h); se recalcula al
+// configurar y al calibrar (antes de start o desde la tarea lectora)
+static imu_fixed_config_t s_conv;
+static imu_fixed_t s_fx;
+
+static uint32_t s_rate_hz = 100;
+static uint32_t s_period_us = 10000;
+static TickType_t s_burst_ticks = 1;
+static mpu6050_stats_t s_stats = {0};
+
+// Modo INT (opcional): la ISR apunta el instante de cada data-ready, que
+// es una muestra más en la FIFO. s_edge_seq cuenta flancos (release en la
+// ISR, acquire en la tarea: pueden ir en cores distintos).
+static gpio_num_t s_int_pin = GPIO_NUM_NC;
+static uint32_t s_wake_every = 0;       // 0 = lo que cabe en una ráfaga
+static int64_t s_edge_us[MPU6050_EDGE_RING];
+static _Atomic uint32_t s_edge_seq;
+static uint32_t s_edge_pending;         // solo la ISR
+static uint32_t s_edge_base;            // s_edge_seq al reiniciar la FIFO
+
+// Reconstrucción de tiempos (solo la tarea lectora)
+static int64_t s_next_us;               // instante previsto de la siguiente muestra
+static bool s_ts_valid = false;
+static TickType_t s_last_wake;
+
+// Solo la tarea lectora: ráfaga cruda
+static uint8_t s_fifo_buf[MPU6050_FIFO_MAX_SAMPLES * MPU6050_SAMPLE_LEN];
 
 // =======================
 // I2C BASICO
@@ -52,96 +155,335 @@ static esp_err_t i2c_read(uint8_t reg, uint8_t *out, size_t len) {
 }
 
 // =======================
-// TAREA MPU6050
+// CONFIGURACIÓN
+// =======================
+
+// DLPF con el mayor ancho de banda por debajo de Nyquist (tabla de CONFIG,
+// ancho de banda del acelerómetro)
+static uint8_t dlpf_for_rate(uint32_t rate_hz) {
+    static const struct { uint16_t bw_hz; uint8_t cfg; } dlpf[] = {
+        {184, 1}, {94, 2}, {44, 3}, {21, 4}, {10, 5},
+    };
+    for (size_t i = 0; i < sizeof(dlpf) / sizeof(dlpf[0]); i++) {
+        if (dlpf[i].bw_hz * 2 <= rate_hz) return dlpf[i].cfg;
+    }
+    return 6;   // 5 Hz
+}
+
+static esp_err_t fifo_reset(void) {
+    esp_err_t err = i2c_write(MPU6050_REG_USER_CTRL, MPU6050_USER_FIFO_RESET);
+    if (err == ESP_OK) err = i2c_write(MPU6050_REG_USER_CTRL, MPU6050_USER_FIFO_EN);
+    s_edge_base = atomic_load_explicit(&s_edge_seq, memory_order_acquire);
+    s_ts_valid = false;
+    return err;
+}
+
+// Divisor, DLPF, fondos de escala (s_conv) y FIFO.
+static esp_err_t mpu_configure(uint32_t rate_hz) {
+    if (rate_hz < MPU6050_RATE_MIN_HZ) rate_hz = MPU6050_RATE_MIN_HZ;
+    if (rate_hz > MPU6050_GYRO_RATE_HZ) rate_hz = MPU6050_GYRO_RATE_HZ;
+    uint32_t div = MPU6050_GYRO_RATE_HZ / rate_hz - 1;
+    if (div > 255) div = 255;
+
+    s_rate_hz = MPU6050_GYRO_RATE_HZ / (div + 1);
+    s_period_us = 1000000 / s_rate_hz;
+
+    uint32_t burst_ms = MPU6050_FIFO_MAX_SAMPLES * 1000 / s_rate_hz / 3;
+    if (burst_ms > MPU6050_BURST_MAX_MS) burst_ms = MPU6050_BURST_MAX_MS;
+    s_burst_ticks = pdMS_TO_TICKS(burst_ms);
+    if (s_burst_ticks == 0) s_burst_ticks = 1;
+
+    const uint8_t regs[][2] = {
+        {MPU6050_REG_SMPLRT_DIV, (uint8_t)div},
+        {MPU6050_REG_CONFIG, dlpf_for_rate(s_rate_hz)},
+        {MPU6050_REG_GYRO_CONFIG, (uint8_t)(s_conv.gyro_fs << 3)},
+        {MPU6050_REG_ACCEL_CONFIG, (uint8_t)(s_conv.accel_fs << 3)},
+        {MPU6050_REG_FIFO_EN, MPU6050_FIFO_ACCEL_TEMP_GYRO},
+    };
+    for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+        esp_err_t err = i2c_write(regs[i][0], regs[i][1]);
+        if (err != ESP_OK) return err;
+    }
+
+    // Solo data-ready: un flanco por muestra escrita en la FIFO
+    bool use_int = s_int_pin != GPIO_NUM_NC;
+    esp_err_t err = i2c_write(MPU6050_REG_INT_PIN_CFG, MPU6050_INT_PIN_PULSE);
+    if (err == ESP_OK) {
+        err = i2c_write(MPU6050_REG_INT_ENABLE, use_int ? MPU6050_INT_DATA_RDY_EN : 0x00);
+    }
+    if (err != ESP_OK) return err;
+    return fifo_reset();
+}
+
+// =======================
+// MODO INT
 // =======================
-static void mpu_task(void *arg) {
+static void IRAM_ATTR mpu_isr(void *arg) {
     (void)arg;
-    uint8_t raw[14];
+    uint32_t seq = atomic_load_explicit(&s_edge_seq, memory_order_relaxed);
+    s_edge_us[seq & (MPU6050_EDGE_RING - 1)] = esp_timer_get_time();
+    atomic_store_explicit(&s_edge_seq, seq + 1, memory_order_release);
+
+    // El MPU6050 no tiene interrupción por nivel de FIFO: se despierta a
+    // la tarea cada s_wake_every flancos
+    if (++s_edge_pending >= s_wake_every && s_task) {
+        BaseType_t hp = pdFALSE;
+        s_edge_pending = 0;
+        vTaskNotifyGiveFromISR(s_task, &hp);
+        portYIELD_FROM_ISR(hp);
+    }
+}
+
+// ISR en IRAM: los flancos se siguen marcando mientras se escribe flash (OTA, NVS)
+static esp_err_t int_setup(void) {
+    gpio_config_t io = {
+        .pin_bit_mask = 1ULL << s_int_pin,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_POSEDGE,
+    };
+    esp_err_t err = gpio_config(&io);
+    if (err != ESP_OK) return err;
+
+    err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return err;   // ya instalado: vale
+
+    if (s_wake_every == 0) {
+        s_wake_every = s_rate_hz * (s_burst_ticks * portTICK_PERIOD_MS) / 1000;
+        if (s_wake_every == 0) s_wake_every = 1;
+    }
+    if (s_wake_every > MPU6050_FIFO_MAX_SAMPLES / 3) s_wake_every = MPU6050_FIFO_MAX_SAMPLES / 3;
+    return gpio_isr_handler_add(s_int_pin, mpu_isr, NULL);
+}
+
+// =======================
+// CONVERSIÓN
+// =======================
 
-    while (1) {
-        if (i2c_read(MPU6050_REG_ACCEL_XOUT_H, raw, sizeof(raw)) == ESP_OK) {
-
-            int16_t ax = (raw[0] << 8) | raw[1];
-            int16_t ay = (raw[2] << 8) | raw[3];
-            int16_t az = (raw[4] << 8) | raw[5];
-            int16_t gx = (raw[8] << 8) | raw[9];
-            int16_t gy = (raw[10] << 8) | raw[11];
-            int16_t gz = (raw[12] << 8) | raw[13];
-
-            // Aplicar offset + conversión
-            float ax_f = ((float)(ax - s_offset_ax) / ACCEL_SCALE) * G_TO_MS2;
-            float ay_f = ((float)(ay - s_offset_ay) / ACCEL_SCALE) * G_TO_MS2;
-            float az_f = ((float)(az - s_offset_az) / ACCEL_SCALE) * G_TO_MS2;
-
-            float gx_f = (float)(gx - s_offset_gx) / GYRO_SCALE;
-            float gy_f = (float)(gy - s_offset_gy) / GYRO_SCALE;
-            float gz_f = (float)(gz - s_offset_gz) / GYRO_SCALE;
-
-            // Corrección de ejes (si aplicaba en tu diseño original)
-            float ax_corr = ay_f;
-            float ay_corr = ax_f;
-            float az_corr = az_f;
-
-            float gx_corr = gy_f;
-            float gy_corr = gx_f;
-            float gz_corr = gz_f;
-
-            // Guardar datos crudos/convertidos
-            if (xSemaphoreTake(s_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-                s_last.accel_x = ax_corr;
-                s_last.accel_y = ay_corr;
-                s_last.accel_z = az_corr;
-
-                s_last.gyro_x = gx_corr;
-                s_last.gyro_y = gy_corr;
-                s_last.gyro_z = gz_corr;
-
-                xSemaphoreGive(s_mutex);
-            }
-
-            // ============================
-            //   ENVIAR A PACKET MANAGER
-            // ============================
-            int16_t ax_i = (int16_t)lrintf(ax_corr * 100.0f);
-            int16_t ay_i = (int16_t)lrintf(ay_corr * 100.0f);
-            int16_t az_i = (int16_t)lrintf(az_corr * 100.0f);
-
-            int16_t gx_i = (int16_t)lrintf(gx_corr * 100.0f);
-            int16_t gy_i = (int16_t)lrintf(gy_corr * 100.0f);
-            int16_t gz_i = (int16_t)lrintf(gz_corr * 100.0f);
-
-            uint64_t ts = esp_timer_get_time() / 1000ULL;
-
-            pm_feed_imu_compact(
-                ax_i, ay_i, az_i,
-                gx_i, gy_i, gz_i,
-                ts
-            );
+// Solo para get_latest (depuración): bloque de 14 bytes a m/s² y °/s en
+// float, con los offsets y la matriz de ejes de s_conv. Las muestras que
+// van al packet manager salen de imu_fixed_convert.
+static void mpu_convert(const uint8_t *raw, mpu6050_data_t *out) {
+    static const uint8_t pos[IMU_FIXED_AXES] = {0, 2, 4, 8, 10, 12};
+    static const int8_t identity[3] = {1, 2, 3};
+    const int8_t *axis = (s_conv.axis[0] || s_conv.axis[1] || s_conv.axis[2]) ? s_conv.axis : identity;
+    float accel_lsb = imu_fixed_accel_lsb(s_conv.accel_fs);
+    float gyro_lsb = imu_fixed_gyro_lsb(s_conv.gyro_fs);
+
+    float v[IMU_FIXED_AXES];
+    for (int a = 0; a < IMU_FIXED_AXES; a++) {
+        int16_t r = (raw[pos[a]] << 8) | raw[pos[a] + 1];
+        v[a] = a < 3 ? (float)(r - s_offset[a]) / accel_lsb
+                     : ((float)r - s_gyro_off[a - 3]) / gyro_lsb;
+    }
+
+    float *acc = &out->accel_x;
+    float *gyr = &out->gyro_x;
+    for (int i = 0; i < 3; i++) {
+        int src = (axis[i] < 0 ? -axis[i] : axis[i]) - 1;
+        float sign = axis[i] < 0 ? -1.0f : 1.0f;
+        acc[i] = sign * v[src] * G_TO_MS2;
+        gyr[i] = sign * v[3 + src];
+    }
+}
+
+// =======================
+// TIEMPOS
+// =======================
+
+// La FIFO no guarda tiempos: la muestra más nueva se tomó como mucho un
+// periodo antes de leer la cuenta. Las ráfagas se encadenan (s_next_us) y
+// cada una corrige 1/16 del error, para seguir la deriva del oscilador del
+// MPU respecto al esp_timer sin meter el jitter de la tarea en los tiempos.
+static int64_t burst_first_us(int64_t t_count_us, size_t n) {
+    int64_t period = s_period_us;
+    int64_t est = t_count_us - period / 2 - (int64_t)(n - 1) * period;
+
+    if (s_ts_valid) {
+        int64_t err = est - s_next_us;
+        if (err > -4 * period && err < 4 * period) est = s_next_us + err / 16;
+    }
+    s_next_us = est + (int64_t)n * period;
+    s_ts_valid = true;
+    return est;
+}
+
+// Modo INT: las n muestras contadas son los n últimos flancos anteriores a
+// leer la cuenta, así que cada una tiene su tiempo exacto. No vale si entró
+// un flanco durante esa lectura, si no hay n flancos desde el reinicio de
+// la FIFO o si su separación no cuadra con el periodo (flancos perdidos).
+static bool burst_edges_ok(uint32_t seq_before, uint32_t seq_after, size_t n) {
+    if (seq_before != seq_after || n > MPU6050_EDGE_RING ||
+        seq_before - s_edge_base < n) {
+        return false;
+    }
+    int64_t oldest = s_edge_us[(seq_before - n) & (MPU6050_EDGE_RING - 1)];
+    int64_t newest = s_edge_us[(seq_before - 1) & (MPU6050_EDGE_RING - 1)];
+    int64_t err = (newest - oldest) - (int64_t)(n - 1) * s_period_us;
+    return err > -(int64_t)s_period_us && err < (int64_t)s_period_us;
+}
+
+// =======================
+// LECTURA POR RÁFAGAS
+// =======================
+
+static void cal_add(const uint8_t *raw);
+static esp_err_t cal_finish(void);
+static void cal_save_later(const mpu6050_calibration_t *cal);
+
+// Reinicia el seguimiento del sesgo desde los offsets vigentes
+static void mpu_bias_reset(bool calibrated) {
+    gyro_bias_config_t cfg;
+    gyro_bias_config_default(&cfg, s_rate_hz, imu_fixed_gyro_lsb(s_conv.gyro_fs),
+                             imu_fixed_accel_lsb(s_conv.accel_fs));
+    gyro_bias_init(&s_gb, &cfg, &s_offset[3], calibrated);
+    for (int i = 0; i < 3; i++) s_gyro_off[i] = s_offset[3 + i];
+}
+
+// Pasa una muestra al seguimiento del sesgo; al cerrar ventana, el nuevo
+// sesgo entra en la conversión desde esta misma muestra
+static void mpu_bias_track(const uint8_t *raw) {
+    int32_t q8[3];
+    uint32_t still = s_gb.still, rejected = s_gb.rejected;
+    if (!gyro_bias_update(&s_gb, raw, q8)) return;
+
+    for (int i = 0; i < 3; i++) {
+        imu_fixed_set_offset(&s_fx, 3 + i, q8[i]);
+        s_gyro_off[i] = q8[i] / 256.0f;
+    }
+    s_stats.still_windows += s_gb.still - still;
+    s_stats.still_rejected += s_gb.rejected - rejected;
+    s_stats.temp_c = s_gb.temp_c;
+}
+
+// Espera a la siguiente ráfaga (INT o periodo fijo), vacía la FIFO de una
+// vez y pone a cada muestra su tiempo. La llama siempre la misma tarea (la
+// de adquisición), que es también la que despierta la ISR.
+static size_t mpu_read_block(void *out, size_t max) {
+    pm_imu_sample_t *block = out;
+    if (!s_task) s_task = xTaskGetCurrentTaskHandle();
+
+    bool use_int = s_int_pin != GPIO_NUM_NC;
+    if (use_int) {
+        // Sin flancos en dos ráfagas se lee igual (INT perdido o suelto)
+        if (ulTaskNotifyTake(pdTRUE, 2 * s_burst_ticks) == 0) s_stats.int_timeouts++;
+    } else {
+        vTaskDelayUntil(&s_last_wake, s_burst_ticks);
+    }
+
+    // 1) Cuántas muestras hay
+    uint8_t cnt[2];
+    uint32_t seq_before = atomic_load_explicit(&s_edge_seq, memory_order_acquire);
+    if (i2c_read(MPU6050_REG_FIFO_COUNTH, cnt, sizeof(cnt)) != ESP_OK) {
+        s_stats.read_errors++;
+        ESP_LOGW(TAG, "Lectura MPU6050 fallida");
+        return 0;
+    }
+    int64_t t_count = esp_timer_get_time();
+    uint32_t seq_after = atomic_load_explicit(&s_edge_seq, memory_order_acquire);
+    size_t count = ((size_t)cnt[0] << 8) | cnt[1];
+
+    // Llena: se han perdido muestras y la FIFO ya no está alineada
+    if (count >= MPU6050_FIFO_SIZE) {
+        s_stats.fifo_overflows++;
+        ESP_LOGW(TAG, "FIFO MPU6050 desbordada (%lu)", (unsigned long)s_stats.fifo_overflows);
+        if (fifo_reset() != ESP_OK) s_stats.read_errors++;
+        return 0;
+    }
+
+    // avail da los tiempos; si no caben todas se leen las n más antiguas
+    size_t avail = count / MPU6050_SAMPLE_LEN;
+    size_t n = avail < max ? avail : max;
+    if (n == 0) return 0;
+
+    // 2) Una sola lectura para toda la ráfaga (lo que sobre de una
+    //    muestra a medio escribir se queda para la siguiente)
+    if (i2c_read(MPU6050_REG_FIFO_R_W, s_fifo_buf, n * MPU6050_SAMPLE_LEN) != ESP_OK) {
+        s_stats.read_errors++;
+        ESP_LOGW(TAG, "Lectura FIFO MPU6050 fallida");
+        // no se sabe cuántos bytes llegó a sacar: se realinea
+        if (fifo_reset() != ESP_OK) s_stats.read_errors++;
+        return 0;
+    }
+
+    // Calibración pedida en marcha: se promedian las propias muestras de la
+    // FIFO sin dejar de leer; al completarse se aplica desde aquí y se
+    // guarda desde otra tarea (cal_save_later)
+    uint32_t req = atomic_exchange_explicit(&s_cal_request, 0, memory_order_relaxed);
+    if (req) s_cal = (cal_acc_t){ .target = req };
+    if (s_cal.target) {
+        for (size_t i = 0; i < n && s_cal.n < s_cal.target; i++) {
+            cal_add(&s_fifo_buf[i * MPU6050_SAMPLE_LEN]);
         }
-        else {
-            ESP_LOGW(TAG, "Lectura MPU6050 fallida");
+        if (s_cal.n >= s_cal.target) {
+            s_cal.target = 0;
+            if (cal_finish() == ESP_OK) cal_save_later(&s_cal_info);
         }
+    }
 
-        vTaskDelay(pdMS_TO_TICKS(s_period_ms));
+    // 3) Convertir y poner tiempos: flancos INT o estimación
+    bool edges = use_int && burst_edges_ok(seq_before, seq_after, avail);
+    int64_t ts = 0;
+    if (!edges) {
+        ts = burst_first_us(t_count, avail);
+        s_stats.ts_estimated += n;
     }
+    for (size_t i = 0; i < n; i++) {
+        if (edges) ts = s_edge_us[(seq_before - avail + i) & (MPU6050_EDGE_RING - 1)];
+        const uint8_t *raw = &s_fifo_buf[i * MPU6050_SAMPLE_LEN];
+        mpu_bias_track(raw);
+        int16_t v[IMU_FIXED_AXES];
+        imu_fixed_convert(&s_fx, raw, v);
+        block[i] = (pm_imu_sample_t){
+            .ax = v[0], .ay = v[1], .az = v[2],
+            .gx = v[3], .gy = v[4], .gz = v[5],
+            .ts32 = (uint32_t)(ts / 1000),
+        };
+        ts += s_period_us;
+    }
+    // ts = instante de la primera muestra que sigue en la FIFO
+    s_next_us = ts;
+    s_ts_valid = true;
+    s_stats.samples += n;
+    s_stats.bursts++;
+
+    // Guardar la última muestra (float, solo para depuración)
+    mpu6050_data_t d;
+    mpu_convert(&s_fifo_buf[(n - 1) * MPU6050_SAMPLE_LEN], &d);
+    seqlock_write(&s_last, &d, sizeof(d));
+    return n;
 }
 
 // =======================
 // API PUBLICA
 // =======================
-esp_err_t mpu6050_start(i2c_port_t i2c_port, gpio_num_t sda, gpio_num_t scl,
-                        uint32_t clk_hz, uint32_t period_ms,
-                        uint32_t stack_size, UBaseType_t task_prio) {
-    
-    s_i2c_port = i2c_port;
+esp_err_t mpu6050_init(const mpu6050_config_t *cfg) {
+    if (!cfg) return ESP_ERR_INVALID_ARG;
+    if (s_ready) return ESP_ERR_INVALID_STATE;
+
+    // Punto fijo según fondo de escala, unidades y ejes (sin calibrar aún)
+    s_conv = cfg->conv;
+    for (int a = 0; a < IMU_FIXED_AXES; a++) s_offset[a] = 0;
+    s_cal = (cal_acc_t){0};
+    s_cal_valid = false;
+    atomic_store_explicit(&s_cal_request, 0, memory_order_relaxed);
+    if (imu_fixed_init(&s_fx, &s_conv, s_offset) != 0) {
+        ESP_LOGE(TAG, "Conversión IMU no válida (fondo de escala, unidades o ejes)");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_i2c_port = cfg->i2c_port;
+    s_int_pin = cfg->int_pin;
+    s_wake_every = cfg->samples_per_wake;
 
     i2c_config_t conf = {
         .mode = I2C_MODE_MASTER,
-        .sda_io_num = sda,
-        .scl_io_num = scl,
+        .sda_io_num = cfg->sda,
+        .scl_io_num = cfg->scl,
         .sda_pullup_en = GPIO_PULLUP_ENABLE,
         .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = clk_hz,
+        .master.clk_speed = cfg->clk_hz,
     };
 
     esp_err_t err = i2c_param_config(s_i2c_port, &conf);
@@ -157,7 +499,7 @@ esp_err_t mpu6050_start(i2c_port_t i2c_port, gpio_num_t sda, gpio_num_t scl,
     }
 
     // Wake MPU6050 (no usar ESP_ERROR_CHECK aquí para evitar abortar si no está presente)
-    err = i2c_write(MPU6050_REG_PWR_MGMT1, 0x00);
+    err = i2c_write(MPU6050_REG_PWR_MGMT1, MPU6050_CLK_PLL_XGYRO);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Advertencia: no se pudo wakear MPU6050 (i2c write): %s", esp_err_to_name(err));
         // Limpieza parcial: desinstalamos driver para dejar I2C como estaba
@@ -165,95 +507,267 @@ esp_err_t mpu6050_start(i2c_port_t i2c_port, gpio_num_t sda, gpio_num_t scl,
         return err;
     }
 
-    s_mutex = xSemaphoreCreateMutex();
-    s_period_ms = period_ms ? period_ms : 200;
-
-    BaseType_t ok = xTaskCreate(
-        mpu_task, "mpu6050_task",
-        stack_size ? stack_size : 4096,
-        NULL,
-        task_prio ? task_prio : 5,
-        &s_task
-    );
-
-    if (ok != pdPASS) {
-        ESP_LOGE(TAG, "No se pudo crear tarea MPU6050");
-        // si hubo fallo, limpiar driver y mutex
-        if (s_mutex) { vSemaphoreDelete(s_mutex); s_mutex = NULL; }
+    err = mpu_configure(cfg->sample_rate_hz ? cfg->sample_rate_hz : 100);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "No se pudo configurar FIFO MPU6050: %s", esp_err_to_name(err));
         i2c_driver_delete(s_i2c_port);
-        return ESP_FAIL;
+        return err;
     }
 
-    ESP_LOGI(TAG, "MPU6050 inicializado en I2C%d  (SDA=%d, SCL=%d)",
-             s_i2c_port, sda, scl);
+    if (s_int_pin != GPIO_NUM_NC && (err = int_setup()) != ESP_OK) {
+        // sin INT se sigue por sondeo
+        ESP_LOGW(TAG, "INT en GPIO%d no disponible (%s), se usa sondeo",
+                 s_int_pin, esp_err_to_name(err));
+        s_int_pin = GPIO_NUM_NC;
+        i2c_write(MPU6050_REG_INT_ENABLE, 0x00);
+    }
+
+    mpu_bias_reset(false);   // s_rate_hz ya es la real
+    seqlock_init(&s_last);
+    s_ready = true;
+
+    ESP_LOGI(TAG, "MPU6050 inicializado en I2C%d  (SDA=%d, SCL=%d), %lu Hz, ráfaga cada %lu ms",
+             s_i2c_port, cfg->sda, cfg->scl, (unsigned long)s_rate_hz,
+             (unsigned long)(s_burst_ticks * portTICK_PERIOD_MS));
+    if (s_int_pin != GPIO_NUM_NC) {
+        ESP_LOGI(TAG, "INT data-ready en GPIO%d, tarea cada %lu muestras",
+                 s_int_pin, (unsigned long)s_wake_every);
+    }
 
     return ESP_OK;
 }
 
+// La FIFO se llena durante el calibrado: se empieza de cero
+static esp_err_t mpu_start(void) {
+    s_last_wake = xTaskGetTickCount();
+    return fifo_reset();
+}
+
 esp_err_t mpu6050_stop(void) {
-    if (s_task) { vTaskDelete(s_task); s_task = NULL; }
-    if (s_mutex) { vSemaphoreDelete(s_mutex); s_mutex = NULL; }
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
+    // la ISR no debe notificar a una tarea que ya no lee
+    if (s_int_pin != GPIO_NUM_NC) {
+        gpio_isr_handler_remove(s_int_pin);
+        i2c_write(MPU6050_REG_INT_ENABLE, 0x00);
+    }
+    s_task = NULL;
+    s_ready = false;
     i2c_driver_delete(s_i2c_port);
     return ESP_OK;
 }
 
 esp_err_t mpu6050_get_latest(mpu6050_data_t *out, TickType_t timeout_ticks) {
     if (!out) return ESP_ERR_INVALID_ARG;
-    if (!s_mutex) return ESP_ERR_INVALID_STATE;
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
+
+    // Lectura partida: se reintenta. Si el escritor está a medias en este
+    // mismo core, hay que cederle la CPU para que termine.
+    TickType_t waited = 0;
+    while (!seqlock_read(&s_last, out, sizeof(*out), MPU6050_LATEST_TRIES, NULL)) {
+        if (waited++ >= timeout_ticks) return ESP_ERR_TIMEOUT;
+        vTaskDelay(1);
+    }
+    return ESP_OK;
+}
 
-    if (xSemaphoreTake(s_mutex, timeout_ticks) != pdTRUE)
-        return ESP_ERR_TIMEOUT;
+void mpu6050_get_stats(mpu6050_stats_t *out) {
+    if (out) *out = s_stats;
+}
 
-    *out = s_last;
-    xSemaphoreGive(s_mutex);
+// Suma las lecturas de reposo de una muestra cruda (14 bytes)
+static void cal_add(const uint8_t *raw) {
+    static const uint8_t pos[IMU_FIXED_AXES] = {0, 2, 4, 8, 10, 12};
+    for (int a = 0; a < IMU_FIXED_AXES; a++) {
+        int16_t v = (int16_t)((raw[pos[a]] << 8) | raw[pos[a] + 1]);
+        s_cal.sum[a] += v;
+        if (a >= 3) {
+            if (s_cal.n == 0 || v < s_cal.gmin[a - 3]) s_cal.gmin[a - 3] = v;
+            if (s_cal.n == 0 || v > s_cal.gmax[a - 3]) s_cal.gmax[a - 3] = v;
+        }
+    }
+    s_cal.n++;
+}
 
-    return ESP_OK;
+static void cal_save(const mpu6050_calibration_t *cal) {
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(MPU6050_NVS_NS, NVS_READWRITE, &h);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(h, MPU6050_NVS_CAL, cal, sizeof(*cal));
+        if (err == ESP_OK) err = nvs_commit(h);
+        nvs_close(h);
+    }
+    if (err != ESP_OK) ESP_LOGW(TAG, "No se pudo guardar la calibración: %s", esp_err_to_name(err));
 }
 
-esp_err_t mpu6050_calibrate(size_t samples) {
-    if (samples == 0) samples = 200;
+// Guarda la última calibración pendiente y termina
+static void cal_save_task(void *arg) {
+    for (;;) {
+        portENTER_CRITICAL(&s_save_lock);
+        bool pending = s_save_pending;
+        mpu6050_calibration_t cal = s_save_rec;
+        s_save_pending = false;
+        if (!pending) s_save_running = false;
+        portEXIT_CRITICAL(&s_save_lock);
+
+        if (!pending) break;
+        cal_save(&cal);
+    }
+    vTaskDelete(NULL);
+}
 
-    uint8_t raw[14];
-    int64_t sum_ax = 0, sum_ay = 0, sum_az = 0;
-    int64_t sum_gx = 0, sum_gy = 0, sum_gz = 0;
+// Guardado desde la tarea lectora: la tarea de guardado recoge el último
+// registro; si ya está en marcha, lo verá antes de terminar
+static void cal_save_later(const mpu6050_calibration_t *cal) {
+    portENTER_CRITICAL(&s_save_lock);
+    s_save_rec = *cal;
+    s_save_pending = true;
+    bool running = s_save_running;
+    s_save_running = true;
+    portEXIT_CRITICAL(&s_save_lock);
+    if (running) return;
+
+    if (xTaskCreate(cal_save_task, "imu_cal_save", MPU6050_SAVE_STACK, NULL,
+                    MPU6050_SAVE_PRIO, NULL) != pdPASS) {
+        portENTER_CRITICAL(&s_save_lock);
+        s_save_running = false;
+        s_save_pending = false;
+        portEXIT_CRITICAL(&s_save_lock);
+        ESP_LOGW(TAG, "No se pudo guardar la calibración: sin memoria para la tarea");
+    }
+}
 
-    for (size_t i = 0; i < samples; i++) {
-        if (i2c_read(MPU6050_REG_ACCEL_XOUT_H, raw, sizeof(raw)) == ESP_OK) {
+// Aplica offsets a la conversión en punto fijo. Solo desde quien convierte
+// (la tarea lectora) o antes de start.
+static void cal_apply(const mpu6050_calibration_t *cal) {
+    for (int a = 0; a < IMU_FIXED_AXES; a++) s_offset[a] = cal->offset[a];
+    imu_fixed_init(&s_fx, &s_conv, s_offset);
+    mpu_bias_reset(true);
+    s_cal_info = *cal;
+    s_cal_valid = true;
+}
 
-            int16_t ax = (raw[0] << 8) | raw[1];
-            int16_t ay = (raw[2] << 8) | raw[3];
-            int16_t az = (raw[4] << 8) | raw[5];
+// Cierra una medida: offsets = media (gravedad fuera de az) y aplicar; el
+// llamante la guarda. Si el giróscopo se ha movido no se toca nada.
+static esp_err_t cal_finish(void) {
+    if (s_cal.n == 0) return ESP_FAIL;
+
+    int32_t span_max = (int32_t)(MPU6050_CAL_MAX_SPAN_DPS * imu_fixed_gyro_lsb(s_conv.gyro_fs));
+    for (int i = 0; i < 3; i++) {
+        if (s_cal.gmax[i] - s_cal.gmin[i] > span_max) {
+            ESP_LOGW(TAG, "Calibrado descartado: IMU en movimiento (g%c %d LSB)",
+                     'x' + i, s_cal.gmax[i] - s_cal.gmin[i]);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
 
-            int16_t gx = (raw[8] << 8) | raw[9];
-            int16_t gy = (raw[10] << 8) | raw[11];
-            int16_t gz = (raw[12] << 8) | raw[13];
+    mpu6050_calibration_t cal = {
+        .version = MPU6050_CAL_VERSION,
+        .accel_fs = s_conv.accel_fs,
+        .gyro_fs = s_conv.gyro_fs,
+        .samples = s_cal.n,
+        .timestamp = (int64_t)time(NULL),
+    };
+    for (int a = 0; a < IMU_FIXED_AXES; a++) cal.offset[a] = (int16_t)(s_cal.sum[a] / (int64_t)s_cal.n);
+    cal.offset[2] -= (int16_t)imu_fixed_accel_lsb(s_conv.accel_fs); // quitar gravedad
 
-            sum_ax += ax;
-            sum_ay += ay;
-            sum_az += az;
+    cal_apply(&cal);
 
-            sum_gx += gx;
-            sum_gy += gy;
-            sum_gz += gz;
-        }
+    ESP_LOGI(TAG,
+        "Calibrado (%lu muestras): ax=%d ay=%d az=%d gx=%d gy=%d gz=%d",
+        (unsigned long)cal.samples,
+        cal.offset[0], cal.offset[1], cal.offset[2],
+        cal.offset[3], cal.offset[4], cal.offset[5]
+    );
+    return ESP_OK;
+}
+
+esp_err_t mpu6050_calibrate(size_t samples) {
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
+    if (samples > MPU6050_CAL_SAMPLES_MAX) return ESP_ERR_INVALID_ARG;
+    if (samples == 0) samples = MPU6050_CAL_SAMPLES;
 
+    uint8_t raw[14];
+    s_cal = (cal_acc_t){0};
+    for (size_t i = 0; i < samples; i++) {
+        if (i2c_read(MPU6050_REG_ACCEL_XOUT_H, raw, sizeof(raw)) == ESP_OK) cal_add(raw);
         vTaskDelay(pdMS_TO_TICKS(5));
     }
+    // antes de start: se puede guardar aquí mismo
+    esp_err_t err = cal_finish();
+    if (err == ESP_OK) cal_save(&s_cal_info);
+    return err;
+}
 
-    s_offset_ax = sum_ax / samples;
-    s_offset_ay = sum_ay / samples;
-    s_offset_az = sum_az / samples - (int16_t)ACCEL_SCALE; // quitar gravedad
+esp_err_t mpu6050_request_calibration(size_t samples) {
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
+    if (samples > MPU6050_CAL_SAMPLES_MAX) return ESP_ERR_INVALID_ARG;
+    if (samples == 0) samples = MPU6050_CAL_SAMPLES;
+    atomic_store_explicit(&s_cal_request, (uint32_t)samples, memory_order_relaxed);
+    return ESP_OK;
+}
 
-    s_offset_gx = sum_gx / samples;
-    s_offset_gy = sum_gy / samples;
-    s_offset_gz = sum_gz / samples;
+esp_err_t mpu6050_load_calibration(void) {
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
 
-    ESP_LOGI(TAG,
-        "Calibrado: ax=%d ay=%d az=%d gx=%d gy=%d gz=%d",
-        s_offset_ax, s_offset_ay, s_offset_az,
-        s_offset_gx, s_offset_gy, s_offset_gz
-    );
+    mpu6050_calibration_t cal;
+    size_t len = sizeof(cal);
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(MPU6050_NVS_NS, NVS_READONLY, &h);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(h, MPU6050_NVS_CAL, &cal, &len);
+        nvs_close(h);
+    }
+    if (err != ESP_OK) return ESP_ERR_NOT_FOUND;
+
+    // Los offsets van en LSB: solo valen con el mismo fondo de escala
+    if (len != sizeof(cal) || cal.version != MPU6050_CAL_VERSION ||
+        cal.accel_fs != s_conv.accel_fs || cal.gyro_fs != s_conv.gyro_fs) {
+        ESP_LOGW(TAG, "Calibración guardada incompatible (v%u, fs %u/%u)",
+                 cal.version, cal.accel_fs, cal.gyro_fs);
+        return ESP_ERR_NOT_FOUND;
+    }
 
+    cal_apply(&cal);
+    ESP_LOGI(TAG, "Calibración cargada (t=%lld, %lu muestras)",
+             (long long)cal.timestamp, (unsigned long)cal.samples);
+    return ESP_OK;
+}
+
+esp_err_t mpu6050_get_calibration(mpu6050_calibration_t *out) {
+    if (!out) return ESP_ERR_INVALID_ARG;
+    if (!s_cal_valid) return ESP_ERR_NOT_FOUND;
+    *out = s_cal_info;
     return ESP_OK;
 }
 
+// calibrate de la fuente: en el arranque basta con la guardada; solo se
+// mide (1 s en reposo) si no hay o no vale
+static esp_err_t mpu_calibrate(size_t samples) {
+    if (mpu6050_load_calibration() == ESP_OK) return ESP_OK;
+    ESP_LOGI(TAG, "Sin calibración guardada: calibrando");
+    return mpu6050_calibrate(samples);
+}
+
+static esp_err_t mpu_init(const void *cfg) {
+    return mpu6050_init(cfg);
+}
+
+static void mpu_get_caps(sensor_caps_t *out) {
+    *out = (sensor_caps_t){
+        .kind = SENSOR_KIND_IMU,
+        .rate_hz = s_rate_hz,
+        .max_block = MPU6050_FIFO_MAX_SAMPLES,
+        .hw_timestamps = s_int_pin != GPIO_NUM_NC,
+        .simulated = false,
+    };
+}
+
+const sensor_source_t mpu6050_source = {
+    .name = "imu_mpu6050",
+    .init = mpu_init,
+    .calibrate = mpu_calibrate,
+    .start = mpu_start,
+    .read_block = mpu_read_block,
+    .stop = mpu6050_stop,
+    .get_caps = mpu_get_caps,
+};
@@ -3,6 +3,8 @@
 
 #include "esp_err.h"
 #include "driver/i2c.h"
+#include "sensor_source.h"
+#include "utils/imu_fixed.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,20 +19,97 @@ typedef struct {
   float gyro_z;
 } mpu6050_data_t;
 
-// Inicializa el bus y lanza la tarea del MPU6050.
-// Usa el bus físico indicado (I2C_NUM_0 o I2C_NUM_1), pines y frecuencia.
-esp_err_t mpu6050_start(i2c_port_t i2c_port, gpio_num_t sda, gpio_num_t scl, uint32_t clk_hz,
-                        uint32_t period_ms, uint32_t stack_size, UBaseType_t task_prio);
+// Contadores de adquisición (los escribe solo la tarea lectora)
+typedef struct {
+  uint32_t samples;         // muestras sacadas de la FIFO
+  uint32_t bursts;          // lecturas de FIFO con al menos una muestra
+  uint32_t fifo_overflows;  // FIFO llena: muestras perdidas y FIFO reiniciada
+  uint32_t read_errors;     // transacciones I2C fallidas
+  uint32_t int_timeouts;    // modo INT: la tarea despertó sin flancos
+  uint32_t ts_estimated;    // muestras con tiempo estimado (sin flanco INT que las date)
+  uint32_t still_windows;   // reposos que han corregido el sesgo del giróscopo
+  uint32_t still_rejected;  // "reposos" descartados (giro lento constante)
+  float temp_c;             // temperatura del MPU6050 (última ventana de sesgo)
+} mpu6050_stats_t;
+
+// Calibración guardada en NVS (blob). Los offsets van en LSB de los ejes
+// del sensor (ax..gz), así que solo valen con el mismo fondo de escala.
+#define MPU6050_CAL_VERSION 1
+typedef struct {
+  uint8_t version;    // MPU6050_CAL_VERSION; otra = no vale
+  uint8_t accel_fs;   // fondos de escala con los que se midió
+  uint8_t gyro_fs;
+  uint8_t reserved;
+  int16_t offset[6];
+  uint32_t samples;   // muestras promediadas
+  int64_t timestamp;  // time() al calibrar: s desde 1970 si hay hora, si no desde el arranque
+} mpu6050_calibration_t;
+
+typedef struct {
+  i2c_port_t i2c_port;        // I2C_NUM_0 o I2C_NUM_1
+  gpio_num_t sda;
+  gpio_num_t scl;
+  uint32_t clk_hz;
+  uint32_t sample_rate_hz;    // 4..1000, 0 = 100
+  gpio_num_t int_pin;         // pin INT del MPU6050; GPIO_NUM_NC = sondeo
+  uint32_t samples_per_wake;  // modo INT: 1 = una por muestra, 0 = una ráfaga
+  // Fondos de escala, unidades de salida y matriz de ejes de las muestras
+  // (imu_fixed.h). Todo a 0 = ±2 g, ±250 °/s, m/s² y °/s x100, sin rotar.
+  imu_fixed_config_t conv;
+} mpu6050_config_t;
+
+// Fuente IMU real (sensor_source.h); init recibe un mpu6050_config_t.
+// El MPU muestrea a sample_rate_hz con DLPF por debajo de Nyquist y deja
+// las muestras en su FIFO; read_block la vacía a ráfagas, las convierte en
+// punto fijo y reconstruye el tiempo de cada muestra.
+//
+// El sesgo del giróscopo no queda fijo tras calibrar: en cada ventana de
+// reposo se vuelve a estimar, junto con su deriva con la temperatura del
+// propio MPU6050 (utils/gyro_bias.h), y se aplica a las muestras
+// siguientes sin parar la lectura.
+//
+// Modo INT (int_pin): se activa la interrupción data-ready; la ISR apunta
+// el instante de cada muestra con esp_timer_get_time() y despierta a la
+// tarea lectora cada samples_per_wake muestras. El MPU6050 no tiene
+// interrupción por nivel de FIFO: este contador hace de watermark. Sin INT
+// la lectura va a periodo fijo (vTaskDelayUntil).
+extern const sensor_source_t mpu6050_source;
 
-// Detiene la tarea y libera recursos.
+// Configura el bus y el MPU6050 (lo mismo que mpu6050_source.init).
+esp_err_t mpu6050_init(const mpu6050_config_t *cfg);
+
+// Libera ISR, bus y recursos. La tarea lectora ya no debe leer.
 esp_err_t mpu6050_stop(void);
 
-// Obtiene la última muestra de forma thread-safe.
+// Última muestra en float (m/s², °/s), desde cualquier tarea o core sin
+// bloquear a la lectora (seqlock). Solo para depuración: las muestras del
+// packet manager van en punto fijo.
 esp_err_t mpu6050_get_latest(mpu6050_data_t *out, TickType_t timeout_ticks);
 
-// Calibración simple: promedia N lecturas en reposo.
+// Copia los contadores de adquisición.
+void mpu6050_get_stats(mpu6050_stats_t *out);
+
+// Calibración. mpu6050_source.calibrate carga la guardada en NVS y solo
+// mide si no hay (o es de otra versión o fondo de escala): tras un reset
+// por watchdog no se recalibra con la IMU quizá en movimiento.
+//
+// mpu6050_calibrate: mide ya (antes de start), promedia N lecturas en
+// reposo (0 = 200, ~1 s; como mucho 800, si no ESP_ERR_INVALID_ARG),
+// aplica y guarda. Se descarta, sin tocar nada, si el giróscopo se mueve
+// durante la medida.
 esp_err_t mpu6050_calibrate(size_t samples);
 
+// Igual pero en marcha: la tarea lectora promedia las N siguientes
+// muestras de la FIFO sin dejar de entregarlas y las aplica; el guardado
+// en NVS va en una tarea aparte de baja prioridad. No bloquea.
+esp_err_t mpu6050_request_calibration(size_t samples);
+
+// Carga y aplica la calibración de NVS. ESP_ERR_NOT_FOUND si no hay o no vale.
+esp_err_t mpu6050_load_calibration(void);
+
+// Calibración en uso. ESP_ERR_NOT_FOUND si aún no hay.
+esp_err_t mpu6050_get_calibration(mpu6050_calibration_t *out);
+
 #ifdef __cplusplus
 }
 #endif
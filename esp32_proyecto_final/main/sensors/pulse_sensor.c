@@ -1,6 +1,5 @@
 #include "pulse_sensor.h"
 #include "../drivers/adc_driver.h"
-#include "../utils/packet_manager.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -15,28 +14,50 @@
 static adc_continuous_handle_t adc_handle;
 static float last_bpm = 0.0f;
 
-void pulse_sensor_task(void *pvParameters) {
+// Estado de la detección (solo la tarea lectora)
+static float bpm = 0.0f;
+static float threshold = 2000.0f;
+static bool pulse_detected = false;
+static int64_t last_pulse_time = 0;
+static int64_t last_report_time = 0;
+
+static esp_err_t pulse_init(const void *cfg) {
+  (void)cfg;
+  ESP_LOGI(TAG, "Configurando ADC continuo...");
+  return adc_driver_init(&adc_handle);
+}
+
+static esp_err_t pulse_start(void) {
+  bpm = 0.0f;
+  threshold = 2000.0f;
+  pulse_detected = false;
+  last_pulse_time = 0;
+  last_report_time = esp_timer_get_time();
+  ESP_LOGI(TAG, "💓 Iniciando lectura continua del ADC (modo real)...");
+  return ESP_OK;
+}
+
+// Lee el ADC cada 10 ms hasta que toca informar y devuelve el BPM
+static size_t pulse_read_block(void *out, size_t max) {
   adc_channel_result_t results[] = {
     {.channel = ADC_CHANNEL_0, .average = 0},
   };
+  if (max == 0) return 0;
 
-  float bpm = 0.0f;
-  float threshold = 2000.0f;
-  bool pulse_detected = false;
-  int64_t last_pulse_time = 0;
-  int64_t last_report_time = 0;
-
-  ESP_LOGI(TAG, "💓 Iniciando lectura continua del ADC (modo real)...");
+  // Como mucho un periodo de informe por llamada: sin datos del ADC se
+  // vuelve con 0 y sensor_acq puede parar la tarea entre medias
+  int64_t deadline = esp_timer_get_time() + REPORT_PERIOD_MS * 1000;
 
   while (1) {
     int samples = adc_driver_read_multi(adc_handle, results, 1);
+    int64_t now = esp_timer_get_time();
     if (samples <= 0) {
+      if (now >= deadline) return 0;
       vTaskDelay(pdMS_TO_TICKS(10));
       continue;
     }
 
     int raw = results[0].average;
-    int64_t now = esp_timer_get_time();
 
     // Seguimiento dinámico del nivel base
     threshold = 0.95f * threshold + 0.05f * raw;
@@ -60,29 +81,43 @@ void pulse_sensor_task(void *pvParameters) {
       pulse_detected = false;
     }
 
-    // Enviar valores solo por packet_manager
+    // El BPM sale cada REPORT_PERIOD_MS (lo encola sensor_acq)
     if ((now - last_report_time) > (REPORT_PERIOD_MS * 1000)) {
       last_report_time = now;
 
       uint16_t bpm_u16 = (uint16_t)roundf(bpm);
-
-      // Encolar la pulsación para el paquete compacto
-      if (pm_feed_pulse(bpm_u16) != 0) {
-        ESP_LOGW(TAG, "pm_feed_pulse: cola llena, descartado (%u)", bpm_u16);
-      } else {
-        ESP_LOGI(TAG, "💓 BPM enviado al packet_manager: %u", bpm_u16);
-      }
+      ESP_LOGI(TAG, "💓 BPM medido: %u", bpm_u16);
+      *(uint16_t *)out = bpm_u16;
+      return 1;
     }
 
+    if (now >= deadline) return 0;
     vTaskDelay(pdMS_TO_TICKS(10));
   }
 }
 
-void pulse_sensor_start() {
-  ESP_LOGI(TAG, "Configurando ADC continuo...");
-  adc_driver_init(&adc_handle);
+static esp_err_t pulse_stop(void) {
+  esp_err_t err = adc_continuous_stop(adc_handle);
+  if (err == ESP_OK) err = adc_continuous_deinit(adc_handle);
+  return err;
+}
 
-  xTaskCreate(pulse_sensor_task, "pulse_sensor_task",
-              4096, NULL, 5, NULL);
+static void pulse_get_caps(sensor_caps_t *out) {
+  *out = (sensor_caps_t){
+    .kind = SENSOR_KIND_PULSE,
+    .rate_hz = 1000 / REPORT_PERIOD_MS,
+    .max_block = 1,
+    .hw_timestamps = false,
+    .simulated = false,
+  };
 }
 
+const sensor_source_t pulse_sensor_source = {
+  .name = "pulse_adc",
+  .init = pulse_init,
+  .calibrate = NULL,
+  .start = pulse_start,
+  .read_block = pulse_read_block,
+  .stop = pulse_stop,
+  .get_caps = pulse_get_caps,
+};
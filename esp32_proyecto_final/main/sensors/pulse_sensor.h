@@ -1,4 +1,6 @@
 #pragma once
+#include "sensor_source.h"
 
-void pulse_sensor_start(void);
-
+/* Pulso real por ADC continuo (sensor_source.h): detecta latidos a 100 Hz
+ * y da un BPM cada 500 ms. init no usa cfg. */
+extern const sensor_source_t pulse_sensor_source;
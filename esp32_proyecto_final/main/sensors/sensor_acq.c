@@ -0,0 +1,126 @@
+#include "sensor_acq.h"
+#include "utils/packet_manager.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+static const char *TAG = "SENSOR_ACQ";
+
+// Muestras por read_block (la FIFO entera del MPU6050 son 73)
+#define SENSOR_ACQ_BLOCK 80
+
+typedef struct {
+  const sensor_source_t *src;
+  sensor_caps_t caps;
+  TaskHandle_t task;
+  volatile bool run;
+  sensor_acq_stats_t stats;      // solo los escribe la tarea
+  union {
+    pm_imu_sample_t imu[SENSOR_ACQ_BLOCK];
+    uint16_t pulse[SENSOR_ACQ_BLOCK];
+  } block;
+} acq_slot_t;
+
+static acq_slot_t s_slots[SENSOR_ACQ_MAX];
+
+static acq_slot_t *slot_of(const sensor_source_t *src) {
+  for (size_t i = 0; i < SENSOR_ACQ_MAX; i++) {
+    if (s_slots[i].src == src) return &s_slots[i];
+  }
+  return NULL;
+}
+
+// Entrega al packet manager: cada tipo tiene aquí su único productor
+static size_t acq_deliver(acq_slot_t *s, size_t n) {
+  if (s->caps.kind == SENSOR_KIND_IMU) {
+    return pm_feed_imu_block(s->block.imu, n);
+  }
+  size_t ok = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (pm_feed_pulse(s->block.pulse[i]) == 0) ok++;
+  }
+  return ok;
+}
+
+static void acq_task(void *arg) {
+  acq_slot_t *s = arg;
+  size_t max = s->caps.max_block;
+  if (max == 0 || max > SENSOR_ACQ_BLOCK) max = SENSOR_ACQ_BLOCK;
+
+  ESP_LOGI(TAG, "%s: %lu Hz, hasta %u muestras por bloque%s",
+           s->src->name, (unsigned long)s->caps.rate_hz, (unsigned)max,
+           s->caps.simulated ? " (simulada)" : "");
+
+  while (s->run) {
+    size_t n = s->src->read_block(&s->block, max);
+    if (n == 0) continue;
+
+    size_t ok = acq_deliver(s, n);
+    s->stats.blocks++;
+    s->stats.samples += n;
+    s->stats.dropped += n - ok;
+    if (ok < n) {
+      ESP_LOGD(TAG, "%s: cola llena, %u descartadas", s->src->name, (unsigned)(n - ok));
+    }
+  }
+
+  s->src->stop();
+  ESP_LOGI(TAG, "%s detenida", s->src->name);
+  s->task = NULL;
+  s->src = NULL;
+  vTaskDelete(NULL);
+}
+
+esp_err_t sensor_acq_start(const sensor_source_t *src, const void *cfg,
+                           uint32_t stack_size, UBaseType_t task_prio) {
+  if (!src || !src->init || !src->start || !src->read_block || !src->stop || !src->get_caps) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (slot_of(src)) return ESP_ERR_INVALID_STATE;
+  acq_slot_t *s = slot_of(NULL);
+  if (!s) return ESP_ERR_NO_MEM;
+
+  esp_err_t err = src->init(cfg);
+  if (err != ESP_OK) return err;
+
+  if (src->calibrate && src->calibrate(0) != ESP_OK) {
+    ESP_LOGW(TAG, "%s: calibrado fallido (pero seguimos)", src->name);
+  }
+
+  err = src->start();
+  if (err != ESP_OK) {
+    src->stop();
+    return err;
+  }
+
+  s->src = src;
+  src->get_caps(&s->caps);
+  s->stats = (sensor_acq_stats_t){0};
+  s->run = true;
+
+  BaseType_t ok = xTaskCreate(acq_task, src->name,
+                              stack_size ? stack_size : 4096, s,
+                              task_prio ? task_prio : 5, &s->task);
+  if (ok != pdPASS) {
+    ESP_LOGE(TAG, "No se pudo crear la tarea de %s", src->name);
+    src->stop();
+    s->src = NULL;
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+esp_err_t sensor_acq_stop(const sensor_source_t *src) {
+  acq_slot_t *s = src ? slot_of(src) : NULL;
+  if (!s) return ESP_ERR_NOT_FOUND;
+  s->run = false;
+  return ESP_OK;
+}
+
+esp_err_t sensor_acq_get_stats(const sensor_source_t *src, sensor_acq_stats_t *out) {
+  acq_slot_t *s = src ? slot_of(src) : NULL;
+  if (!s || !out) return ESP_ERR_NOT_FOUND;
+  *out = s->stats;
+  return ESP_OK;
+}
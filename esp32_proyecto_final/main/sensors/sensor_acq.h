@@ -0,0 +1,35 @@
+#pragma once
+#include "sensor_source.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Adquisición: una tarea por fuente que llama a read_block y entrega las
+ * muestras al packet manager (pm_feed_imu_block / pm_feed_pulse). Es el
+ * único productor de cada ring del packet manager, sea cual sea el backend.
+ */
+
+#define SENSOR_ACQ_MAX 2
+
+typedef struct {
+  uint32_t blocks;     /* read_block con al menos una muestra */
+  uint32_t samples;    /* muestras leídas de la fuente */
+  uint32_t dropped;    /* rechazadas por el packet manager (cola llena) */
+} sensor_acq_stats_t;
+
+/* init + calibrate (si la fuente lo tiene) + start + tarea de adquisición.
+ * Si init falla no se arranca nada y se devuelve el error. */
+esp_err_t sensor_acq_start(const sensor_source_t *src, const void *cfg,
+                           uint32_t stack_size, UBaseType_t task_prio);
+
+/* La tarea termina tras su read_block en curso y llama a stop de la fuente. */
+esp_err_t sensor_acq_stop(const sensor_source_t *src);
+
+/* Contadores de la fuente (ESP_ERR_NOT_FOUND si no está arrancada). */
+esp_err_t sensor_acq_get_stats(const sensor_source_t *src, sensor_acq_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
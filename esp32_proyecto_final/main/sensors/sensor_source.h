@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Fuente de muestras (sensor real o simulador) con una interfaz común, para
+ * que app_main y la adquisición (sensor_acq.h) no dependan del backend.
+ *
+ * Ciclo de vida: init(cfg) -> [calibrate] -> start -> read_block... -> stop.
+ * read_block lo llama siempre la misma tarea (la de sensor_acq): la fuente
+ * marca el ritmo esperando dentro hasta tener la siguiente tanda de
+ * muestras. No encola nada en el packet manager; eso es cosa de sensor_acq.
+ */
+
+typedef enum {
+  SENSOR_KIND_IMU = 0,  /* read_block da pm_imu_sample_t */
+  SENSOR_KIND_PULSE,    /* read_block da uint16_t (BPM) */
+} sensor_kind_t;
+
+typedef struct {
+  sensor_kind_t kind;
+  uint32_t rate_hz;     /* muestras por segundo (tras init); 0 = menos de 1 Hz */
+  uint16_t max_block;   /* como mucho tantas muestras por read_block */
+  bool hw_timestamps;   /* tiempos del propio sensor (FIFO/INT), no del lector */
+  bool simulated;
+} sensor_caps_t;
+
+typedef struct sensor_source {
+  const char *name;
+
+  /* cfg depende del backend (p.ej. mpu6050_config_t); NULL = por defecto */
+  esp_err_t (*init)(const void *cfg);
+
+  /* Opcional (NULL si no aplica): antes de start. Puede cargar una
+   * calibración guardada en vez de medir (en reposo). */
+  esp_err_t (*calibrate)(size_t samples);
+
+  esp_err_t (*start)(void);
+
+  /* Espera la siguiente tanda y copia hasta max muestras del tipo de
+   * caps.kind en out. Devuelve cuántas (0 = ninguna esta vez). */
+  size_t (*read_block)(void *out, size_t max);
+
+  esp_err_t (*stop)(void);
+
+  void (*get_caps)(sensor_caps_t *out);
+} sensor_source_t;
+
+#ifdef __cplusplus
+}
+#endif
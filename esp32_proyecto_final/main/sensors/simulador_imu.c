@@ -8,73 +8,91 @@
 
 static const char *TAG = "IMU_SIM";
 
+#define IMU_SIM_PERIOD_MS 20   // 50 Hz
+
 /* Última muestra simulada */
 static mpu6050_data_t latest = {0};
+static float t = 0.0f;
+static TickType_t last_wake;
 
-/* ----------- TAREA DE SIMULACIÓN IMU ----------- */
-static void imu_sim_task(void *arg) {
-  (void)arg;
-  ESP_LOGW(TAG, "IMU simulator task started");
+/* ----------- FUENTE SIMULADA ----------- */
+static esp_err_t imu_sim_init(const void *cfg) {
+  (void)cfg;
+  ESP_LOGW(TAG, "Starting IMU simulator...");
+  t = 0.0f;
+  return ESP_OK;
+}
 
-  float t = 0.0f;
+static esp_err_t imu_sim_calibrate(size_t samples) {
+  ESP_LOGW(TAG, "Simulated IMU calibration: %u samples", (unsigned)samples);
+  return ESP_OK;
+}
 
-  while (1) {
-    /* Generar datos simulados */
-    latest.accel_x = 0.05f * sinf(t * 2.0f);
-    latest.accel_y = 0.04f * sinf(t * 1.3f);
-    latest.accel_z = 9.81f + 0.02f * sinf(t * 0.7f);
+static esp_err_t imu_sim_start(void) {
+  last_wake = xTaskGetTickCount();
+  return ESP_OK;
+}
 
-    latest.gyro_x = 1.0f * sinf(t * 1.1f);
-    latest.gyro_y = 0.5f * sinf(t * 0.9f);
-    latest.gyro_z = 0.3f * sinf(t * 1.7f);
+static size_t imu_sim_read_block(void *out, size_t max) {
+  if (max == 0) return 0;
+  vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(IMU_SIM_PERIOD_MS));
 
-    /* Convertir valores a formato compacto int16 (x100) */
-    int16_t ax_i = (int16_t)lrintf(latest.accel_x * 100.0f);
-    int16_t ay_i = (int16_t)lrintf(latest.accel_y * 100.0f);
-    int16_t az_i = (int16_t)lrintf(latest.accel_z * 100.0f);
+  /* Generar datos simulados */
+  latest.accel_x = 0.05f * sinf(t * 2.0f);
+  latest.accel_y = 0.04f * sinf(t * 1.3f);
+  latest.accel_z = 9.81f + 0.02f * sinf(t * 0.7f);
 
-    int16_t gx_i = (int16_t)lrintf(latest.gyro_x * 100.0f);
-    int16_t gy_i = (int16_t)lrintf(latest.gyro_y * 100.0f);
-    int16_t gz_i = (int16_t)lrintf(latest.gyro_z * 100.0f);
+  latest.gyro_x = 1.0f * sinf(t * 1.1f);
+  latest.gyro_y = 0.5f * sinf(t * 0.9f);
+  latest.gyro_z = 0.3f * sinf(t * 1.7f);
 
-    uint64_t ts = esp_timer_get_time() / 1000ULL;
+  /* Convertir valores a formato compacto int16 (x100) */
+  pm_imu_sample_t *s = out;
+  s->ax = (int16_t)lrintf(latest.accel_x * 100.0f);
+  s->ay = (int16_t)lrintf(latest.accel_y * 100.0f);
+  s->az = (int16_t)lrintf(latest.accel_z * 100.0f);
 
-    /* Encolar compact IMU */
-    pm_feed_imu_compact(ax_i, ay_i, az_i, gx_i, gy_i, gz_i, ts);
+  s->gx = (int16_t)lrintf(latest.gyro_x * 100.0f);
+  s->gy = (int16_t)lrintf(latest.gyro_y * 100.0f);
+  s->gz = (int16_t)lrintf(latest.gyro_z * 100.0f);
 
-    ESP_LOGD(TAG, "pm_feed_imu_compact enqueued ax=%d ay=%d az=%d gx=%d gy=%d gz=%d ts=%llu",
-             ax_i, ay_i, az_i, gx_i, gy_i, gz_i, (unsigned long long)ts);
+  s->ts32 = (uint32_t)(esp_timer_get_time() / 1000ULL);
 
-    t += 0.05f;
-    vTaskDelay(pdMS_TO_TICKS(20));  // 50 Hz
-  }
-}
+  ESP_LOGD(TAG, "sim ax=%d ay=%d az=%d gx=%d gy=%d gz=%d ts=%lu",
+           s->ax, s->ay, s->az, s->gx, s->gy, s->gz, (unsigned long)s->ts32);
 
-/* ----------- API PÚBLICA ----------- */
-esp_err_t mpu6050_sim_start(void) {
-  ESP_LOGW(TAG, "Starting IMU simulator...");
+  t += 0.05f;
+  return 1;
+}
 
-  BaseType_t ok = xTaskCreate(
-    imu_sim_task,
-    "imu_sim_task",
-    4096,
-    NULL,
-    6,
-    NULL
-  );
+static esp_err_t imu_sim_stop(void) {
+  return ESP_OK;
+}
 
-  return ok == pdPASS ? ESP_OK : ESP_FAIL;
+static void imu_sim_get_caps(sensor_caps_t *out) {
+  *out = (sensor_caps_t){
+    .kind = SENSOR_KIND_IMU,
+    .rate_hz = 1000 / IMU_SIM_PERIOD_MS,
+    .max_block = 1,
+    .hw_timestamps = false,
+    .simulated = true,
+  };
 }
 
+const sensor_source_t mpu6050_sim_source = {
+  .name = "imu_sim",
+  .init = imu_sim_init,
+  .calibrate = imu_sim_calibrate,
+  .start = imu_sim_start,
+  .read_block = imu_sim_read_block,
+  .stop = imu_sim_stop,
+  .get_caps = imu_sim_get_caps,
+};
+
+/* ----------- API PÚBLICA ----------- */
 esp_err_t mpu6050_sim_get_latest(mpu6050_data_t *out, TickType_t timeout) {
   (void)timeout;
   if (!out) return ESP_ERR_INVALID_ARG;
   *out = latest;
   return ESP_OK;
 }
-
-esp_err_t mpu6050_sim_calibrate(size_t samples) {
-  ESP_LOGW(TAG, "Simulated IMU calibration: %u samples", (unsigned)samples);
-  return ESP_OK;
-}
-
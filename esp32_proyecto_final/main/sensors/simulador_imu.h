@@ -1,15 +1,16 @@
 #pragma once
 #include "esp_err.h"
 #include "sensors/mpu6050.h" /* si tienes la estructura mpu6050_data_t */
+#include "sensor_source.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-esp_err_t mpu6050_sim_start(void);
+/* IMU simulada a 50 Hz (sensor_source.h); init no usa cfg */
+extern const sensor_source_t mpu6050_sim_source;
+
 esp_err_t mpu6050_sim_get_latest(mpu6050_data_t *out, TickType_t timeout_ticks);
-esp_err_t mpu6050_sim_calibrate(size_t samples);
 
 #ifdef __cplusplus
 }
 #endif
-
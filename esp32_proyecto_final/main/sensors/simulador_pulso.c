@@ -3,53 +3,73 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include <stdlib.h>
-#include "utils/packet_manager.h"
 
 static const char *TAG = "PULSE_SIM";
 static uint16_t latest_bpm = 60;
+static float drift = 0.0f;
+static TickType_t last_wake;
 
-static void pulse_sim_task(void *arg) {
-  (void)arg;
+static esp_err_t pulse_sim_init(const void *cfg) {
+  (void)cfg;
   ESP_LOGW(TAG, "Pulse simulator started");
+  drift = 0.0f;
+  return ESP_OK;
+}
 
-  float bpm = 70.0f;              // valor inicial
-  float drift = 0.0f;
+static esp_err_t pulse_sim_start(void) {
+  last_wake = xTaskGetTickCount();
+  return ESP_OK;
+}
 
-  while (1) {
+static size_t pulse_sim_read_block(void *out, size_t max) {
+  if (max == 0) return 0;
+  vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(1000));   // 1 Hz → 1 BPM por segundo
 
-    // --- Variación suave de BPM ---
-    float random_step = ((rand() % 2001) / 1000.0f - 1.0f) * 0.5f; // -0.5 a +0.5
-    drift += random_step;
+  // --- Variación suave de BPM ---
+  float random_step = ((rand() % 2001) / 1000.0f - 1.0f) * 0.5f; // -0.5 a +0.5
+  drift += random_step;
 
-    // Limitar deriva
-    if (drift > 5) drift = 5;
-    if (drift < -5) drift = -5;
+  // Limitar deriva
+  if (drift > 5) drift = 5;
+  if (drift < -5) drift = -5;
 
-    bpm = 70.0f + drift;
+  float bpm = 70.0f + drift;
 
-    // Limitar BPM a rango humano
-    if (bpm < 55) bpm = 55;
-    if (bpm > 95) bpm = 95;
+  // Limitar BPM a rango humano
+  if (bpm < 55) bpm = 55;
+  if (bpm > 95) bpm = 95;
 
-    latest_bpm = (uint16_t)bpm;
+  latest_bpm = (uint16_t)bpm;
+  ESP_LOGD(TAG, "BPM simulado = %u", latest_bpm);
 
-    // Enviar
-    if (pm_feed_pulse(latest_bpm) != 0) {
-      ESP_LOGD(TAG, "pm_feed_pulse: queue full, drop %u", latest_bpm);
-    } else {
-      ESP_LOGD(TAG, "pm_feed_pulse: enqueued BPM = %u", latest_bpm);
-    }
+  *(uint16_t *)out = latest_bpm;
+  return 1;
+}
 
-    vTaskDelay(pdMS_TO_TICKS(1000));   // 1 Hz → 1 BPM por segundo
-  }
+static esp_err_t pulse_sim_stop(void) {
+  return ESP_OK;
 }
 
-esp_err_t pulse_sensor_sim_start(void) {
-  BaseType_t ok = xTaskCreate(pulse_sim_task, "pulse_sim", 2048, NULL, 6, NULL);
-  return ok == pdPASS ? ESP_OK : ESP_FAIL;
+static void pulse_sim_get_caps(sensor_caps_t *out) {
+  *out = (sensor_caps_t){
+    .kind = SENSOR_KIND_PULSE,
+    .rate_hz = 1,
+    .max_block = 1,
+    .hw_timestamps = false,
+    .simulated = true,
+  };
 }
 
+const sensor_source_t pulse_sensor_sim_source = {
+  .name = "pulse_sim",
+  .init = pulse_sim_init,
+  .calibrate = NULL,
+  .start = pulse_sim_start,
+  .read_block = pulse_sim_read_block,
+  .stop = pulse_sim_stop,
+  .get_caps = pulse_sim_get_caps,
+};
+
 uint16_t pulse_sensor_sim_get_latest(void) {
   return latest_bpm;
 }
-
@@ -1,13 +1,15 @@
 #pragma once
 #include "esp_err.h"
+#include "sensor_source.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-esp_err_t pulse_sensor_sim_start(void);
+/* Pulso simulado, 1 BPM por segundo (sensor_source.h); init no usa cfg */
+extern const sensor_source_t pulse_sensor_sim_source;
+
 uint16_t pulse_sensor_sim_get_latest(void);
 
 #ifdef __cplusplus
 }
 #endif
-
@@ -0,0 +1,163 @@
+#include "gyro_bias.h"
+#include <math.h>
+#include <string.h>
+
+/* Valores típicos de la hoja de datos del MPU6050, con margen */
+#define WINDOW_S          0.5f
+#define ACCEL_STD_MAX_G   0.02f    /* por eje; el ruido propio ronda 4 mg */
+#define GYRO_SPAN_MAX_DPS 1.0f    /* máx - mín por eje en la ventana */
+#define GYRO_NOISE_DPS    0.05f    /* por muestra, con DLPF */
+#define BIAS_WALK_DPS_H   0.05f    /* deriva libre del sesgo, °/s por √h */
+#define TEMP_WALK_DPS_C_H 0.002f   /* del coeficiente, °/s/°C por √h */
+#define BIAS_CAL_DPS      0.1f     /* incertidumbre tras calibrar */
+#define BIAS_MAX_DPS      5.0f     /* sin calibrar / tope */
+#define TEMP_COEF_DPS_C   0.1f     /* tope del coeficiente térmico */
+#define GATE_SIGMA        5.0f
+#define REJECT_RESET_S    120.0f   /* tanto "reposo" descartado: sesgo perdido */
+
+static const uint8_t accel_pos[3] = {0, 2, 4};
+static const uint8_t gyro_pos[3] = {8, 10, 12};
+#define TEMP_POS 6
+
+static inline int16_t be16(const uint8_t *b) {
+  return (int16_t)((b[0] << 8) | b[1]);
+}
+
+void gyro_bias_config_default(gyro_bias_config_t *cfg, uint32_t rate_hz,
+                              float gyro_lsb, float accel_lsb) {
+  uint32_t window = (uint32_t)(rate_hz * WINDOW_S);
+  if (window < 4) window = 4;
+  if (window > GYRO_BIAS_WINDOW_MAX) window = GYRO_BIAS_WINDOW_MAX;
+
+  float accel_std = ACCEL_STD_MAX_G * accel_lsb;
+  float noise = GYRO_NOISE_DPS * gyro_lsb;
+  float walk_bias = BIAS_WALK_DPS_H * gyro_lsb;
+  float walk_temp = TEMP_WALK_DPS_C_H * gyro_lsb;
+  float bias_max = BIAS_MAX_DPS * gyro_lsb;
+  float temp_max = TEMP_COEF_DPS_C * gyro_lsb;
+
+  *cfg = (gyro_bias_config_t){
+    .window = window,
+    .window_s = (float)window / (float)(rate_hz ? rate_hz : 1),
+    .accel_var_max = 3.0f * accel_std * accel_std,
+    .gyro_span_max = (int32_t)(GYRO_SPAN_MAX_DPS * gyro_lsb),
+    .meas_var = noise * noise,
+    .q_bias = walk_bias * walk_bias / 3600.0f,
+    .q_temp = walk_temp * walk_temp / 3600.0f,
+    .p_bias_max = bias_max * bias_max,
+    .p_temp_max = temp_max * temp_max,
+    .gate = GATE_SIGMA,
+    .reject_reset = (uint32_t)(REJECT_RESET_S / WINDOW_S),
+  };
+}
+
+static void window_reset(gyro_bias_t *gb) {
+  gb->n = 0;
+  gb->tsum = 0;
+  for (int i = 0; i < 3; i++) {
+    gb->asum[i] = 0;
+    gb->gsum[i] = 0;
+    gb->asq[i] = 0;
+    gb->gmin[i] = INT16_MAX;
+    gb->gmax[i] = INT16_MIN;
+  }
+}
+
+void gyro_bias_init(gyro_bias_t *gb, const gyro_bias_config_t *cfg,
+                    const int16_t bias[3], bool calibrated) {
+  memset(gb, 0, sizeof(*gb));
+  gb->cfg = *cfg;
+  float bias_var = calibrated ? BIAS_CAL_DPS / BIAS_MAX_DPS : 1.0f;
+  gb->p00 = cfg->p_bias_max * bias_var * bias_var;
+  gb->p11 = cfg->p_temp_max;
+  for (int i = 0; i < 3; i++) gb->a[i] = bias ? bias[i] : 0;
+  window_reset(gb);
+}
+
+/* Cierra la ventana: predicción siempre, corrección solo en reposo */
+static void window_close(gyro_bias_t *gb, int32_t bias_q8[3]) {
+  const gyro_bias_config_t *c = &gb->cfg;
+  float n = (float)gb->n;
+  float temp = gyro_bias_temp_c((int16_t)(gb->tsum / (int32_t)gb->n));
+  gb->temp_c = temp;
+  gb->windows++;
+  if (!gb->has_ref) {
+    gb->t_ref = temp;
+    gb->has_ref = true;
+  }
+  float d = temp - gb->t_ref;
+
+  /* Predicción: a y b derivan libremente; sin reposo la incertidumbre crece
+   * hasta el tope, no más */
+  gb->p00 += c->q_bias * c->window_s;
+  gb->p11 += c->q_temp * c->window_s;
+  if (gb->p00 > c->p_bias_max) gb->p00 = c->p_bias_max;
+  if (gb->p11 > c->p_temp_max) gb->p11 = c->p_temp_max;
+
+  /* Reposo: giróscopo sin oscilar y acelerómetro quieto (varianza * n²
+   * exacta en enteros; en float la gravedad se comería la diferencia) */
+  bool still = true;
+  float var = 0;
+  for (int i = 0; i < 3; i++) {
+    if (gb->gmax[i] - gb->gmin[i] > c->gyro_span_max) still = false;
+    int64_t s = gb->asum[i];
+    var += (float)((int64_t)gb->n * gb->asq[i] - s * s) / (n * n);
+  }
+  if (var > c->accel_var_max) still = false;
+
+  if (still) {
+    /* h = [1, d], R = ruido de la media de la ventana */
+    float ph0 = gb->p00 + d * gb->p01;
+    float ph1 = gb->p01 + d * gb->p11;
+    float s = ph0 + d * ph1 + c->meas_var / n;
+    float gate = c->gate * sqrtf(s);
+
+    float innov[3];
+    for (int i = 0; i < 3; i++) {
+      innov[i] = (float)gb->gsum[i] / n - (gb->a[i] + gb->b[i] * d);
+      if (fabsf(innov[i]) > gate) still = false;
+    }
+
+    if (still) {
+      float k0 = ph0 / s, k1 = ph1 / s;
+      for (int i = 0; i < 3; i++) {
+        gb->a[i] += k0 * innov[i];
+        gb->b[i] += k1 * innov[i];
+      }
+      gb->p00 -= k0 * ph0;
+      gb->p01 -= k0 * ph1;
+      gb->p11 -= k1 * ph1;
+      gb->still++;
+      gb->reject_run = 0;
+    } else {
+      gb->rejected++;
+      if (++gb->reject_run >= c->reject_reset) {
+        gb->p00 = c->p_bias_max;
+        gb->reject_run = 0;
+      }
+    }
+  }
+
+  for (int i = 0; i < 3; i++) {
+    float bias = gb->a[i] + gb->b[i] * d;
+    bias_q8[i] = (int32_t)lrintf(bias * 256.0f);
+  }
+  window_reset(gb);
+}
+
+bool gyro_bias_update(gyro_bias_t *gb, const uint8_t *raw, int32_t bias_q8[3]) {
+  for (int i = 0; i < 3; i++) {
+    int32_t a = be16(&raw[accel_pos[i]]);
+    int32_t g = be16(&raw[gyro_pos[i]]);
+    gb->asum[i] += a;
+    gb->asq[i] += (int64_t)a * a;
+    gb->gsum[i] += g;
+    if (g < gb->gmin[i]) gb->gmin[i] = (int16_t)g;
+    if (g > gb->gmax[i]) gb->gmax[i] = (int16_t)g;
+  }
+  gb->tsum += be16(&raw[TEMP_POS]);
+
+  if (++gb->n < gb->cfg.window) return false;
+  window_close(gb, bias_q8);
+  return true;
+}
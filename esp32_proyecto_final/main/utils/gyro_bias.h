@@ -0,0 +1,97 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Seguimiento en marcha del sesgo del giróscopo del MPU6050 a partir de las
+ * muestras crudas (14 bytes: accel, temp, gyro), para que no se pierda con
+ * la deriva térmica de una noche entera sin volver a calibrar.
+ *
+ * No depende de ESP-IDF: se compila igual en el host (tools/).
+ *
+ * Las muestras se agrupan en ventanas fijas (~0,5 s). Una ventana es de
+ * reposo si la varianza del acelerómetro es baja y el giróscopo apenas
+ * oscila; entonces su media es una medida del sesgo. El sesgo se modela
+ * por eje como
+ *
+ *   sesgo(T) = a + b * (T - T_ref)
+ *
+ * con T la temperatura del propio MPU6050 (media de la ventana) y se
+ * estima con un filtro de Kalman de dos estados (a y b con deriva libre).
+ * Como la medida es la misma función de T en los tres ejes, la covarianza
+ * es una sola 2x2 para todos. Coste por muestra: unas sumas enteras; al
+ * cerrar ventana, unas decenas de operaciones float. Memoria fija.
+ *
+ * Entre reposos el sesgo sigue a la temperatura con el b aprendido. Una
+ * ventana "quieta" cuya media queda lejos de lo previsto (giro lento y
+ * constante) se descarta en vez de corregir. Si se descartan muchas
+ * seguidas lo que está mal es el sesgo (calibración mala): se vuelve a la
+ * incertidumbre máxima y la siguiente lo corrige.
+ */
+
+#define GYRO_BIAS_WINDOW_MAX 1000   /* muestras por ventana (sumas en int32) */
+
+typedef struct {
+  uint32_t window;        /* muestras por ventana */
+  float window_s;         /* su duración (s) */
+  float accel_var_max;    /* LSB²: suma de las varianzas de los 3 ejes */
+  int32_t gyro_span_max;  /* LSB: máx - mín del giróscopo por eje */
+  float meas_var;         /* LSB²: ruido de una muestra del giróscopo */
+  float q_bias;           /* LSB²/s: deriva libre de a */
+  float q_temp;           /* (LSB/°C)²/s: deriva libre de b */
+  float p_bias_max;       /* LSB²: tope de la varianza de a */
+  float p_temp_max;       /* (LSB/°C)²: tope de la varianza de b */
+  float gate;             /* innovación máxima, en desviaciones típicas */
+  uint32_t reject_reset;  /* descartes seguidos para dar el sesgo por perdido */
+} gyro_bias_config_t;
+
+typedef struct {
+  gyro_bias_config_t cfg;
+
+  /* Ventana en curso */
+  uint32_t n;
+  int32_t asum[3], gsum[3], tsum;
+  int64_t asq[3];
+  int16_t gmin[3], gmax[3];
+
+  /* Filtro */
+  float a[3];             /* sesgo a T_ref (LSB) */
+  float b[3];             /* coeficiente térmico (LSB/°C) */
+  float p00, p01, p11;    /* covarianza de (a, b), común a los 3 ejes */
+  float t_ref;            /* °C; la de la primera ventana */
+  bool has_ref;
+  uint32_t reject_run;    /* descartes seguidos */
+
+  /* Contadores */
+  uint32_t windows;       /* ventanas cerradas */
+  uint32_t still;         /* de reposo que han corregido el sesgo */
+  uint32_t rejected;      /* de reposo descartadas por la innovación */
+  float temp_c;           /* temperatura de la última ventana */
+} gyro_bias_t;
+
+/* Temperatura del MPU6050 desde TEMP_OUT (hoja de registros) */
+static inline float gyro_bias_temp_c(int16_t raw) {
+  return (float)raw / 340.0f + 36.53f;
+}
+
+/* Umbrales y ruidos típicos del MPU6050 en LSB para la tasa y los fondos
+ * de escala dados (LSB por °/s y por g). */
+void gyro_bias_config_default(gyro_bias_config_t *cfg, uint32_t rate_hz,
+                              float gyro_lsb, float accel_lsb);
+
+/* Empieza con sesgo bias (LSB, ejes del sensor gx..gz). calibrated = ese
+ * sesgo viene de una calibración y se confía más en él. */
+void gyro_bias_init(gyro_bias_t *gb, const gyro_bias_config_t *cfg,
+                    const int16_t bias[3], bool calibrated);
+
+/* Añade una muestra cruda. Al cerrar ventana devuelve true y deja en
+ * bias_q8 el sesgo para la temperatura actual en LSB/256. */
+bool gyro_bias_update(gyro_bias_t *gb, const uint8_t *raw, int32_t bias_q8[3]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,145 @@
+#include "imu_codec.h"
+#include <string.h>
+
+/* ============================
+   Varint (LEB128) + zig-zag
+   ============================ */
+
+static inline uint16_t zigzag16(int16_t v) {
+  return (uint16_t)(((uint16_t)v << 1) ^ (uint16_t)(v >> 15));
+}
+
+static inline int16_t unzigzag16(uint16_t u) {
+  return (int16_t)((u >> 1) ^ (uint16_t)(-(int16_t)(u & 1)));
+}
+
+static inline int varint_len(uint16_t v) {
+  if (v < 0x80) return 1;
+  if (v < 0x4000) return 2;
+  return 3;
+}
+
+static inline int varint_put(uint8_t *out, uint16_t v) {
+  int n = 0;
+  while (v >= 0x80) {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+/* Devuelve bytes consumidos o -1 (truncado o más de 16 bits) */
+static inline int varint_get(const uint8_t *in, size_t len, uint16_t *v) {
+  uint32_t acc = 0;
+  for (size_t i = 0; i < len && i < 3; i++) {
+    acc |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+    if ((in[i] & 0x80) == 0) {
+      if (acc > 0xFFFF) return -1;
+      *v = (uint16_t)acc;
+      return (int)i + 1;
+    }
+  }
+  return -1;
+}
+
+static inline uint16_t delta16(int16_t cur, int16_t prev) {
+  return zigzag16((int16_t)(uint16_t)((uint16_t)cur - (uint16_t)prev));
+}
+
+/* ============================
+   API
+   ============================ */
+
+void imu_codec_reset(imu_codec_state_t *st, bool with_dt) {
+  memset(st, 0, sizeof(*st));
+  st->with_dt = with_dt;
+}
+
+int imu_codec_sample_len(const imu_codec_state_t *st,
+                         const int16_t s[IMU_CODEC_AXES], uint16_t dt) {
+  int n = 0;
+
+  if (st->with_dt) {
+    uint16_t ddt = st->count ? (uint16_t)(dt - st->prev_dt) : dt;
+    n += varint_len(ddt);
+  }
+
+  if (st->count == 0) return n + IMU_CODEC_RAW_LEN;
+
+  for (int a = 0; a < IMU_CODEC_AXES; a++) {
+    n += varint_len(delta16(s[a], st->prev[a]));
+  }
+  return n;
+}
+
+int imu_codec_put(imu_codec_state_t *st, uint8_t *out, size_t room,
+                  const int16_t s[IMU_CODEC_AXES], uint16_t dt) {
+  int need = imu_codec_sample_len(st, s, dt);
+  if (need < 0 || (size_t)need > room) return -1;
+
+  int off = 0;
+
+  if (st->with_dt) {
+    uint16_t ddt = st->count ? (uint16_t)(dt - st->prev_dt) : dt;
+    off += varint_put(out + off, ddt);
+  }
+
+  if (st->count == 0) {
+    /* primera muestra del bloque en crudo (int16 LE) */
+    for (int a = 0; a < IMU_CODEC_AXES; a++) {
+      uint16_t u = (uint16_t)s[a];
+      out[off++] = (uint8_t)(u & 0xFF);
+      out[off++] = (uint8_t)(u >> 8);
+    }
+  } else {
+    for (int a = 0; a < IMU_CODEC_AXES; a++) {
+      off += varint_put(out + off, delta16(s[a], st->prev[a]));
+    }
+  }
+
+  memcpy(st->prev, s, sizeof(st->prev));
+  st->prev_dt = dt;
+  st->count++;
+  return off;
+}
+
+int imu_codec_decode(const uint8_t *in, size_t len, uint8_t count, bool with_dt,
+                     int16_t *imu_flat, uint16_t *dt) {
+  size_t off = 0;
+  int16_t prev[IMU_CODEC_AXES] = {0};
+  uint16_t prev_dt = 0;
+
+  for (uint8_t i = 0; i < count; i++) {
+    int16_t *s = &imu_flat[IMU_CODEC_AXES * i];
+
+    if (with_dt) {
+      uint16_t ddt;
+      int n = varint_get(in + off, len - off, &ddt);
+      if (n < 0) return -1;
+      off += n;
+      prev_dt = (i == 0) ? ddt : (uint16_t)(prev_dt + ddt);
+    }
+    if (dt) dt[i] = prev_dt;
+
+    if (i == 0) {
+      if (len - off < IMU_CODEC_RAW_LEN) return -1;
+      for (int a = 0; a < IMU_CODEC_AXES; a++) {
+        s[a] = (int16_t)(uint16_t)(in[off] | ((uint16_t)in[off + 1] << 8));
+        off += 2;
+      }
+    } else {
+      for (int a = 0; a < IMU_CODEC_AXES; a++) {
+        uint16_t z;
+        int n = varint_get(in + off, len - off, &z);
+        if (n < 0) return -1;
+        off += n;
+        s[a] = (int16_t)(uint16_t)((uint16_t)prev[a] + (uint16_t)unzigzag16(z));
+      }
+    }
+
+    memcpy(prev, s, sizeof(prev));
+  }
+
+  return (int)off;
+}
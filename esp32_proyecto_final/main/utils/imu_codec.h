@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Codec delta + varint para bloques IMU (PM_FLAG_IMU_DELTA).
+ *
+ * No depende de ESP-IDF: se compila igual en el host (tools/).
+ *
+ * Por cada muestra del bloque, en orden:
+ *  [dt]  varint de (dt_i - dt_{i-1}) si el paquete lleva PM_FLAG_SAMPLE_DT
+ *        (dt_0 va tal cual; los dt son no decrecientes)
+ *  muestra 0:  ax,ay,az,gx,gy,gz crudos (int16 LE, 12 bytes)
+ *  muestra i:  por eje, zig-zag varint de (int16)(v_i - v_{i-1})
+ *
+ * La resta se hace módulo 2^16, así que la reconstrucción es exacta para
+ * cualquier par de int16 y un delta nunca ocupa más de 3 bytes.
+ */
+
+#define IMU_CODEC_AXES         6
+#define IMU_CODEC_RAW_LEN      (IMU_CODEC_AXES * 2)
+#define IMU_CODEC_MIN_DELTA_LEN IMU_CODEC_AXES   /* 1 byte por eje */
+#define IMU_CODEC_MAX_DELTA_LEN (IMU_CODEC_AXES * 3)
+
+typedef struct {
+  int16_t prev[IMU_CODEC_AXES];
+  uint16_t prev_dt;
+  uint8_t count;      /* muestras ya codificadas/decodificadas en el bloque */
+  bool with_dt;
+} imu_codec_state_t;
+
+/* Empieza un bloque nuevo (la siguiente muestra irá en crudo). */
+void imu_codec_reset(imu_codec_state_t *st, bool with_dt);
+
+/* Bytes que ocuparía la muestra s (con su dt) si se añadiera ahora. */
+int imu_codec_sample_len(const imu_codec_state_t *st,
+                         const int16_t s[IMU_CODEC_AXES], uint16_t dt);
+
+/* Añade una muestra al bloque. Devuelve bytes escritos o -1 si no cabe
+ * en room (en ese caso el estado no cambia). */
+int imu_codec_put(imu_codec_state_t *st, uint8_t *out, size_t room,
+                  const int16_t s[IMU_CODEC_AXES], uint16_t dt);
+
+/* Decodifica count muestras de un bloque. imu_flat recibe 6*count int16 y
+ * dt (opcional, puede ser NULL) count valores. Devuelve bytes consumidos
+ * o -1 si el bloque está truncado o corrupto. */
+int imu_codec_decode(const uint8_t *in, size_t len, uint8_t count, bool with_dt,
+                     int16_t *imu_flat, uint16_t *dt);
+
+#ifdef __cplusplus
+}
+#endif
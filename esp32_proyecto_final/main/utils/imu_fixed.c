@@ -0,0 +1,81 @@
+#include "imu_fixed.h"
+#include <math.h>
+
+#define G_TO_MS2  9.80665
+#define DEG_TO_RAD (M_PI / 180.0)
+
+/* Byte de cada eje en la muestra cruda: accel(0..5) temp(6..7) gyro(8..13) */
+static const uint8_t raw_offset[IMU_FIXED_AXES] = {0, 2, 4, 8, 10, 12};
+
+/* LSB/(°/s) de la hoja de datos para FS_SEL 0..3 */
+static const float gyro_lsb[4] = {131.0f, 65.5f, 32.8f, 16.4f};
+
+float imu_fixed_accel_lsb(uint8_t accel_fs) {
+  return (float)(16384 >> (accel_fs & 3));
+}
+
+float imu_fixed_gyro_lsb(uint8_t gyro_fs) {
+  return gyro_lsb[gyro_fs & 3];
+}
+
+double imu_fixed_scale(const imu_fixed_config_t *cfg, int gyro) {
+  if (gyro) {
+    double lsb = imu_fixed_gyro_lsb(cfg->gyro_fs);
+    return (cfg->gyro_unit == IMU_GYRO_MRADS) ? 1000.0 * DEG_TO_RAD / lsb : 100.0 / lsb;
+  }
+  double lsb = imu_fixed_accel_lsb(cfg->accel_fs);
+  return (cfg->accel_unit == IMU_ACCEL_MG) ? 1000.0 / lsb : 100.0 * G_TO_MS2 / lsb;
+}
+
+int imu_fixed_init(imu_fixed_t *fx, const imu_fixed_config_t *cfg,
+                   const int16_t offset[IMU_FIXED_AXES]) {
+  static const int8_t identity[3] = {1, 2, 3};
+  const int8_t *axis = (cfg->axis[0] || cfg->axis[1] || cfg->axis[2]) ? cfg->axis : identity;
+
+  if (cfg->accel_fs > IMU_ACCEL_FS_16G || cfg->gyro_fs > IMU_GYRO_FS_2000 ||
+      cfg->accel_unit > IMU_ACCEL_MG || cfg->gyro_unit > IMU_GYRO_MRADS) {
+    return -1;
+  }
+
+  /* Permutación con signo: cada eje del sensor una sola vez */
+  unsigned used = 0;
+  for (int i = 0; i < 3; i++) {
+    int a = axis[i] < 0 ? -axis[i] : axis[i];
+    if (a < 1 || a > 3 || (used & (1u << a))) return -1;
+    used |= 1u << a;
+  }
+
+  for (int gyro = 0; gyro < 2; gyro++) {
+    /* La mayor precisión que cabe en 31 bits: con menos, valores a una
+     * fracción de LSB de .5 redondean al lado equivocado */
+    double scale = imu_fixed_scale(cfg, gyro);
+    int shift = 1;
+    while (shift < 62 && ldexp(scale, shift + 1) < (double)INT32_MAX) shift++;
+    int64_t mul = llround(ldexp(scale, shift));
+    if (mul > INT32_MAX) return -1;
+
+    for (int i = 0; i < 3; i++) {
+      int a = (axis[i] < 0 ? -axis[i] : axis[i]) - 1;   /* eje del sensor */
+      int in = 3 * gyro + a;
+      int out = 3 * gyro + i;
+      int32_t m = axis[i] < 0 ? -(int32_t)mul : (int32_t)mul;
+
+      fx->src[out] = raw_offset[in];
+      fx->mul[out] = m;
+      fx->shift[out] = (uint8_t)shift;
+      /* (raw - off) * m + 1/2, todo en el sesgo */
+      fx->bias[out] = (1LL << (shift - 1)) - (int64_t)(offset ? offset[in] : 0) * m;
+    }
+  }
+  return 0;
+}
+
+void imu_fixed_set_offset(imu_fixed_t *fx, int axis, int32_t offset_q8) {
+  if (axis < 0 || axis >= IMU_FIXED_AXES) return;
+  for (int out = 0; out < IMU_FIXED_AXES; out++) {
+    if (fx->src[out] != raw_offset[axis]) continue;
+    /* offset * m redondeado; exacto si offset_q8 es múltiplo de 256 */
+    int64_t om = ((int64_t)offset_q8 * fx->mul[out] + 128) >> 8;
+    fx->bias[out] = (1LL << (fx->shift[out] - 1)) - om;
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Conversión IMU en punto fijo: muestra cruda del MPU6050 (14 bytes big
+ * endian: accel, temp, gyro) a 6 int16 en las unidades de salida, sin
+ * float ni lrintf por muestra.
+ *
+ * No depende de ESP-IDF: se compila igual en el host (tools/).
+ *
+ * imu_fixed_init lo precalcula todo a partir del fondo de escala, las
+ * unidades, la matriz de ejes y los offsets de calibrado. Por cada eje de
+ * salida queda de qué eje del sensor sale, un multiplicador con signo
+ * normalizado a 31 bits con su desplazamiento y un sesgo que lleva el
+ * offset y el medio LSB del redondeo:
+ *
+ *   p = raw * mul + bias;  out = sat16(p >> shift)
+ *
+ * y si p cae justo en .5 se redondea a par, como lrintf. El resultado es el
+ * entero más cercano al valor exacto para cualquier raw y offset
+ * (tools/imu_fixed_bench lo comprueba sobre todo el rango). Fuera de int16
+ * satura en vez de dar la vuelta.
+ */
+
+#define IMU_FIXED_AXES     6      /* ax, ay, az, gx, gy, gz */
+#define IMU_FIXED_RAW_LEN  14
+
+/* Fondos de escala: el valor va tal cual a AFS_SEL / FS_SEL (bits 4:3) */
+typedef enum {
+  IMU_ACCEL_FS_2G = 0,
+  IMU_ACCEL_FS_4G,
+  IMU_ACCEL_FS_8G,
+  IMU_ACCEL_FS_16G,
+} imu_accel_fs_t;
+
+typedef enum {
+  IMU_GYRO_FS_250 = 0,
+  IMU_GYRO_FS_500,
+  IMU_GYRO_FS_1000,
+  IMU_GYRO_FS_2000,
+} imu_gyro_fs_t;
+
+/* Unidades de salida */
+typedef enum {
+  IMU_ACCEL_CMS2 = 0,   /* m/s² x100 (formato compacto del packet manager) */
+  IMU_ACCEL_MG,         /* g x1000 */
+} imu_accel_unit_t;
+
+typedef enum {
+  IMU_GYRO_CDPS = 0,    /* °/s x100 (formato compacto del packet manager) */
+  IMU_GYRO_MRADS,       /* rad/s x1000 */
+} imu_gyro_unit_t;
+
+typedef struct {
+  uint8_t accel_fs;     /* imu_accel_fs_t */
+  uint8_t gyro_fs;      /* imu_gyro_fs_t */
+  uint8_t accel_unit;   /* imu_accel_unit_t */
+  uint8_t gyro_unit;    /* imu_gyro_unit_t */
+  /* Eje de salida i = signo(axis[i]) * eje del sensor |axis[i]| (1=x 2=y
+   * 3=z). Vale igual para acelerómetro y giróscopo. {0,0,0} = identidad. */
+  int8_t axis[3];
+} imu_fixed_config_t;
+
+typedef struct {
+  int32_t mul[IMU_FIXED_AXES];
+  int64_t bias[IMU_FIXED_AXES];
+  uint8_t shift[IMU_FIXED_AXES];
+  uint8_t src[IMU_FIXED_AXES];   /* byte del eje en la muestra cruda */
+} imu_fixed_t;
+
+/* LSB por unidad física (g o °/s) del fondo de escala. */
+float imu_fixed_accel_lsb(uint8_t accel_fs);
+float imu_fixed_gyro_lsb(uint8_t gyro_fs);
+
+/* Unidades de salida por LSB del sensor, en doble precisión (referencia). */
+double imu_fixed_scale(const imu_fixed_config_t *cfg, int gyro);
+
+/* Precalcula la conversión. offset: LSB en ejes del sensor (ax..gz), NULL
+ * = sin offset. Devuelve 0 o -1 si la configuración no es válida. */
+int imu_fixed_init(imu_fixed_t *fx, const imu_fixed_config_t *cfg,
+                   const int16_t offset[IMU_FIXED_AXES]);
+
+/* Cambia en caliente el offset de un eje del sensor (0..5 = ax..gz) a
+ * offset_q8 / 256 LSB, sin recalcular multiplicadores: sirve para sesgos
+ * con fracción de LSB (gyro_bias.h). Con offset entero da lo mismo que
+ * imu_fixed_init. */
+void imu_fixed_set_offset(imu_fixed_t *fx, int axis, int32_t offset_q8);
+
+/* Convierte una muestra cruda de IMU_FIXED_RAW_LEN bytes. */
+static inline void imu_fixed_convert(const imu_fixed_t *fx, const uint8_t *raw,
+                                     int16_t out[IMU_FIXED_AXES]) {
+  for (int i = 0; i < IMU_FIXED_AXES; i++) {
+    const uint8_t *b = &raw[fx->src[i]];
+    int32_t v = (int16_t)((b[0] << 8) | b[1]);
+    int64_t p = (int64_t)v * fx->mul[i] + fx->bias[i];
+    int64_t q = p >> fx->shift[i];
+    if ((p & ((1LL << fx->shift[i]) - 1)) == 0 && (q & 1)) q--;   /* .5 exacto: a par */
+    out[i] = (int16_t)(q > INT16_MAX ? INT16_MAX : q < INT16_MIN ? INT16_MIN : q);
+  }
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,90 +1,977 @@
 #include "ota.h"
+#include "ota_delta.h"
+#include "spsc_ring.h"
+#include "esp_app_desc.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "mbedtls/sha256.h"
+#include "nvs.h"
+#include "miniz.h"                /* tinfl de la ROM */
 #include <string.h>
 #include <stdbool.h>
 static const char *TAG = "BLE_OTA";
 
+#define OTA_TASK_STACK 4096
+#define OTA_TASK_PRIO  4      /* por debajo de sensores y pm_task */
+
+/* La escritora (inflate, parche y SHA-256) va en el núcleo que no usa NimBLE */
+#if CONFIG_FREERTOS_UNICORE || !defined(CONFIG_BT_NIMBLE_PINNED_TO_CORE)
+#define OTA_TASK_CORE  tskNO_AFFINITY
+#else
+#define OTA_TASK_CORE  (CONFIG_BT_NIMBLE_PINNED_TO_CORE ? 0 : 1)
+#endif
+#define OTA_OPS_LEN    32     /* potencia de 2, >= OTA_POOL_BLOCKS + control */
+
+/* Operaciones del receptor (host BLE) a la tarea escritora */
+typedef enum {
+  OTA_OP_BEGIN,
+  OTA_OP_DATA,
+  OTA_OP_END,
+  OTA_OP_ABORT,
+  OTA_OP_HASH,
+  OTA_OP_SUSPEND,       /* enlace perdido: checkpoint y cerrar el handle */
+} ota_op_type_t;
+
+typedef struct {
+  uint8_t type;
+  uint8_t v2;           /* BEGIN: sesión v2 (con ACKs) */
+  uint16_t seq;         /* DATA: seq de la trama; BEGIN: ack_every */
+  uint16_t len;
+  uint8_t flags;        /* BEGIN: OTA_V2_FLAG_* */
+  uint32_t arg;         /* BEGIN: tamaño de imagen (0 = desconocido) */
+  uint32_t id;          /* BEGIN: image_id (0 = no reanudable) */
+  uint8_t *buf;         /* DATA: bloque del pool; BEGIN: SHA-256 esperado o NULL */
+} ota_op_t;
+
+/* Pool: el receptor saca bloques de s_free y los manda por s_ops; la
+ * escritora los devuelve a s_free. Un productor y un consumidor por ring. */
+static uint8_t s_pool[OTA_POOL_BLOCKS][OTA_BLOCK_SIZE];
+static uint8_t *s_free_mem[OTA_POOL_BLOCKS];
+static ota_op_t s_ops_mem[OTA_OPS_LEN];
+static spsc_ring_t s_free;
+static spsc_ring_t s_ops;
+static TaskHandle_t s_writer;
+static ota_reply_cb_t s_reply;
+
+/* Estado del receptor (solo tarea del host BLE) */
 static bool ota_in_progress = false;
+static bool s_rx_v2;
+static bool s_rx_nacked;          /* ya se pidió reenvío del hueco actual */
+static uint16_t s_rx_next_seq;
+static uint32_t s_rx_id;
+static uint8_t *s_rx_spare;       /* bloque sacado de s_free y no enviado */
+
+/* Estado de la escritora; s_failed y el último ACK los lee el receptor */
 static const esp_partition_t *update_partition = NULL;
 static esp_ota_handle_t update_handle = 0;
 static size_t total_written = 0;
+static bool s_wr_v2;
+static uint16_t s_wr_ack_every;
+static uint16_t s_wr_unacked;
+static volatile bool s_failed;
+static volatile ota_status_t s_fail_status;
+static volatile uint16_t s_acked_seq;
+static volatile uint32_t s_acked_written;
+static size_t s_wr_image_size;
+static size_t s_wr_received;      /* bytes de datos recibidos (comprimidos o no) */
+static int64_t s_wr_t0_us;
+
+/* Descompresión al vuelo: tinfl con una ventana circular del mismo tamaño
+ * que la del compresor. Se reserva al empezar una sesión comprimida. */
+#define OTA_INFLATE_WINDOW (1u << OTA_DEFLATE_WBITS)
+
+typedef struct {
+  tinfl_decompressor inf;
+  tinfl_status status;
+  size_t pos;
+  uint8_t window[OTA_INFLATE_WINDOW];
+} ota_inflate_t;
+
+static ota_inflate_t *s_inflate;
+
+/* OTA delta: el parche (ya descomprimido) se aplica contra la partición en
+ * ejecución y la salida va a flash por flash_write. */
+static ota_delta_t *s_delta;
+static const esp_partition_t *s_wr_base;
+static ota_status_t s_wr_out_err;  /* causa del último fallo de flash_write / base_read */
+static int64_t s_wr_last_ack_us;
+
+#define OTA_KEEPALIVE_US  500000   /* COPY largos: el cliente no debe dar el ACK por perdido */
+
+/* SHA-256 incremental de la imagen según se escribe: en OTA_V2_END solo
+ * queda cerrar el hash, sin releer la partición. Se compara con el del BEGIN
+ * y/o con el del parche. */
+static mbedtls_sha256_context s_wr_sha;
+static bool s_wr_sha_on;
+static bool s_wr_has_expect;
+static uint8_t s_wr_expect[32];
+
+/* Punto de reanudación en NVS. Solo para sesiones v2 sin comprimir ni
+ * delta y con image_id: el estado de tinfl y del parche no se guarda. El
+ * offset va alineado a sector, así que al reanudar se reescribe desde el
+ * principio de un sector (esp_ota_resume borra según avanza). */
+#define OTA_NVS_NS         "ota"
+#define OTA_NVS_CKPT       "ckpt"
+#define OTA_CKPT_INTERVAL  (64 * 1024)
+#define OTA_CKPT_ALIGN     4096
+#define OTA_NO_CKPT        SIZE_MAX
+
+typedef struct {
+  uint32_t image_id;
+  uint32_t image_size;
+  uint32_t offset;          /* bytes ya en flash */
+  uint32_t part_addr;       /* partición de actualización de la sesión */
+} ota_ckpt_t;
+
+static ota_ckpt_t s_ckpt;         /* copia en RAM; la lee también el receptor */
+static bool s_ckpt_loaded;
+static portMUX_TYPE s_ckpt_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_wr_id;
+static size_t s_wr_ckpt_next = OTA_NO_CKPT;
+
+static inline void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)(v & 0xFF);
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v) {
+  put_u16(p, (uint16_t)(v & 0xFFFF));
+  put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+/* ============================
+   Respuestas v2
+   ============================ */
+
+static void reply(const uint8_t *data, size_t len) {
+  if (s_reply) s_reply(data, len);
+}
+
+static void reply_status(uint8_t type, ota_status_t st) {
+  uint8_t msg[2] = { type, (uint8_t)st };
+  reply(msg, sizeof(msg));
+}
+
+static void reply_ack(ota_status_t st, uint16_t next_seq, uint32_t written) {
+  uint8_t msg[8];
+  msg[0] = OTA_V2_ACK;
+  msg[1] = (uint8_t)st;
+  put_u16(&msg[2], next_seq);
+  put_u32(&msg[4], written);
+  reply(msg, sizeof(msg));
+}
+
+/* ============================
+   Checkpoint (NVS)
+   ============================ */
+
+/* NVS se inicializa después de ota_init(): se lee la primera vez que hace falta */
+static void ckpt_get(ota_ckpt_t *out) {
+  if (!s_ckpt_loaded) {
+    ota_ckpt_t c = { 0 };
+    size_t len = sizeof(c);
+    nvs_handle_t h;
+    if (nvs_open(OTA_NVS_NS, NVS_READONLY, &h) == ESP_OK) {
+      if (nvs_get_blob(h, OTA_NVS_CKPT, &c, &len) != ESP_OK || len != sizeof(c)) {
+        memset(&c, 0, sizeof(c));
+      }
+      nvs_close(h);
+    }
+    portENTER_CRITICAL(&s_ckpt_lock);
+    if (!s_ckpt_loaded) s_ckpt = c;
+    s_ckpt_loaded = true;
+    portEXIT_CRITICAL(&s_ckpt_lock);
+  }
+  portENTER_CRITICAL(&s_ckpt_lock);
+  *out = s_ckpt;
+  portEXIT_CRITICAL(&s_ckpt_lock);
+}
+
+/* c == NULL: sin sesión que reanudar */
+static void ckpt_put(const ota_ckpt_t *c) {
+  ota_ckpt_t v = { 0 };
+  if (c) v = *c;
+
+  portENTER_CRITICAL(&s_ckpt_lock);
+  bool same = s_ckpt_loaded && memcmp(&s_ckpt, &v, sizeof(v)) == 0;
+  s_ckpt = v;
+  s_ckpt_loaded = true;
+  portEXIT_CRITICAL(&s_ckpt_lock);
+  if (same) return;
+
+  nvs_handle_t h;
+  esp_err_t err = nvs_open(OTA_NVS_NS, NVS_READWRITE, &h);
+  if (err == ESP_OK) {
+    err = c ? nvs_set_blob(h, OTA_NVS_CKPT, &v, sizeof(v)) : nvs_erase_key(h, OTA_NVS_CKPT);
+    if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+  }
+  if (err != ESP_OK) ESP_LOGW(TAG, "Checkpoint OTA no guardado: %s", esp_err_to_name(err));
+}
+
+/* ============================
+   Tarea escritora
+   ============================ */
+
+static void session_release(void) {
+  if (s_inflate) {
+    heap_caps_free(s_inflate);
+    s_inflate = NULL;
+  }
+  if (s_delta) {
+    heap_caps_free(s_delta);
+    s_delta = NULL;
+  }
+  if (s_wr_sha_on) {
+    mbedtls_sha256_free(&s_wr_sha);
+    s_wr_sha_on = false;
+  }
+}
+
+static void writer_fail(ota_status_t st) {
+  session_release();
+  if (update_handle) {
+    esp_ota_abort(update_handle);
+    update_handle = 0;
+  }
+  s_fail_status = st;
+  s_failed = true;
+}
+
+/* Guarda hasta dónde está la imagen en flash (alineado a sector) */
+static void writer_checkpoint(void) {
+  ota_ckpt_t c = {
+    .image_id = s_wr_id,
+    .image_size = (uint32_t)s_wr_image_size,
+    .offset = (uint32_t)(total_written & ~(size_t)(OTA_CKPT_ALIGN - 1)),
+    .part_addr = update_partition->address,
+  };
+  ckpt_put(&c);
+  s_wr_ckpt_next = total_written + OTA_CKPT_INTERVAL;
+}
+
+/* Destino final de los datos: flash, con el tamaño anunciado como tope */
+static int flash_write(void *ctx, const uint8_t *data, size_t len) {
+  if (s_wr_image_size && total_written + len > s_wr_image_size) {
+    s_wr_out_err = OTA_ST_TOO_LARGE;
+    return -1;
+  }
+  esp_err_t err = esp_ota_write(update_handle, data, len);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error escribiendo bloque OTA: %s", esp_err_to_name(err));
+    s_wr_out_err = OTA_ST_FLASH_ERROR;
+    return -1;
+  }
+  if (s_wr_sha_on) mbedtls_sha256_update(&s_wr_sha, data, len);
+  total_written += len;
+  if (total_written >= s_wr_ckpt_next) writer_checkpoint();
+
+  /* Un COPY puede escribir cientos de KB sin consumir tramas: se repite
+   * el último ACK para que el cliente no lo dé por perdido */
+  int64_t now = esp_timer_get_time();
+  if (s_wr_v2 && now - s_wr_last_ack_us > OTA_KEEPALIVE_US) {
+    s_wr_last_ack_us = now;
+    reply_ack(OTA_ST_OK, s_acked_seq, s_acked_written);
+  }
+  return 0;
+}
+
+static int base_read(void *ctx, uint32_t off, uint8_t *dst, size_t len) {
+  if (esp_partition_read(s_wr_base, off, dst, len) != ESP_OK) {
+    s_wr_out_err = OTA_ST_FLASH_ERROR;
+    return -1;
+  }
+  return 0;
+}
+
+/* Añade a ctx los primeros len bytes de part, releídos de flash */
+static esp_err_t partition_hash_update(mbedtls_sha256_context *ctx,
+                                       const esp_partition_t *part, size_t len) {
+  uint8_t buf[256];
+  for (size_t off = 0; off < len; ) {
+    size_t n = (len - off > sizeof(buf)) ? sizeof(buf) : len - off;
+    esp_err_t err = esp_partition_read(part, off, buf, n);
+    if (err != ESP_OK) return err;
+    mbedtls_sha256_update(ctx, buf, n);
+    off += n;
+  }
+  return ESP_OK;
+}
+
+/* Datos ya descomprimidos: al parche o directos a flash */
+static ota_status_t writer_out(const uint8_t *data, size_t len) {
+  if (!s_delta) return flash_write(NULL, data, len) == 0 ? OTA_ST_OK : s_wr_out_err;
+
+  switch (ota_delta_feed(s_delta, data, len)) {
+    case OTA_DELTA_OK:
+      return OTA_ST_OK;
+    case OTA_DELTA_ERR_BASE:
+      ESP_LOGE(TAG, "El parche no corresponde a la imagen en ejecución.");
+      return OTA_ST_BAD_BASE;
+    case OTA_DELTA_ERR_IO:
+      return s_wr_out_err;
+    default:
+      ESP_LOGE(TAG, "Parche inválido.");
+      return OTA_ST_BAD_STREAM;
+  }
+}
+
+static void writer_begin(const ota_op_t *op) {
+  ota_status_t st = OTA_ST_OK;
+
+  if (update_handle) {                 /* sesión anterior sin cerrar */
+    esp_ota_abort(update_handle);
+    update_handle = 0;
+  }
+  session_release();
+  total_written = 0;
+  s_wr_received = 0;
+  s_wr_id = op->id;
+  s_wr_ckpt_next = OTA_NO_CKPT;
+  s_wr_image_size = op->arg;
+  s_wr_t0_us = esp_timer_get_time();
+  s_failed = false;
+  s_wr_v2 = op->v2;
+  s_wr_ack_every = op->seq ? op->seq : OTA_V2_ACK_EVERY;
+  s_wr_unacked = 0;
+  s_acked_seq = 0;
+  s_acked_written = 0;
+  s_wr_has_expect = op->buf != NULL;
+  if (op->buf) {
+    memcpy(s_wr_expect, op->buf, sizeof(s_wr_expect));
+    spsc_ring_push(&s_free, &op->buf, 1);
+  }
+
+  /* ¿Reanudación de una sesión interrumpida? */
+  ota_ckpt_t ckpt;
+  size_t resume_at = 0;
+  bool resumable = s_wr_v2 && op->id && op->arg &&
+                   !(op->flags & (OTA_V2_FLAG_DEFLATE | OTA_V2_FLAG_DELTA));
+  ckpt_get(&ckpt);
+
+  update_partition = esp_ota_get_next_update_partition(NULL);
+  if (resumable && update_partition && ckpt.image_id == op->id &&
+      ckpt.image_size == op->arg && ckpt.part_addr == update_partition->address &&
+      ckpt.offset < op->arg) {
+    resume_at = ckpt.offset;
+  } else if (ckpt.image_id) {
+    ckpt_put(NULL);                      /* esp_ota_begin va a borrar la partición */
+  }
+
+  if (!update_partition) {
+    ESP_LOGE(TAG, "No se encontró partición OTA válida.");
+    st = OTA_ST_NO_PARTITION;
+  } else if (op->arg > update_partition->size) {
+    ESP_LOGE(TAG, "Imagen de %lu bytes no cabe en '%s'.",
+             (unsigned long)op->arg, update_partition->label);
+    st = OTA_ST_TOO_LARGE;
+  } else if ((op->flags & OTA_V2_FLAG_DEFLATE) && op->arg == 0) {
+    ESP_LOGE(TAG, "OTA comprimida sin tamaño de imagen.");
+    st = OTA_ST_BAD_FRAME;
+  } else if ((op->flags & OTA_V2_FLAG_DEFLATE) &&
+             !(s_inflate = heap_caps_malloc(sizeof(*s_inflate),
+                                            MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT))) {
+    ESP_LOGE(TAG, "Sin memoria para descomprimir.");
+    st = OTA_ST_NO_MEM;
+  } else if ((op->flags & OTA_V2_FLAG_DELTA) &&
+             (op->arg == 0 || !(s_wr_base = esp_ota_get_running_partition()))) {
+    ESP_LOGE(TAG, "OTA delta sin tamaño de imagen o sin partición base.");
+    st = OTA_ST_BAD_FRAME;
+  } else if ((op->flags & OTA_V2_FLAG_DELTA) &&
+             !(s_delta = heap_caps_malloc(sizeof(*s_delta),
+                                          MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT))) {
+    ESP_LOGE(TAG, "Sin memoria para el parche.");
+    st = OTA_ST_NO_MEM;
+  } else if (resume_at) {
+    if (esp_ota_resume(update_partition, OTA_WITH_SEQUENTIAL_WRITES, resume_at,
+                       &update_handle) != ESP_OK) {
+      ESP_LOGE(TAG, "Error reanudando OTA.");
+      update_handle = 0;
+      ckpt_put(NULL);
+      st = OTA_ST_FLASH_ERROR;
+    } else {
+      total_written = resume_at;
+    }
+  } else if (esp_ota_begin(update_partition, op->arg ? op->arg : OTA_SIZE_UNKNOWN,
+                           &update_handle) != ESP_OK) {
+    /* con tamaño conocido solo se borra lo necesario */
+    ESP_LOGE(TAG, "Error iniciando OTA.");
+    update_handle = 0;
+    st = OTA_ST_FLASH_ERROR;
+  }
+
+  if (st == OTA_ST_OK && s_inflate) {
+    tinfl_init(&s_inflate->inf);
+    s_inflate->status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    s_inflate->pos = 0;
+  }
+  if (st == OTA_ST_OK && s_delta) {
+    ota_delta_init(s_delta, esp_app_get_description()->app_elf_sha256, s_wr_base->size,
+                   base_read, flash_write, NULL);
+  }
+  if (st == OTA_ST_OK && (s_wr_has_expect || s_delta)) {
+    mbedtls_sha256_init(&s_wr_sha);
+    mbedtls_sha256_starts(&s_wr_sha, 0);
+    s_wr_sha_on = true;
+    /* al reanudar, lo que ya estaba en flash entra en el hash releído */
+    if (resume_at && partition_hash_update(&s_wr_sha, update_partition, resume_at) != ESP_OK) {
+      ESP_LOGE(TAG, "Error releyendo la imagen a reanudar.");
+      st = OTA_ST_FLASH_ERROR;
+    }
+  }
+
+  if (st != OTA_ST_OK) {
+    writer_fail(st);
+  } else {
+    if (resumable) s_wr_ckpt_next = total_written + OTA_CKPT_INTERVAL;
+    ESP_LOGI(TAG, "OTA %s en partición '%s'%s%s%s (desde %u).",
+             resume_at ? "reanudada" : "iniciada", update_partition->label,
+             s_inflate ? " (comprimida)" : "", s_delta ? " (delta)" : "",
+             s_wr_has_expect ? " (con SHA-256)" : "", (unsigned)total_written);
+  }
+
+  if (s_wr_v2) {
+    uint8_t msg[OTA_V2_BEGIN_RSP_LEN];
+    msg[0] = OTA_V2_BEGIN_RSP;
+    msg[1] = (uint8_t)st;
+    put_u16(&msg[2], OTA_V2_MAX_DATA);
+    msg[4] = OTA_POOL_BLOCKS;
+    msg[5] = (s_inflate ? OTA_V2_FLAG_DEFLATE : 0) | (s_delta ? OTA_V2_FLAG_DELTA : 0);
+    put_u32(&msg[6], (st == OTA_ST_OK) ? (uint32_t)total_written : 0);
+    reply(msg, sizeof(msg));
+  }
+}
+
+/* Descomprime un bloque y pasa lo que salga a writer_out. tinfl no escribe
+ * más allá del final de la ventana: cada salida es un tramo contiguo. */
+static ota_status_t writer_inflate(const uint8_t *in, size_t len) {
+  ota_inflate_t *z = s_inflate;
+
+  for (;;) {
+    if (z->status == TINFL_STATUS_DONE) {
+      return len ? OTA_ST_BAD_STREAM : OTA_ST_OK;   /* basura tras el final */
+    }
+    size_t in_n = len;
+    size_t out_n = OTA_INFLATE_WINDOW - z->pos;
+    z->status = tinfl_decompress(&z->inf, in, &in_n, z->window, z->window + z->pos, &out_n,
+                                 TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+    if (z->status < 0) {
+      ESP_LOGE(TAG, "Flujo comprimido inválido (%d).", (int)z->status);
+      return OTA_ST_BAD_STREAM;
+    }
+    if (out_n) {
+      ota_status_t st = writer_out(z->window + z->pos, out_n);
+      if (st != OTA_ST_OK) return st;
+      z->pos = (z->pos + out_n) & (OTA_INFLATE_WINDOW - 1);
+    }
+    in += in_n;
+    len -= in_n;
+    /* NEEDS_MORE_INPUT: consumido todo el bloque; HAS_MORE_OUTPUT: ventana
+     * llena, se sigue desde el principio */
+    if (z->status == TINFL_STATUS_NEEDS_MORE_INPUT) return OTA_ST_OK;
+  }
+}
+
+static void writer_data(const ota_op_t *op) {
+  if (!s_failed && update_handle) {
+    s_wr_received += op->len;
+    ota_status_t st = s_inflate ? writer_inflate(op->buf, op->len)
+                                : writer_out(op->buf, op->len);
+    if (st != OTA_ST_OK) writer_fail(st);
+  }
+  spsc_ring_push(&s_free, &op->buf, 1);
+
+  if (!s_wr_v2) return;
+  s_acked_seq = (uint16_t)(op->seq + 1);
+  s_acked_written = (uint32_t)total_written;
+  /* ACK cada ack_every tramas, y al vaciarse la cola para no dejar la
+   * cola de la ventana sin confirmar */
+  if (++s_wr_unacked >= s_wr_ack_every || s_failed || spsc_ring_count(&s_ops) == 0) {
+    s_wr_unacked = 0;
+    s_wr_last_ack_us = esp_timer_get_time();
+    reply_ack(s_failed ? s_fail_status : OTA_ST_OK, s_acked_seq, s_acked_written);
+  }
+}
+
+static void writer_end(void) {
+  ota_status_t st = s_failed ? s_fail_status : OTA_ST_OK;
+
+  if (st == OTA_ST_OK && !update_handle) st = OTA_ST_NO_SESSION;
+  if (st == OTA_ST_OK && s_inflate &&
+      (s_inflate->status != TINFL_STATUS_DONE || total_written != s_wr_image_size)) {
+    ESP_LOGE(TAG, "Flujo comprimido incompleto (%u de %u bytes).",
+             (unsigned)total_written, (unsigned)s_wr_image_size);
+    st = OTA_ST_BAD_STREAM;
+  }
+  if (st == OTA_ST_OK && s_delta &&
+      (!ota_delta_idle(s_delta) || total_written != s_wr_image_size)) {
+    ESP_LOGE(TAG, "Parche incompleto (%u de %u bytes).",
+             (unsigned)total_written, (unsigned)s_wr_image_size);
+    st = OTA_ST_BAD_STREAM;
+  }
+
+  /* El hash se ha ido calculando al escribir: aquí solo se cierra y se
+   * compara, antes de esp_ota_end y de tocar la partición de arranque */
+  if (st == OTA_ST_OK && s_wr_sha_on) {
+    uint8_t got[32];
+    int64_t t0 = esp_timer_get_time();
+    mbedtls_sha256_finish(&s_wr_sha, got);
+    bool ok = (!s_wr_has_expect || memcmp(got, s_wr_expect, sizeof(got)) == 0) &&
+              (!s_delta || memcmp(got, ota_delta_target_sha256(s_delta), sizeof(got)) == 0);
+    if (!ok) {
+      ESP_LOGE(TAG, "La imagen escrita no coincide con su SHA-256.");
+      st = OTA_ST_BAD_IMAGE;
+    } else {
+      ESP_LOGI(TAG, "SHA-256 verificado en %lu us.",
+               (unsigned long)(esp_timer_get_time() - t0));
+    }
+  }
+
+  if (s_wr_id) ckpt_put(NULL);           /* con o sin éxito, no se reanuda */
+  s_wr_ckpt_next = OTA_NO_CKPT;
+  session_release();
+
+  if (st == OTA_ST_OK) {
+    esp_err_t err = esp_ota_end(update_handle);
+    update_handle = 0;
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Error finalizando OTA: %s", esp_err_to_name(err));
+      st = OTA_ST_FLASH_ERROR;
+    } else if (esp_ota_set_boot_partition(update_partition) != ESP_OK) {
+      ESP_LOGE(TAG, "Error activando nueva partición.");
+      st = OTA_ST_FLASH_ERROR;
+    }
+  } else {
+    writer_fail(st);
+  }
+
+  if (s_wr_v2) reply_status(OTA_V2_END_RSP, st);
+  if (st != OTA_ST_OK) {
+    ESP_LOGE(TAG, "OTA rechazada (estado %d).", st);
+    return;
+  }
+
+  ESP_LOGI(TAG, "OTA completada: %u bytes recibidos, %u escritos, %lu ms. Reiniciando...",
+           (unsigned)s_wr_received, (unsigned)total_written,
+           (unsigned long)((esp_timer_get_time() - s_wr_t0_us) / 1000));
+  vTaskDelay(pdMS_TO_TICKS(1000));
+  esp_restart();
+}
+
+esp_err_t ota_partition_sha256(size_t len, uint8_t out[32]) {
+  const esp_partition_t *part = update_partition;
+  if (!part) part = esp_ota_get_next_update_partition(NULL);
+  if (!part || len > part->size) return ESP_ERR_INVALID_ARG;
+
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+  esp_err_t err = partition_hash_update(&ctx, part, len);
+  mbedtls_sha256_finish(&ctx, out);
+  mbedtls_sha256_free(&ctx);
+  return err;
+}
+
+/* Relee de flash lo escrito hasta ahora (va en cola detrás de los datos) */
+static void writer_hash(void) {
+  uint8_t msg[OTA_V2_HASH_RSP_LEN];
+  ota_status_t st = s_failed ? s_fail_status : OTA_ST_OK;
+
+  memset(msg, 0, sizeof(msg));
+  if (st == OTA_ST_OK && ota_partition_sha256(total_written, &msg[6]) != ESP_OK) {
+    st = OTA_ST_FLASH_ERROR;
+  }
+  msg[0] = OTA_V2_HASH_RSP;
+  msg[1] = (uint8_t)st;
+  put_u32(&msg[2], (uint32_t)total_written);
+  reply(msg, sizeof(msg));
+}
+
+static void ota_writer_task(void *arg) {
+  for (;;) {
+    ota_op_t op;
+    if (spsc_ring_pop(&s_ops, &op, 1) == 0) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+
+    switch (op.type) {
+      case OTA_OP_BEGIN:
+        writer_begin(&op);
+        break;
+      case OTA_OP_DATA:
+        writer_data(&op);
+        break;
+      case OTA_OP_END:
+        writer_end();
+        break;
+      case OTA_OP_SUSPEND:
+        /* Se guarda dónde seguir; si no es reanudable es un ABORT */
+        if (update_handle && !s_failed && s_wr_ckpt_next != OTA_NO_CKPT) {
+          writer_checkpoint();
+          session_release();
+          esp_ota_abort(update_handle);    /* libera el handle, no borra */
+          update_handle = 0;
+          s_wr_ckpt_next = OTA_NO_CKPT;
+          ESP_LOGW(TAG, "OTA suspendida: se puede reanudar desde %lu.",
+                   (unsigned long)s_ckpt.offset);
+          break;
+        }
+        /* fallthrough */
+      case OTA_OP_ABORT:
+        session_release();
+        if (update_handle) {
+          esp_ota_abort(update_handle);
+          update_handle = 0;
+        }
+        if (s_wr_id) ckpt_put(NULL);
+        s_wr_ckpt_next = OTA_NO_CKPT;
+        ESP_LOGW(TAG, "OTA abortada (%u bytes escritos).", (unsigned)total_written);
+        break;
+      case OTA_OP_HASH:
+        writer_hash();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/* ============================
+   Receptor (tarea del host BLE)
+   ============================ */
+
+static bool post_op(const ota_op_t *op) {
+  if (spsc_ring_push(&s_ops, op, 1) != 1) return false;
+  xTaskNotifyGive(s_writer);
+  return true;
+}
+
+/* sha: bloque del pool con el SHA-256 esperado (lo devuelve la escritora) */
+static void rx_begin(bool v2, uint32_t image_size, uint8_t ack_every, uint8_t flags,
+                     uint32_t image_id, uint8_t *sha) {
+  ota_op_t op = {
+    .type = OTA_OP_BEGIN, .v2 = v2, .seq = ack_every, .flags = flags, .arg = image_size,
+    .id = image_id, .buf = sha,
+  };
+  s_failed = false;
+  if (!post_op(&op)) {
+    ESP_LOGE(TAG, "Cola OTA llena.");
+    if (sha) s_rx_spare = sha;
+    if (v2) reply_status(OTA_V2_BEGIN_RSP, OTA_ST_OVERFLOW);
+    return;
+  }
+  ota_in_progress = true;
+  s_rx_v2 = v2;
+  s_rx_id = image_id;
+  s_rx_nacked = false;
+  s_rx_next_seq = 0;
+}
+
+static void rx_end(void) {
+  ota_op_t op = { .type = OTA_OP_END };
+  ota_in_progress = false;
+  if (!post_op(&op)) {
+    ESP_LOGE(TAG, "Cola OTA llena.");
+    if (s_rx_v2) reply_status(OTA_V2_END_RSP, OTA_ST_OVERFLOW);
+  }
+}
+
+static void rx_abort(void) {
+  ota_op_t op = { .type = OTA_OP_ABORT };
+  ota_in_progress = false;
+  post_op(&op);
+}
+
+static void rx_suspend(void) {
+  ota_op_t op = { .type = OTA_OP_SUSPEND };
+  ota_in_progress = false;
+  post_op(&op);
+}
+
+static int flat_copy(const void *src, size_t off, size_t len, uint8_t *dst) {
+  memcpy(dst, (const uint8_t *)src + off, len);
+  return 0;
+}
+
+/* Copia [off, off + len) del origen a un bloque del pool (una sola pasada,
+ * sin buffer intermedio) y lo pasa a la escritora */
+static ota_status_t rx_data(uint16_t seq, const void *src, size_t off, size_t len,
+                            ota_copy_fn copy) {
+  if (len > OTA_BLOCK_SIZE) return OTA_ST_BAD_FRAME;
+
+  /* s_free solo lo rellena la escritora: un bloque que no llega a salir se
+   * guarda para la siguiente trama en vez de devolverlo al ring */
+  uint8_t *buf = s_rx_spare;
+  s_rx_spare = NULL;
+  if (!buf && spsc_ring_pop(&s_free, &buf, 1) == 0) return OTA_ST_OVERFLOW;
+
+  if (copy(src, off, len, buf) != 0) {
+    s_rx_spare = buf;
+    return OTA_ST_BAD_FRAME;
+  }
+  ota_op_t op = { .type = OTA_OP_DATA, .seq = seq, .len = (uint16_t)len, .buf = buf };
+  if (!post_op(&op)) {
+    s_rx_spare = buf;
+    return OTA_ST_OVERFLOW;
+  }
+  return OTA_ST_OK;
+}
+
+/* Los comandos v1 se comparan con los primeros bytes copiados en head */
+static bool is_cmd(const uint8_t *head, size_t len, const char *cmd) {
+  return len == strlen(cmd) && memcmp(head, cmd, len) == 0;
+}
+
+esp_err_t ota_init(void) {
+  if (s_writer) return ESP_OK;
+
+  if (!spsc_ring_init(&s_free, s_free_mem, OTA_POOL_BLOCKS, sizeof(uint8_t *)) ||
+      !spsc_ring_init(&s_ops, s_ops_mem, OTA_OPS_LEN, sizeof(ota_op_t))) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  for (int i = 0; i < OTA_POOL_BLOCKS; i++) {
+    uint8_t *buf = s_pool[i];
+    spsc_ring_push(&s_free, &buf, 1);
+  }
 
-void ota_init(void) {
   ota_in_progress = false;
   total_written = 0;
   update_partition = NULL;
+
+  if (xTaskCreatePinnedToCore(ota_writer_task, "ota_writer", OTA_TASK_STACK, NULL,
+                              OTA_TASK_PRIO, &s_writer, OTA_TASK_CORE) != pdPASS) {
+    s_writer = NULL;
+    return ESP_ERR_NO_MEM;
+  }
   ESP_LOGI(TAG, "OTA BLE inicializada.");
+  return ESP_OK;
+}
+
+void ota_set_reply_cb(ota_reply_cb_t cb) {
+  s_reply = cb;
 }
 
 bool ota_is_in_progress(void) {
   return ota_in_progress;
 }
 
+void ota_link_lost(void) {
+  if (!s_writer || !ota_in_progress) return;
+  ESP_LOGW(TAG, "Cliente OTA desconectado a mitad de sesión.");
+  rx_suspend();
+}
+
+size_t ota_pool_free(void) {
+  return s_writer ? spsc_ring_count(&s_free) + (s_rx_spare ? 1 : 0) : 0;
+}
+
+esp_err_t ota_wait_idle(uint32_t timeout_ms, size_t *written) {
+  TickType_t waited = 0;
+  while (spsc_ring_count(&s_ops) != 0 || ota_pool_free() != OTA_POOL_BLOCKS) {
+    if (waited++ * portTICK_PERIOD_MS >= timeout_ms) return ESP_ERR_TIMEOUT;
+    vTaskDelay(1);
+  }
+  if (written) *written = total_written;
+  return s_failed ? ESP_FAIL : ESP_OK;
+}
+
 void ota_process_chunk(const uint8_t *data, size_t len) {
-  if (len == 0 || data == NULL) return;
+  ota_process_chunk_from(data, len, flat_copy);
+}
+
+void ota_process_frame(const uint8_t *data, size_t len) {
+  ota_process_frame_from(data, len, flat_copy);
+}
+
+void ota_process_chunk_from(const void *src, size_t len, ota_copy_fn copy) {
+  if (len == 0 || src == NULL) return;
+  if (!s_writer) {
+    ESP_LOGE(TAG, "ota_init() no llamado.");
+    return;
+  }
+
+  /* Los comandos son cortos: basta con mirar los primeros bytes */
+  uint8_t head[16];
+  size_t head_len = (len < sizeof(head)) ? len : sizeof(head);
+  if (copy(src, 0, head_len, head) != 0) return;
 
   // Detectar comandos de control
-  if (strncmp((const char *)data, "OTA_BEGIN", len) == 0) {
+  if (is_cmd(head, len, "OTA_BEGIN")) {
     if (ota_in_progress) {
       ESP_LOGW(TAG, "Ya hay una OTA en curso.");
       return;
     }
-
-    update_partition = esp_ota_get_next_update_partition(NULL);
-    if (!update_partition) {
-      ESP_LOGE(TAG, "No se encontró partición OTA válida.");
-      return;
-    }
-
-    if (esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle) != ESP_OK) {
-      ESP_LOGE(TAG, "Error iniciando OTA.");
-      return;
-    }
-
-    ota_in_progress = true;
-    total_written = 0;
-    ESP_LOGI(TAG, "OTA iniciada en partición '%s'.", update_partition->label);
+    rx_begin(false, 0, 0, 0, 0, NULL);
     return;
   }
 
-  if (strncmp((const char *)data, "OTA_END", len) == 0) {
+  if (is_cmd(head, len, "OTA_END")) {
     if (!ota_in_progress) {
       ESP_LOGW(TAG, "No hay OTA activa para finalizar.");
       return;
     }
-
-    if (esp_ota_end(update_handle) != ESP_OK) {
-      ESP_LOGE(TAG, "Error finalizando OTA.");
-      return;
-    }
-
-    if (esp_ota_set_boot_partition(update_partition) != ESP_OK) {
-      ESP_LOGE(TAG, "Error activando nueva partición.");
-      return;
-    }
-
-    ESP_LOGI(TAG, "OTA completada (%d bytes). Reiniciando...", total_written);
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    esp_restart();
+    rx_end();
     return;
   }
 
-  // Si estamos en modo OTA, escribir los datos binarios
+  // Si estamos en modo OTA, pasar los datos a la tarea escritora
   if (ota_in_progress) {
-    esp_err_t err = esp_ota_write(update_handle, data, len);
-    if (err != ESP_OK) {
-      ESP_LOGE(TAG, "Error escribiendo bloque OTA: %s", esp_err_to_name(err));
-    } else {
-      total_written += len;
+    for (size_t off = 0; off < len; ) {
+      size_t n = (len - off > OTA_BLOCK_SIZE) ? OTA_BLOCK_SIZE : len - off;
+      if (rx_data(s_rx_next_seq++, src, off, n, copy) != OTA_ST_OK) {
+        /* v1 no tiene reenvío: la imagen ya no sirve */
+        ESP_LOGE(TAG, "Pool OTA lleno, se descarta la sesión.");
+        rx_abort();
+        return;
+      }
+      off += n;
     }
     return;
   }
 
   // Si no estamos en OTA y no es comando, ignorar
-  ESP_LOGI(TAG, "Dato recibido fuera de sesión OTA (%d bytes)", len);
+  ESP_LOGI(TAG, "Dato recibido fuera de sesión OTA (%u bytes)", (unsigned)len);
 }
 
+void ota_process_frame_from(const void *src, size_t len, ota_copy_fn copy) {
+  if (len == 0 || src == NULL) return;
+  if (!s_writer) {
+    ESP_LOGE(TAG, "ota_init() no llamado.");
+    return;
+  }
+
+  /* Cabecera a la pila; los datos van directos al bloque del pool */
+  uint8_t data[11];                 /* el más largo: OTA_V2_BEGIN con image_id */
+  if (copy(src, 0, (len < sizeof(data)) ? len : sizeof(data), data) != 0) return;
+
+  switch (data[0]) {
+    case OTA_V2_BEGIN: {
+      if (len < 6) {
+        reply_status(OTA_V2_BEGIN_RSP, OTA_ST_BAD_FRAME);
+        break;
+      }
+      uint32_t size = get_u32(&data[1]);
+      uint32_t id = 0;
+      if (len >= 11) id = get_u32(&data[7]);
+      if (ota_in_progress) {
+        /* el mismo cliente vuelve a empezar la misma imagen (p.ej. tras un
+         * timeout): se suspende la sesión y se reanuda desde el checkpoint */
+        if (!(s_rx_v2 && id && id == s_rx_id)) {
+          reply_status(OTA_V2_BEGIN_RSP, OTA_ST_BUSY);
+          break;
+        }
+        rx_suspend();
+      }
+      /* El SHA-256 va al pool como un bloque de datos más: la pila del host
+       * BLE no lo guarda hasta que la escritora empiece la sesión */
+      uint8_t *sha = NULL;
+      if (len >= OTA_V2_BEGIN_SHA_LEN) {
+        sha = s_rx_spare;
+        s_rx_spare = NULL;
+        if (!sha && spsc_ring_pop(&s_free, &sha, 1) == 0) {
+          reply_status(OTA_V2_BEGIN_RSP, OTA_ST_OVERFLOW);
+          break;
+        }
+        if (copy(src, OTA_V2_BEGIN_SHA_LEN - 32, 32, sha) != 0) {
+          s_rx_spare = sha;
+          reply_status(OTA_V2_BEGIN_RSP, OTA_ST_BAD_FRAME);
+          break;
+        }
+      }
+      rx_begin(true, size, data[5], (len > 6) ? data[6] : 0, id, sha);
+      break;
+    }
+
+    case OTA_V2_DATA: {
+      if (!ota_in_progress || !s_rx_v2) {
+        reply_ack(OTA_ST_NO_SESSION, 0, 0);
+        break;
+      }
+      if (s_failed) {
+        /* la escritora ya falló: se corta la sesión */
+        reply_ack(s_fail_status, s_acked_seq, s_acked_written);
+        rx_abort();
+        break;
+      }
+      if (len < OTA_V2_DATA_HDR || len - OTA_V2_DATA_HDR > OTA_V2_MAX_DATA) {
+        reply_ack(OTA_ST_BAD_FRAME, s_rx_next_seq, s_acked_written);
+        break;
+      }
+
+      uint16_t seq = (uint16_t)(data[1] | (data[2] << 8));
+      int16_t ahead = (int16_t)(seq - s_rx_next_seq);
+      if (ahead < 0) {
+        /* repetida (reenvío del cliente): ya está en cola o escrita */
+        reply_ack(OTA_ST_OK, s_acked_seq, s_acked_written);
+        break;
+      }
+      if (ahead > 0) {
+        if (!s_rx_nacked) reply_ack(OTA_ST_BAD_SEQ, s_rx_next_seq, s_acked_written);
+        s_rx_nacked = true;
+        break;
+      }
+
+      ota_status_t st = rx_data(seq, src, OTA_V2_DATA_HDR, len - OTA_V2_DATA_HDR, copy);
+      if (st != OTA_ST_OK) {
+        /* se pierde esta trama: el cliente reenvía desde next_seq */
+        reply_ack(st, s_rx_next_seq, s_acked_written);
+        s_rx_nacked = true;
+        break;
+      }
+      s_rx_next_seq++;
+      s_rx_nacked = false;
+      break;
+    }
+
+    case OTA_V2_END:
+      if (!ota_in_progress || !s_rx_v2) {
+        reply_status(OTA_V2_END_RSP, OTA_ST_NO_SESSION);
+        break;
+      }
+      rx_end();
+      break;
+
+    case OTA_V2_ABORT:
+      if (ota_in_progress) rx_abort();
+      break;
+
+    case OTA_V2_INFO: {
+      ota_ckpt_t c;
+      ckpt_get(&c);
+      uint8_t msg[OTA_V2_INFO_RSP_LEN] = { OTA_V2_INFO_RSP, OTA_ST_OK, OTA_V2_FLAGS };
+      memcpy(&msg[3], esp_app_get_description()->app_elf_sha256, 32);
+      put_u32(&msg[35], c.image_id);
+      put_u32(&msg[39], c.offset);
+      reply(msg, sizeof(msg));
+      break;
+    }
+
+    case OTA_V2_HASH: {
+      ota_op_t op = { .type = OTA_OP_HASH };
+      if (!ota_in_progress || !s_rx_v2) {
+        uint8_t msg[OTA_V2_HASH_RSP_LEN] = { OTA_V2_HASH_RSP, OTA_ST_NO_SESSION };
+        reply(msg, sizeof(msg));
+      } else if (!post_op(&op)) {
+        uint8_t msg[OTA_V2_HASH_RSP_LEN] = { OTA_V2_HASH_RSP, OTA_ST_OVERFLOW };
+        reply(msg, sizeof(msg));
+      }
+      break;
+    }
+
+    default:
+      ESP_LOGW(TAG, "Trama OTA desconocida 0x%02X (%u bytes)", data[0], (unsigned)len);
+      break;
+  }
+}
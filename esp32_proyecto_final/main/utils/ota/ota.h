@@ -5,23 +5,192 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+
+/**
+ * OTA por BLE.
+ *
+ * v1 (característica de escritura, write with response): comandos de texto
+ * "OTA_BEGIN" / "OTA_END" y entre medias los bytes de la imagen tal cual.
+ *
+ * v2 (característica OTA, write without response + notificaciones): tramas
+ * binarias con número de secuencia. byte0 = tipo, enteros LE.
+ *   Cliente -> ESP32:
+ *     OTA_V2_BEGIN  u32 image_size, u8 ack_every,
+ *                   [u8 flags, [u32 image_id, [sha256[32] de la imagen final]]]
+ *     OTA_V2_DATA   u16 seq, datos (hasta OTA_V2_MAX_DATA bytes)
+ *     OTA_V2_END
+ *     OTA_V2_ABORT
+ *     OTA_V2_HASH   (SHA-256 de lo escrito hasta ahora, releído de flash)
+ *     OTA_V2_INFO
+ *   ESP32 -> cliente:
+ *     OTA_V2_BEGIN_RSP  u8 status, u16 max_data, u8 window, u8 flags,
+ *                       u32 offset (primer byte de la imagen a mandar)
+ *     OTA_V2_ACK        u8 status, u16 next_seq, u32 written
+ *     OTA_V2_END_RSP    u8 status
+ *     OTA_V2_HASH_RSP   u8 status, u32 written, sha256[32] (MTU >= 41)
+ *     OTA_V2_INFO_RSP   u8 status, u8 flags soportados, app_elf_sha256[32]
+ *                       de la imagen en ejecución (base de los parches),
+ *                       u32 image_id y u32 offset del checkpoint (0 = ninguno)
+ *                       (MTU >= 46)
+ *
+ * Las tramas se copian a un pool acotado de OTA_POOL_BLOCKS bloques y una
+ * tarea aparte las escribe en flash: el host BLE nunca espera al borrado ni
+ * a la escritura. La tarea escritora confirma (ACK) cada ack_every tramas
+ * escritas y cuando se queda sin trabajo; next_seq es la primera trama aún
+ * no escrita. El cliente puede tener hasta window tramas sin confirmar.
+ *
+ * Un hueco en seq se contesta una vez con OTA_ST_BAD_SEQ y next_seq = la
+ * trama esperada (reenviar desde ahí); las repetidas se ignoran y se
+ * contestan con el último ACK (sirven de sondeo si se perdió uno).
+ *
+ * Con OTA_V2_FLAG_DEFLATE los datos son un flujo zlib con ventana de
+ * 2^OTA_DEFLATE_WBITS bytes (tools/ota_pack) que la tarea escritora
+ * descomprime al vuelo; image_size es entonces el tamaño descomprimido y
+ * seq/ACK cuentan tramas comprimidas. BEGIN_RSP devuelve los flags
+ * aceptados (un firmware sin compresión no los devuelve).
+ *
+ * Con OTA_V2_FLAG_DELTA los datos (descomprimidos si además va
+ * OTA_V2_FLAG_DEFLATE) son un parche de ota_delta.h contra la imagen en
+ * ejecución; la imagen resultante se compara con el SHA-256 del parche antes
+ * de cambiar la partición de arranque (igual que el del BEGIN, abajo).
+ *
+ * Reanudación: una sesión sin compresión ni delta y con image_id != 0
+ * guarda en NVS cada 64 KB (y al perder el enlace) hasta dónde está escrita,
+ * alineado a sector. Un OTA_V2_BEGIN posterior con el mismo image_id y
+ * tamaño continúa desde ahí, también tras un reinicio: BEGIN_RSP.offset dice
+ * desde qué byte mandar (con seq desde 0). OTA_V2_ABORT, OTA_V2_END o una
+ * imagen distinta descartan el checkpoint. Si se pierde el enlace la sesión
+ * se suspende sola (ota_link_lost) y el siguiente BEGIN no da OTA_ST_BUSY.
+ *
+ * Con sha256 en el BEGIN (MTU >= 46) la tarea escritora calcula el SHA-256
+ * de la imagen según la escribe, en el núcleo que no usa NimBLE, y en
+ * OTA_V2_END lo compara antes de esp_ota_end: si no coincide contesta
+ * OTA_ST_BAD_IMAGE y la partición de arranque no cambia. Al reanudar, la
+ * parte ya escrita se relee una vez para el hash.
+ *
+ * Las funciones *_from leen el fragmento con una función de copia (p.ej.
+ * os_mbuf_copydata sobre la cadena de mbufs de NimBLE): los datos van
+ * directos del origen al bloque del pool, sea cual sea el MTU.
+ */
+
+#define OTA_POOL_BLOCKS   16
+#define OTA_BLOCK_SIZE    512    /* SDU L2CAP / MTU grande */
+#define OTA_V2_DATA_HDR   3      /* tipo + seq */
+#define OTA_V2_MAX_DATA   (OTA_BLOCK_SIZE - OTA_V2_DATA_HDR)
+#define OTA_V2_ACK_EVERY  8      /* si el cliente manda 0 */
+
+/* Flags de OTA_V2_BEGIN */
+#define OTA_V2_FLAG_DEFLATE  0x01
+#define OTA_V2_FLAG_DELTA    0x02
+#define OTA_V2_FLAGS         (OTA_V2_FLAG_DEFLATE | OTA_V2_FLAG_DELTA)
+#define OTA_DEFLATE_WBITS    12     /* ventana de 4 KB: cabe en RAM interna */
+
+typedef enum {
+  OTA_V2_BEGIN      = 0x01,
+  OTA_V2_DATA       = 0x02,
+  OTA_V2_END        = 0x03,
+  OTA_V2_ABORT      = 0x04,
+  OTA_V2_HASH       = 0x05,
+  OTA_V2_INFO       = 0x06,
+  OTA_V2_BEGIN_RSP  = 0x81,
+  OTA_V2_ACK        = 0x82,
+  OTA_V2_END_RSP    = 0x84,
+  OTA_V2_HASH_RSP   = 0x85,
+  OTA_V2_INFO_RSP   = 0x86,
+} ota_v2_type_t;
+
+#define OTA_V2_BEGIN_SHA_LEN (1 + 4 + 1 + 1 + 4 + 32)   /* BEGIN con sha256 */
+#define OTA_V2_BEGIN_RSP_LEN (2 + 2 + 1 + 1 + 4)
+#define OTA_V2_HASH_RSP_LEN  (2 + 4 + 32)
+#define OTA_V2_INFO_RSP_LEN  (2 + 1 + 32 + 4 + 4)
+
+typedef enum {
+  OTA_ST_OK = 0,
+  OTA_ST_BUSY,          /* ya hay una sesión abierta */
+  OTA_ST_NO_SESSION,    /* trama sin OTA_V2_BEGIN previo */
+  OTA_ST_BAD_SEQ,       /* hueco: reenviar desde next_seq */
+  OTA_ST_BAD_FRAME,     /* trama corta o demasiado larga */
+  OTA_ST_NO_PARTITION,
+  OTA_ST_FLASH_ERROR,   /* esp_ota_begin / write / end */
+  OTA_ST_TOO_LARGE,     /* la imagen no cabe en la partición */
+  OTA_ST_OVERFLOW,      /* pool lleno: más tramas en vuelo que window */
+  OTA_ST_BAD_STREAM,    /* flujo comprimido corrupto o incompleto */
+  OTA_ST_NO_MEM,
+  OTA_ST_BAD_BASE,      /* parche generado contra otra imagen */
+  OTA_ST_BAD_IMAGE,     /* la imagen escrita no coincide con su hash */
+} ota_status_t;
+
 /**
- * @brief Inicializa el módulo OTA (si fuera necesario).
+ * @brief Envía una respuesta v2 al cliente (notificación en la
+ *        característica OTA). Se llama desde la tarea del host BLE o desde
+ *        la tarea escritora.
  */
-void ota_init(void);
+typedef void (*ota_reply_cb_t)(const uint8_t *data, size_t len);
 
 /**
- * @brief Procesa un comando o fragmento recibido vía BLE.
- * 
+ * @brief Copia len bytes del origen desde off a dst. 0 = ok.
+ */
+typedef int (*ota_copy_fn)(const void *src, size_t off, size_t len, uint8_t *dst);
+
+/**
+ * @brief Inicializa el módulo OTA: pool de bloques y tarea escritora.
+ */
+esp_err_t ota_init(void);
+
+/**
+ * @brief Registra por dónde salen las respuestas v2.
+ */
+void ota_set_reply_cb(ota_reply_cb_t cb);
+
+/**
+ * @brief Procesa un comando o fragmento recibido vía BLE (v1).
+ *
  * @param data Puntero al buffer recibido.
  * @param len Longitud del buffer.
  */
 void ota_process_chunk(const uint8_t *data, size_t len);
 
+/**
+ * @brief Procesa una trama v2. Solo desde una tarea (la del host BLE):
+ *        es el único productor del pool.
+ */
+void ota_process_frame(const uint8_t *data, size_t len);
+
+/**
+ * @brief Como ota_process_chunk / ota_process_frame, leyendo de src con copy.
+ */
+void ota_process_chunk_from(const void *src, size_t len, ota_copy_fn copy);
+void ota_process_frame_from(const void *src, size_t len, ota_copy_fn copy);
+
 /**
  * @brief Retorna si la OTA está en curso.
  */
 bool ota_is_in_progress(void);
 
-#endif // OTA_H
+/**
+ * @brief El cliente de la sesión OTA se ha desconectado: la sesión se
+ *        suspende (reanudable si tiene image_id) o se aborta. Desde la tarea
+ *        del host BLE, como ota_process_*.
+ */
+void ota_link_lost(void);
+
+/**
+ * @brief Bloques libres del pool (aproximado fuera del receptor).
+ */
+size_t ota_pool_free(void);
+
+/**
+ * @brief Espera a que la tarea escritora vacíe la cola y devuelva todos los
+ *        bloques. written = bytes escritos en la sesión.
+ *
+ * @return ESP_OK, ESP_ERR_TIMEOUT o ESP_FAIL si la escritura falló.
+ */
+esp_err_t ota_wait_idle(uint32_t timeout_ms, size_t *written);
 
+/**
+ * @brief SHA-256 de los primeros len bytes de la partición de actualización
+ *        (releídos de flash).
+ */
+esp_err_t ota_partition_sha256(size_t len, uint8_t out[32]);
+
+#endif // OTA_H
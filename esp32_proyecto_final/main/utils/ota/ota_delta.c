@@ -0,0 +1,132 @@
+#include "ota_delta.h"
+
+#include <string.h>
+
+static uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static size_t op_args_len(uint8_t op) {
+  switch (op) {
+    case OTA_DELTA_OP_COPY:
+    case OTA_DELTA_OP_ADD:  return 8;
+    case OTA_DELTA_OP_DATA: return 4;
+    default:                return 0;
+  }
+}
+
+void ota_delta_init(ota_delta_t *d, const uint8_t base_sha[32], uint32_t base_size,
+                    ota_delta_read_fn read, ota_delta_write_fn write, void *ctx) {
+  memset(d, 0, sizeof(*d));
+  memcpy(d->base_sha, base_sha, sizeof(d->base_sha));
+  d->base_size = base_size;
+  d->read = read;
+  d->write = write;
+  d->ctx = ctx;
+}
+
+static int in_base(const ota_delta_t *d, uint32_t src, uint32_t len) {
+  return src <= d->base_size && len <= d->base_size - src;
+}
+
+/* COPY se ejecuta entero en cuanto llega su cabecera */
+static ota_delta_err_t do_copy(ota_delta_t *d, uint32_t src, uint32_t len) {
+  if (!in_base(d, src, len)) return OTA_DELTA_ERR_RANGE;
+  while (len > 0) {
+    size_t n = (len > sizeof(d->scratch)) ? sizeof(d->scratch) : len;
+    if (d->read(d->ctx, src, d->scratch, n) != 0) return OTA_DELTA_ERR_IO;
+    if (d->write(d->ctx, d->scratch, n) != 0) return OTA_DELTA_ERR_IO;
+    src += (uint32_t)n;
+    len -= (uint32_t)n;
+  }
+  return OTA_DELTA_OK;
+}
+
+/* Cabecera de op completa: valida y deja el cuerpo pendiente */
+static ota_delta_err_t start_op(ota_delta_t *d) {
+  uint8_t op = d->op[0];
+  d->op_len = 0;
+
+  if (op == OTA_DELTA_OP_COPY) {
+    return do_copy(d, get_u32(&d->op[1]), get_u32(&d->op[5]));
+  }
+  if (op == OTA_DELTA_OP_ADD) {
+    d->src = get_u32(&d->op[1]);
+    d->remaining = get_u32(&d->op[5]);
+    if (!in_base(d, d->src, d->remaining)) return OTA_DELTA_ERR_RANGE;
+  } else {
+    d->remaining = get_u32(&d->op[1]);
+  }
+  /* el cuerpo se identifica por op[0], que se conserva */
+  d->op[0] = op;
+  return OTA_DELTA_OK;
+}
+
+ota_delta_err_t ota_delta_feed(ota_delta_t *d, const uint8_t *in, size_t len) {
+  while (len > 0) {
+    /* Cabecera del parche */
+    if (d->hdr_len < OTA_DELTA_HDR_LEN) {
+      size_t n = OTA_DELTA_HDR_LEN - d->hdr_len;
+      if (n > len) n = len;
+      memcpy(&d->hdr[d->hdr_len], in, n);
+      d->hdr_len += n;
+      in += n;
+      len -= n;
+      if (d->hdr_len == OTA_DELTA_HDR_LEN) {
+        if (memcmp(d->hdr, OTA_DELTA_MAGIC, 4) != 0 || d->hdr[4] != OTA_DELTA_VERSION) {
+          return OTA_DELTA_ERR_FORMAT;
+        }
+        if (memcmp(&d->hdr[OTA_DELTA_SHA_BASE], d->base_sha, 32) != 0) {
+          return OTA_DELTA_ERR_BASE;
+        }
+      }
+      continue;
+    }
+
+    /* Cuerpo de ADD / DATA */
+    if (d->remaining > 0) {
+      size_t n = (len > d->remaining) ? d->remaining : len;
+      if (n > sizeof(d->scratch)) n = sizeof(d->scratch);
+      if (d->op[0] == OTA_DELTA_OP_ADD) {
+        if (d->read(d->ctx, d->src, d->scratch, n) != 0) return OTA_DELTA_ERR_IO;
+        for (size_t i = 0; i < n; i++) d->scratch[i] = (uint8_t)(d->scratch[i] + in[i]);
+        if (d->write(d->ctx, d->scratch, n) != 0) return OTA_DELTA_ERR_IO;
+        d->src += (uint32_t)n;
+      } else if (d->write(d->ctx, in, n) != 0) {
+        return OTA_DELTA_ERR_IO;
+      }
+      d->remaining -= (uint32_t)n;
+      in += n;
+      len -= n;
+      continue;
+    }
+
+    /* Cabecera de la siguiente op */
+    if (d->op_len == 0) {
+      if (op_args_len(*in) == 0) return OTA_DELTA_ERR_FORMAT;
+      d->op[d->op_len++] = *in++;
+      len--;
+      continue;
+    }
+    size_t want = 1 + op_args_len(d->op[0]) - d->op_len;
+    size_t n = (want > len) ? len : want;
+    memcpy(&d->op[d->op_len], in, n);
+    d->op_len += n;
+    in += n;
+    len -= n;
+    if (n == want) {
+      ota_delta_err_t err = start_op(d);
+      if (err != OTA_DELTA_OK) return err;
+    }
+  }
+  return OTA_DELTA_OK;
+}
+
+int ota_delta_idle(const ota_delta_t *d) {
+  return d->hdr_len == OTA_DELTA_HDR_LEN && d->op_len == 0 && d->remaining == 0;
+}
+
+const uint8_t *ota_delta_target_sha256(const ota_delta_t *d) {
+  return (d->hdr_len == OTA_DELTA_HDR_LEN) ? &d->hdr[OTA_DELTA_SHA_NEW] : NULL;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Parches binarios para OTA delta (OTA_V2_FLAG_DELTA).
+ *
+ * No depende de ESP-IDF: se compila igual en el host (tools/ota_delta).
+ *
+ * La imagen nueva se reconstruye en streaming a partir de la imagen en
+ * ejecución (base), sin tenerla entera en RAM:
+ *  cabecera: "OTAD", u8 versión, 3 reservados, sha256 de la base
+ *            (app_elf_sha256 del descriptor de la app), sha256 de la imagen
+ *            nueva completa
+ *  ops (enteros LE):
+ *    COPY  u32 src, u32 len             nueva = base[src .. src+len)
+ *    ADD   u32 src, u32 len, len bytes  nueva[i] = base[src+i] + diff[i]
+ *    DATA  u32 len, len bytes           literal
+ *
+ * ADD es el truco de bsdiff: entre dos compilaciones casi todo el código
+ * coincide salvo direcciones desplazadas, así que diff es casi todo ceros
+ * y se comprime muy bien si el parche va además con OTA_V2_FLAG_DEFLATE.
+ */
+
+#define OTA_DELTA_MAGIC     "OTAD"
+#define OTA_DELTA_VERSION   1
+#define OTA_DELTA_HDR_LEN   (4 + 4 + 32 + 32)
+#define OTA_DELTA_SHA_BASE  8
+#define OTA_DELTA_SHA_NEW   (8 + 32)
+#define OTA_DELTA_SCRATCH   256
+
+typedef enum {
+  OTA_DELTA_OP_COPY = 0x01,
+  OTA_DELTA_OP_ADD  = 0x02,
+  OTA_DELTA_OP_DATA = 0x03,
+} ota_delta_op_t;
+
+typedef enum {
+  OTA_DELTA_OK         = 0,
+  OTA_DELTA_ERR_FORMAT = -1,   /* cabecera u op desconocida */
+  OTA_DELTA_ERR_BASE   = -2,   /* el parche es para otra imagen base */
+  OTA_DELTA_ERR_RANGE  = -3,   /* lectura fuera de la base */
+  OTA_DELTA_ERR_IO     = -4,   /* falló read o write */
+} ota_delta_err_t;
+
+/* Leen de la base / escriben la imagen nueva. 0 = ok. */
+typedef int (*ota_delta_read_fn)(void *ctx, uint32_t off, uint8_t *dst, size_t len);
+typedef int (*ota_delta_write_fn)(void *ctx, const uint8_t *src, size_t len);
+
+typedef struct {
+  ota_delta_read_fn read;
+  ota_delta_write_fn write;
+  void *ctx;
+  uint32_t base_size;
+  uint8_t base_sha[32];
+  uint8_t hdr[OTA_DELTA_HDR_LEN];
+  size_t hdr_len;
+  uint8_t op[9];                    /* op + argumentos en curso */
+  size_t op_len;
+  uint32_t src;                     /* ADD: siguiente byte de la base */
+  uint32_t remaining;               /* ADD/DATA: bytes del cuerpo por llegar */
+  uint8_t scratch[OTA_DELTA_SCRATCH];
+} ota_delta_t;
+
+/* Prepara el aplicador. base_sha: hash que debe traer la cabecera. */
+void ota_delta_init(ota_delta_t *d, const uint8_t base_sha[32], uint32_t base_size,
+                    ota_delta_read_fn read, ota_delta_write_fn write, void *ctx);
+
+/* Procesa un fragmento del parche (de cualquier tamaño). */
+ota_delta_err_t ota_delta_feed(ota_delta_t *d, const uint8_t *in, size_t len);
+
+/* true si no hay una op a medias (el parche puede terminar aquí). */
+int ota_delta_idle(const ota_delta_t *d);
+
+/* sha256 de la imagen nueva según la cabecera, o NULL si aún no llegó. */
+const uint8_t *ota_delta_target_sha256(const ota_delta_t *d);
+
+#ifdef __cplusplus
+}
+#endif
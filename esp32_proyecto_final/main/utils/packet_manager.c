@@ -1,72 +1,177 @@
 #include "packet_manager.h"
-#include "network/bluetooth.h"   // tu bluetooth.c / bluetooth.h con send_notification_binary(...)
+#include "imu_codec.h"
+#include "spsc_ring.h"
+#include "network/bluetooth.h"   // bluetooth_notify_mbuf_alloc / send_notification_mbuf
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include <string.h>
 
 static const char *TAG = "PACKET_MGR";
 
-/* Queues & task */
+/* Rings (potencia de 2) & task */
 #define PM_PULSE_Q_LEN 64
-#define PM_IMU_COMPACT_Q_LEN 32
+#define PM_IMU_COMPACT_Q_LEN 128   /* 1 kHz: ~20 muestras por ciclo de 20 ms + ráfagas del MPU */
 #define PM_TASK_STACK 4096
 #define PM_TASK_PRIO 5
+#define PM_STATS_PERIOD_MS 10000
+#define PM_EPOCH_PERIOD_MS 10000   /* reenvío periódico de la epoch absoluta */
+#define PM_OFFLINE_WAIT_MS 1000    /* sin suscriptores: despertar para stats */
+
+/* Un paquete nunca supera una notificación con el MTU preferido; acota las
+ * tablas de lote de pm_send_batch (el paquete va directo a un mbuf) */
+#ifdef CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU
+#define PM_MAX_PACKET_LEN (CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU - 3)
+#else
+#define PM_MAX_PACKET_LEN 244
+#endif
+
+/* Cota con el mejor caso del modo delta (1 byte por eje + 1 de dt) */
+#define PM_MAX_IMU_BATCH \
+  ((PM_MAX_PACKET_LEN - PM_HEADER_LEN) / (IMU_CODEC_MIN_DELTA_LEN + 1))
+#define PM_MAX_PULSE_BATCH 8
 
 typedef struct {
   uint16_t value;
   uint32_t ts32;
 } pm_pulse_item_t;
 
-typedef struct {
-  int16_t ax;
-  int16_t ay;
-  int16_t az;
-  int16_t gx;
-  int16_t gy;
-  int16_t gz;
-  uint64_t ts;
-} pm_imu_compact_t;
-
-static QueueHandle_t s_pulse_q = NULL;
-static QueueHandle_t s_imu_compact_q = NULL;
+typedef pm_imu_sample_t pm_imu_compact_t;
+
+/* Un productor por ring: la tarea del sensor (real o simulador) que esté
+ * activa; el único consumidor es pm_task. */
+static spsc_ring_t s_pulse_q;
+static spsc_ring_t s_imu_compact_q;
+static pm_pulse_item_t s_pulse_buf[PM_PULSE_Q_LEN];
+static pm_imu_compact_t s_imu_buf[PM_IMU_COMPACT_Q_LEN];
+static bool s_rings_ready = false;
 static TaskHandle_t s_task = NULL;
 
-/* Helper: build compact packet into out buffer */
-int packet_manager_build_compact(uint8_t *out, uint8_t max_len,
-                                 uint8_t flags, uint64_t timestamp,
-                                 const int16_t *imu_flat, uint8_t imu_count,
-                                 const uint16_t *pulses, uint8_t pulse_count)
+/* false mientras nadie esté suscrito a las notificaciones: pm_task no
+ * construye nada y los pm_feed_* descartan sin tocar los rings */
+static volatile bool s_transmit = false;
+
+static volatile bool s_batch_mode = true;
+static volatile bool s_imu_delta = true;
+static pm_stats_t s_stats = {0};
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Número de secuencia del siguiente paquete (solo lo toca pm_task) */
+static uint8_t s_seq = 0;
+
+/* Base de tiempos del enlace (solo la toca pm_task) */
+static uint32_t s_epoch_ms = 0;
+static bool s_epoch_valid = false;
+static volatile bool s_epoch_request = false;
+
+static inline void stats_add(uint32_t *counter, uint32_t n) {
+  if (n == 0) return;
+  portENTER_CRITICAL(&s_stats_lock);
+  *counter += n;
+  portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* Destino de la serialización: buffer plano o mbuf de NimBLE. En el mbuf se
+ * escribe en su sitio (os_mbuf_extend), sin buffer intermedio. */
+typedef struct {
+  uint8_t *buf;          /* destino plano (om == NULL) */
+  struct os_mbuf *om;    /* destino mbuf */
+  uint16_t len;
+  uint16_t max_len;
+} pm_writer_t;
+
+/* Reserva n bytes contiguos al final del paquete (NULL si no caben) */
+static uint8_t *pm_reserve(pm_writer_t *w, uint16_t n) {
+  if (n > w->max_len - w->len) return NULL;
+  uint8_t *p = w->om ? (uint8_t *)os_mbuf_extend(w->om, n) : w->buf + w->len;
+  if (p) w->len += n;
+  return p;
+}
+
+static inline bool pm_put_u16(pm_writer_t *w, uint16_t v) {
+  uint8_t *p = pm_reserve(w, 2);
+  if (!p) return false;
+  p[0] = (uint8_t)(v & 0xFF);
+  p[1] = (uint8_t)(v >> 8);
+  return true;
+}
+
+static int pm_serialize(pm_writer_t *w,
+                        uint8_t flags, uint8_t seq,
+                        uint32_t epoch_ms, uint16_t ts_delta,
+                        const int16_t *imu_flat, const uint16_t *imu_dt,
+                        uint8_t imu_count,
+                        const uint16_t *pulses, const uint16_t *pulse_dt,
+                        uint8_t pulse_count)
 {
-  int needed = 1 + 8 + 1 + 1; // flags + timestamp(8) + countImu + countPulse
-  needed += imu_count * 12;   // 6 * int16
-  needed += pulse_count * 2;  // 2 bytes per pulse
+  bool with_dt = (flags & PM_FLAG_SAMPLE_DT) != 0;
+  bool imu_delta = (flags & PM_FLAG_IMU_DELTA) != 0;
+  int dt_len = with_dt ? PM_SAMPLE_DT_LEN : 0;
 
-  if (needed > max_len) {
-    ESP_LOGE(TAG, "Packet too large: need %d / buffer %d", needed, max_len);
+  int pulse_bytes = pulse_count * (PM_PULSE_SAMPLE_LEN + dt_len); // [dt] + uint16
+
+  int needed = PM_HEADER_LEN; // flags + seq + tsDelta(2) + countImu + countPulse
+  if (flags & PM_FLAG_EPOCH) needed += PM_EPOCH_LEN;
+  needed += pulse_bytes;
+  if (!imu_delta) {
+    needed += imu_count * (PM_IMU_SAMPLE_LEN + dt_len);   // [dt] + 6 * int16
+  }
+
+  if (needed > w->max_len) {
+    ESP_LOGE(TAG, "Packet too large: need %d / buffer %u", needed, w->max_len);
     return -1;
   }
 
-  int offset = 0;
+  uint8_t *hdr = pm_reserve(w, (flags & PM_FLAG_EPOCH) ? PM_HEADER_LEN + PM_EPOCH_LEN
+                                                        : PM_HEADER_LEN);
+  if (!hdr) return -1;
 
-  out[offset++] = flags;
+  *hdr++ = flags;
+  *hdr++ = seq;
 
-  /* timestamp little-endian (uint64) */
-  memcpy(out + offset, &timestamp, 8);
-  offset += 8;
+  /* epoch absoluta (uint32 LE, ms de dispositivo) solo en paquetes epoch */
+  if (flags & PM_FLAG_EPOCH) {
+    memcpy(hdr, &epoch_ms, 4);
+    hdr += 4;
+  }
 
-  out[offset++] = imu_count;
-  out[offset++] = pulse_count;
+  /* delta respecto a la epoch (uint16 LE) */
+  memcpy(hdr, &ts_delta, 2);
+  hdr += 2;
 
+  *hdr++ = imu_count;
+  *hdr++ = pulse_count;
+
+  /* IMU comprimido: primera muestra cruda + deltas zig-zag varint */
+  if (imu_delta && imu_flat != NULL && imu_count > 0) {
+    imu_codec_state_t st;
+    imu_codec_reset(&st, with_dt);
+    for (int i = 0; i < imu_count; i++) {
+      const int16_t *p = &imu_flat[6 * i];
+      uint16_t dt = imu_dt ? imu_dt[i] : 0;
+      int n = imu_codec_sample_len(&st, p, dt);
+      uint8_t *dst = (n <= w->max_len - w->len - pulse_bytes) ? pm_reserve(w, (uint16_t)n) : NULL;
+      if (!dst || imu_codec_put(&st, dst, n, p, dt) != n) {
+        ESP_LOGE(TAG, "Packet too large: delta IMU block overflows %u bytes", w->max_len);
+        return -1;
+      }
+    }
+  }
   /* IMU flattened array: [ax0,ay0,az0,gx0,gy0,gz0, ax1,...] as int16 */
-  if (imu_flat != NULL && imu_count > 0) {
+  else if (imu_flat != NULL && imu_count > 0) {
     /* each sample 6 * int16 = 12 bytes */
     const int16_t *p = imu_flat;
     for (int i = 0; i < imu_count; i++) {
+      uint8_t *dst = pm_reserve(w, dt_len + PM_IMU_SAMPLE_LEN);
+      if (!dst) return -1;
+      if (with_dt) {
+        uint16_t dt = imu_dt ? imu_dt[i] : 0;
+        memcpy(dst, &dt, 2);
+        dst += 2;
+      }
       /* copy 6 int16 (little-endian memory copy is fine) */
-      memcpy(out + offset, p, 12);
-      offset += 12;
+      memcpy(dst, p, PM_IMU_SAMPLE_LEN);
       p += 6;
     }
   }
@@ -74,117 +179,364 @@ int packet_manager_build_compact(uint8_t *out, uint8_t max_len,
   /* pulses */
   if (pulses != NULL && pulse_count > 0) {
     for (int i = 0; i < pulse_count; i++) {
-      uint16_t v = pulses[i];
-      memcpy(out + offset, &v, 2);
-      offset += 2;
+      if (with_dt && !pm_put_u16(w, pulse_dt ? pulse_dt[i] : 0)) return -1;
+      if (!pm_put_u16(w, pulses[i])) return -1;
     }
   }
 
-  return offset;
+  return w->len;
+}
+
+/* Helper: build compact packet into out buffer */
+int packet_manager_build_compact(uint8_t *out, uint16_t max_len,
+                                 uint8_t flags, uint8_t seq,
+                                 uint32_t epoch_ms, uint16_t ts_delta,
+                                 const int16_t *imu_flat, const uint16_t *imu_dt,
+                                 uint8_t imu_count,
+                                 const uint16_t *pulses, const uint16_t *pulse_dt,
+                                 uint8_t pulse_count)
+{
+  pm_writer_t w = { .buf = out, .om = NULL, .len = 0, .max_len = max_len };
+  return pm_serialize(&w, flags, seq, epoch_ms, ts_delta,
+                      imu_flat, imu_dt, imu_count, pulses, pulse_dt, pulse_count);
 }
 
-/* Send via bluetooth using your NimBLE helper */
-void packet_manager_send_compact(uint8_t flags, uint64_t timestamp,
-                                 const int16_t *imu_flat, uint8_t imu_count,
-                                 const uint16_t *pulses, uint8_t pulse_count)
+/* Send via bluetooth: se serializa directamente en un mbuf del pool msys
+ * del tamaño del MTU actual y NimBLE lo notifica tal cual. */
+esp_err_t packet_manager_send_compact(uint8_t flags, uint32_t epoch_ms, uint16_t ts_delta,
+                                      const int16_t *imu_flat, const uint16_t *imu_dt,
+                                      uint8_t imu_count,
+                                      const uint16_t *pulses, const uint16_t *pulse_dt,
+                                      uint8_t pulse_count)
 {
-  uint8_t buffer[128];
-  int len = packet_manager_build_compact(buffer, sizeof(buffer),
-                                         flags, timestamp,
-                                         imu_flat, imu_count,
-                                         pulses, pulse_count);
+  uint16_t max_len = 0;
+  struct os_mbuf *om = bluetooth_notify_mbuf_alloc(&max_len);
+  if (!om) {
+    stats_add(&s_stats.notify_errors, 1);   // pool msys agotado
+    return ESP_ERR_NO_MEM;
+  }
+
+  pm_writer_t w = { .buf = NULL, .om = om, .len = 0, .max_len = max_len };
+  int len = pm_serialize(&w, flags, s_seq, epoch_ms, ts_delta,
+                         imu_flat, imu_dt, imu_count,
+                         pulses, pulse_dt, pulse_count);
   if (len < 0) {
     ESP_LOGE(TAG, "Failed to build packet");
-    return;
+    os_mbuf_free_chain(om);
+    stats_add(&s_stats.build_errors, 1);
+    return ESP_FAIL;
   }
 
-  /* send with your bluetooth wrapper (nimble) */
-  send_notification_binary(buffer, (uint16_t)len);
+  /* el seq avanza por paquete construido: un hueco en el receptor = pérdida */
+  s_seq++;
+
+  /* NimBLE se queda con el mbuf (también si falla) */
+  esp_err_t err = send_notification_mbuf(om);
+  if (err == ESP_ERR_INVALID_STATE) {
+    stats_add(&s_stats.packets_skipped, 1);   // nadie suscrito
+    return err;
+  }
+  if (err != ESP_OK) {
+    stats_add(&s_stats.notify_errors, 1);
+    return err;
+  }
+
+  stats_add(&s_stats.packets_sent, 1);
   ESP_LOGD(TAG, "packet_manager_send_compact: sent %d bytes (flags=0x%02x imu=%u pulse=%u)",
            len, flags, imu_count, pulse_count);
+  return ESP_OK;
 }
 
 /* ============================
    Task that consumes queues and sends packets
    ============================ */
 
-static inline uint64_t now_ms64(void) {
-  return (uint64_t)(esp_timer_get_time() / 1000ULL);
+static inline uint32_t now_ms32(void) {
+  return (uint32_t)(esp_timer_get_time() / 1000ULL);
+}
+
+/* Diferencia en ms entre ticks de 32 bits (tolera el wrap), saturada a uint16 */
+static inline uint16_t dt_ms(uint32_t ts, uint32_t base) {
+  int32_t dt = (int32_t)(ts - base);
+  if (dt < 0) return 0;
+  return (dt > 0xFFFF) ? 0xFFFF : (uint16_t)dt;
+}
+
+/* ¿Toca mandar una epoch absoluta? (primera vez, petición o periodo) */
+static bool pm_epoch_due(uint32_t now) {
+  if (s_epoch_request) {
+    s_epoch_request = false;
+    s_epoch_valid = false;
+  }
+  return !s_epoch_valid || dt_ms(now, s_epoch_ms) >= PM_EPOCH_PERIOD_MS;
+}
+
+/* Fija la epoch si hace falta y devuelve el delta del paquete respecto a ella */
+static uint16_t pm_timebase(uint32_t base, bool new_epoch) {
+  if (new_epoch) {
+    s_epoch_ms = base;
+    s_epoch_valid = true;
+    return 0;
+  }
+  return dt_ms(base, s_epoch_ms);
+}
+
+/* Payload útil de una notificación con el MTU actual (sin pasar de las tablas) */
+static uint16_t pm_packet_capacity(void) {
+  uint16_t cap = bluetooth_get_att_mtu() - 3;
+  return (cap > PM_MAX_PACKET_LEN) ? PM_MAX_PACKET_LEN : cap;
+}
+
+/* Modo lote: vacía las colas hasta llenar un paquete del tamaño del MTU.
+ * Lo que no cabe se queda encolado para el siguiente ciclo. */
+static void pm_send_batch(void) {
+  static int16_t imu_flat[6 * PM_MAX_IMU_BATCH];
+  static uint16_t imu_dt[PM_MAX_IMU_BATCH];
+  static uint16_t pulses[PM_MAX_PULSE_BATCH];
+  static uint16_t pulse_dt[PM_MAX_PULSE_BATCH];
+  static uint32_t pulse_ts[PM_MAX_PULSE_BATCH];
+
+  const int imu_len = PM_SAMPLE_DT_LEN + PM_IMU_SAMPLE_LEN;
+  const int pulse_len = PM_SAMPLE_DT_LEN + PM_PULSE_SAMPLE_LEN;
+
+  // 0) Back-pressure: con paquetes esperando crédito o el pool msys al
+  //    límite no se construye nada. Las muestras siguen en los rings y el
+  //    siguiente paquete sale más lleno.
+  if (!bluetooth_notify_ready()) {
+    stats_add(&s_stats.tx_deferred, 1);
+    return;
+  }
+
+  // La epoch solo se decide una vez por paquete; si toca, reserva sus 4 bytes
+  bool new_epoch = pm_epoch_due(now_ms32());
+  int room = (int)pm_packet_capacity() - PM_HEADER_LEN - (new_epoch ? PM_EPOCH_LEN : 0);
+
+  uint8_t imu_count = 0;
+  uint8_t pulse_count = 0;
+
+  // 1) Pulsos primero: son pocos y no queremos que la IMU los deje fuera
+  pm_pulse_item_t ptmp;
+  while (pulse_count < PM_MAX_PULSE_BATCH && room >= pulse_len &&
+         spsc_ring_pop(&s_pulse_q, &ptmp, 1) == 1) {
+    pulses[pulse_count] = ptmp.value;
+    pulse_ts[pulse_count] = ptmp.ts32;
+    pulse_count++;
+    room -= pulse_len;
+  }
+
+  // 2) Rellenar con IMU hasta agotar el MTU. Se leen las muestras en su
+  //    sitio dentro del ring y solo se liberan las que caben (en modo
+  //    delta el tamaño de cada una depende de la anterior).
+  bool delta = s_imu_delta;
+  imu_codec_state_t cst;
+  imu_codec_reset(&cst, true);
+
+  uint32_t base = pulse_count ? pulse_ts[0] : 0;
+
+  spsc_span_t span[2];
+  spsc_ring_read_spans(&s_imu_compact_q, span);
+
+  for (int sp = 0; sp < 2; sp++) {
+    const pm_imu_compact_t *it = (const pm_imu_compact_t *)span[sp].ptr;
+    size_t k = 0;
+
+    for (; k < span[sp].count && imu_count < PM_MAX_IMU_BATCH; k++) {
+      int16_t *p = &imu_flat[6 * imu_count];
+      p[0] = it[k].ax; p[1] = it[k].ay; p[2] = it[k].az;
+      p[3] = it[k].gx; p[4] = it[k].gy; p[5] = it[k].gz;
+
+      // 3) Timestamp base = muestra más antigua (los rings son FIFO)
+      if (imu_count == 0 && (pulse_count == 0 || (int32_t)(it[k].ts32 - base) < 0)) {
+        base = it[k].ts32;
+      }
+      uint16_t dt = dt_ms(it[k].ts32, base);
+
+      int len = imu_len;
+      if (delta) {
+        uint8_t scratch[IMU_CODEC_MAX_DELTA_LEN + IMU_CODEC_RAW_LEN];
+        len = imu_codec_put(&cst, scratch, sizeof(scratch), p, dt);
+      }
+      if (len < 0 || len > room) break;
+
+      imu_dt[imu_count] = dt;
+      imu_count++;
+      room -= len;
+    }
+
+    if (k < span[sp].count) break;   // paquete lleno
+  }
+
+  spsc_ring_commit_read(&s_imu_compact_q, imu_count);
+
+  if (imu_count == 0 && pulse_count == 0) return;
+
+  for (int i = 0; i < pulse_count; i++) pulse_dt[i] = dt_ms(pulse_ts[i], base);
+
+  uint16_t ts_delta = pm_timebase(base, new_epoch);
+
+  uint8_t flags = PM_FLAG_SAMPLE_DT;
+  if (new_epoch)   flags |= PM_FLAG_EPOCH;
+  if (imu_count && delta) flags |= PM_FLAG_IMU_DELTA;
+  if (imu_count)   flags |= PM_FLAG_IMU;
+  if (pulse_count) flags |= PM_FLAG_PULSE;
+
+  esp_err_t err = packet_manager_send_compact(flags, s_epoch_ms, ts_delta,
+                                              (imu_count ? imu_flat : NULL), imu_dt, imu_count,
+                                              (pulse_count ? pulses : NULL), pulse_dt, pulse_count);
+
+  if (err == ESP_OK) {
+    stats_add(&s_stats.imu_delivered, imu_count);
+    stats_add(&s_stats.pulse_delivered, pulse_count);
+  } else {
+    stats_add(&s_stats.imu_dropped, imu_count);
+    stats_add(&s_stats.pulse_dropped, pulse_count);
+  }
+}
+
+/* Modo antiguo: solo la última muestra de cada tipo */
+static void pm_send_latest(void) {
+  static pm_imu_compact_t lastImu = {0};
+  static pm_pulse_item_t lastPulse = {0};
+
+  static bool hasImu = false;
+  static bool hasPulse = false;
+
+  uint32_t imu_new = 0;
+  uint32_t pulse_new = 0;
+
+  // Sin créditos se salta el ciclo; la última muestra sale en el siguiente
+  if (!bluetooth_notify_ready()) {
+    stats_add(&s_stats.tx_deferred, 1);
+    return;
+  }
+
+  // 1) Consumir TODAS las IMUs disponibles
+  pm_imu_compact_t imutmp;
+  while (spsc_ring_pop(&s_imu_compact_q, &imutmp, 1) == 1) {
+    lastImu = imutmp;
+    hasImu = true;
+    imu_new++;
+  }
+
+  // 2) Consumir TODOS los pulsos disponibles
+  pm_pulse_item_t ptmp;
+  while (spsc_ring_pop(&s_pulse_q, &ptmp, 1) == 1) {
+    lastPulse = ptmp;
+    hasPulse = true;
+    pulse_new++;
+  }
+
+  // 3) Elegir timestamp
+  uint32_t now = now_ms32();
+  uint32_t ts = 0;
+  if (hasImu) ts = lastImu.ts32;
+  else if (hasPulse) ts = lastPulse.ts32;
+  else ts = now; // fallback
+
+  bool new_epoch = pm_epoch_due(now);
+  uint16_t ts_delta = pm_timebase(ts, new_epoch);
+
+  // 4) Construir paquete
+  int16_t imu_flat[6];
+  uint16_t pulses[1];
+
+  uint8_t imu_count = 0;
+  uint8_t pulse_count = 0;
+
+  if (hasImu) {
+    imu_flat[0] = lastImu.ax;
+    imu_flat[1] = lastImu.ay;
+    imu_flat[2] = lastImu.az;
+    imu_flat[3] = lastImu.gx;
+    imu_flat[4] = lastImu.gy;
+    imu_flat[5] = lastImu.gz;
+    imu_count = 1;
+  }
+
+  if (hasPulse) {
+    pulses[0] = lastPulse.value;
+    pulse_count = 1;
+  }
+
+  // 5) Flags
+  uint8_t flags = 0;
+  if (new_epoch)   flags |= PM_FLAG_EPOCH;
+  if (imu_count)   flags |= PM_FLAG_IMU;
+  if (pulse_count) flags |= PM_FLAG_PULSE;
+
+  // 6) Enviar paquete
+  esp_err_t err = packet_manager_send_compact(
+      flags,
+      s_epoch_ms, ts_delta,
+      (imu_count ? imu_flat : NULL), NULL,
+      imu_count,
+      (pulse_count ? pulses : NULL), NULL,
+      pulse_count
+  );
+
+  // Solo llega la última de cada ciclo; el resto se pierde
+  uint32_t ok = (err == ESP_OK) ? 1 : 0;
+  if (imu_new) {
+    stats_add(&s_stats.imu_delivered, ok);
+    stats_add(&s_stats.imu_dropped, imu_new - ok);
+  }
+  if (pulse_new) {
+    stats_add(&s_stats.pulse_delivered, ok);
+    stats_add(&s_stats.pulse_dropped, pulse_new - ok);
+  }
+}
+
+/* Descarta lo que quedara en los rings al pasar a modo sin transmisión */
+static void pm_drain(void) {
+  pm_imu_compact_t imutmp;
+  pm_pulse_item_t ptmp;
+  uint32_t imu = 0, pulse = 0;
+  while (spsc_ring_pop(&s_imu_compact_q, &imutmp, 1) == 1) imu++;
+  while (spsc_ring_pop(&s_pulse_q, &ptmp, 1) == 1) pulse++;
+  stats_add(&s_stats.imu_dropped, imu);
+  stats_add(&s_stats.pulse_dropped, pulse);
 }
 
 static void pm_task(void *arg) {
     (void)arg;
     ESP_LOGI(TAG, "pm_task (synced) started");
 
-    pm_imu_compact_t lastImu = {0};
-    pm_pulse_item_t lastPulse = {0};
-
-    bool hasImu = false;
-    bool hasPulse = false;
-
     const TickType_t period = pdMS_TO_TICKS(20);   // 50 Hz envío
     TickType_t lastWake = xTaskGetTickCount();
+    TickType_t lastReport = lastWake;
 
     for (;;) {
-        // 1) Consumir TODAS las IMUs disponibles
-        pm_imu_compact_t imutmp;
-        while (xQueueReceive(s_imu_compact_q, &imutmp, 0) == pdTRUE) {
-            lastImu = imutmp;
-            hasImu = true;
+        if (!s_transmit) {
+            // Sin suscriptores: nada que construir. Se duerme hasta que
+            // pm_set_transmit(true) despierte la tarea.
+            pm_drain();
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PM_OFFLINE_WAIT_MS));
+            lastWake = xTaskGetTickCount();
+            if (!s_transmit) continue;
+            pm_drain();   // lo que entrara justo en la transición ya es viejo
         }
 
-        // 2) Consumir TODOS los pulsos disponibles
-        pm_pulse_item_t ptmp;
-        while (xQueueReceive(s_pulse_q, &ptmp, 0) == pdTRUE) {
-            lastPulse = ptmp;
-            hasPulse = true;
+        if (s_batch_mode) pm_send_batch();
+        else              pm_send_latest();
+
+        // Informe periódico entregadas / descartadas
+        if ((xTaskGetTickCount() - lastReport) >= pdMS_TO_TICKS(PM_STATS_PERIOD_MS)) {
+            lastReport = xTaskGetTickCount();
+            pm_stats_t st;
+            pm_get_stats(&st);
+            ESP_LOGI(TAG, "IMU ok=%lu drop=%lu (qfull=%lu) | PULSE ok=%lu drop=%lu (qfull=%lu) | "
+                          "pkts=%lu notify_err=%lu build_err=%lu deferred=%lu credits=%d tx_fail=%lu",
+                     (unsigned long)st.imu_delivered, (unsigned long)st.imu_dropped,
+                     (unsigned long)st.imu_queue_full,
+                     (unsigned long)st.pulse_delivered, (unsigned long)st.pulse_dropped,
+                     (unsigned long)st.pulse_queue_full,
+                     (unsigned long)st.packets_sent, (unsigned long)st.notify_errors,
+                     (unsigned long)st.build_errors, (unsigned long)st.tx_deferred,
+                     bluetooth_notify_credits(),
+                     (unsigned long)bluetooth_notify_tx_failures());
         }
 
-        // 3) Elegir timestamp
-        uint64_t ts = 0;
-        if (hasImu) ts = lastImu.ts;
-        else if (hasPulse) ts = (uint64_t)lastPulse.ts32;
-        else ts = now_ms64(); // fallback
-
-        // 4) Construir paquete
-        int16_t imu_flat[6];
-        uint16_t pulses[1];
-
-        uint8_t imu_count = 0;
-        uint8_t pulse_count = 0;
-
-        if (hasImu) {
-            imu_flat[0] = lastImu.ax;
-            imu_flat[1] = lastImu.ay;
-            imu_flat[2] = lastImu.az;
-            imu_flat[3] = lastImu.gx;
-            imu_flat[4] = lastImu.gy;
-            imu_flat[5] = lastImu.gz;
-            imu_count = 1;
-        }
-
-        if (hasPulse) {
-            pulses[0] = lastPulse.value;
-            pulse_count = 1;
-        }
-
-        // 5) Flags
-        uint8_t flags = 0;
-        if (imu_count && pulse_count) flags = 0xC0;
-        else if (imu_count)         flags = 0x80;
-        else if (pulse_count)       flags = 0x40;
-
-        // 6) Enviar paquete
-        packet_manager_send_compact(
-            flags,
-            ts,
-            (imu_count ? imu_flat : NULL),
-            imu_count,
-            (pulse_count ? pulses : NULL),
-            pulse_count
-        );
-
-        // 7) Esperar próximo envío
+        // Esperar próximo envío
         vTaskDelayUntil(&lastWake, period);
     }
 }
@@ -194,14 +546,14 @@ static void pm_task(void *arg) {
    ============================ */
 
 esp_err_t pm_init(void) {
-  if (s_pulse_q || s_imu_compact_q || s_task) return ESP_OK;
+  if (s_rings_ready || s_task) return ESP_OK;
 
-  s_pulse_q = xQueueCreate(PM_PULSE_Q_LEN, sizeof(pm_pulse_item_t));
-  s_imu_compact_q = xQueueCreate(PM_IMU_COMPACT_Q_LEN, sizeof(pm_imu_compact_t));
-  if (!s_pulse_q || !s_imu_compact_q) {
-    ESP_LOGE(TAG, "Failed to create queues");
-    return ESP_ERR_NO_MEM;
+  if (!spsc_ring_init(&s_pulse_q, s_pulse_buf, PM_PULSE_Q_LEN, sizeof(pm_pulse_item_t)) ||
+      !spsc_ring_init(&s_imu_compact_q, s_imu_buf, PM_IMU_COMPACT_Q_LEN, sizeof(pm_imu_compact_t))) {
+    ESP_LOGE(TAG, "Failed to init rings");
+    return ESP_ERR_INVALID_SIZE;
   }
+  s_rings_ready = true;
 
   BaseType_t ok = xTaskCreate(pm_task, "pm_task", PM_TASK_STACK, NULL, PM_TASK_PRIO, &s_task);
   if (ok != pdPASS) {
@@ -214,30 +566,98 @@ esp_err_t pm_init(void) {
 }
 
 int pm_feed_pulse(uint16_t value) {
-  if (!s_pulse_q) return -1;
+  if (!s_rings_ready) return -1;
+  if (!s_transmit) return 0;   // nadie escucha: se descarta sin contar
   pm_pulse_item_t it;
   it.value = value;
-  it.ts32 = (uint32_t)now_ms64();
-  if (xQueueSend(s_pulse_q, &it, 0) == pdTRUE) return 0;
+  it.ts32 = now_ms32();
+  if (spsc_ring_push(&s_pulse_q, &it, 1) == 1) return 0;
+  stats_add(&s_stats.pulse_dropped, 1);
+  stats_add(&s_stats.pulse_queue_full, 1);
   return -1;
 }
 
-void pm_feed_imu_compact_sink(const pm_imu_compact_t *it) {
-  /* helper to enqueue if queue exists */
-  if (!s_imu_compact_q) return;
-  xQueueSend(s_imu_compact_q, it, 0);
+size_t pm_feed_imu_block(const pm_imu_sample_t *samples, size_t count) {
+  if (!s_rings_ready || !samples) return 0;
+  if (!s_transmit) return count;
+  size_t pushed = spsc_ring_push(&s_imu_compact_q, samples, count);
+  if (pushed < count) {
+    stats_add(&s_stats.imu_dropped, count - pushed);
+    stats_add(&s_stats.imu_queue_full, count - pushed);
+  }
+  return pushed;
 }
 
 int pm_feed_imu_compact(int16_t ax, int16_t ay, int16_t az,
                         int16_t gx, int16_t gy, int16_t gz,
-                        uint64_t timestamp_ms)
+                        uint32_t timestamp_ms)
 {
-  if (!s_imu_compact_q) return -1;
+  if (!s_rings_ready) return -1;
+  if (!s_transmit) return 0;
   pm_imu_compact_t it;
   it.ax = ax; it.ay = ay; it.az = az;
   it.gx = gx; it.gy = gy; it.gz = gz;
-  it.ts = timestamp_ms;
-  if (xQueueSend(s_imu_compact_q, &it, 0) == pdTRUE) return 0;
+  it.ts32 = timestamp_ms;
+  if (spsc_ring_push(&s_imu_compact_q, &it, 1) == 1) return 0;
+  stats_add(&s_stats.imu_dropped, 1);
+  stats_add(&s_stats.imu_queue_full, 1);
   return -1;
 }
 
+void pm_set_batch_mode(bool enable) {
+  s_batch_mode = enable;
+  ESP_LOGI(TAG, "Modo %s", enable ? "lote (MTU)" : "última muestra");
+}
+
+void pm_set_imu_compression(bool enable) {
+  s_imu_delta = enable;
+  ESP_LOGI(TAG, "Compresión delta IMU %s", enable ? "activada" : "desactivada");
+}
+
+void pm_request_epoch(void) {
+  s_epoch_request = true;
+}
+
+void pm_set_transmit(bool enable) {
+  if (s_transmit == enable) return;
+  s_transmit = enable;
+  ESP_LOGI(TAG, "Transmisión %s", enable ? "activa" : "en pausa (sin suscriptores)");
+  if (enable && s_task) xTaskNotifyGive(s_task);
+}
+
+void pm_get_stats(pm_stats_t *out) {
+  if (!out) return;
+  portENTER_CRITICAL(&s_stats_lock);
+  *out = s_stats;
+  portEXIT_CRITICAL(&s_stats_lock);
+  out->last_seq = (uint8_t)(s_seq - 1);
+}
+
+static inline void put_u32(uint8_t *out, int *off, uint32_t v) {
+  memcpy(out + *off, &v, 4);
+  *off += 4;
+}
+
+int pm_stats_serialize(uint8_t *out, size_t max_len) {
+  if (!out || max_len < PM_STATS_WIRE_LEN) return -1;
+
+  pm_stats_t st;
+  pm_get_stats(&st);
+
+  int off = 0;
+  out[off++] = PM_STATS_WIRE_VERSION;
+  out[off++] = st.last_seq;
+  put_u32(out, &off, st.imu_delivered);
+  put_u32(out, &off, st.imu_dropped);
+  put_u32(out, &off, st.imu_queue_full);
+  put_u32(out, &off, st.pulse_delivered);
+  put_u32(out, &off, st.pulse_dropped);
+  put_u32(out, &off, st.pulse_queue_full);
+  put_u32(out, &off, st.packets_sent);
+  put_u32(out, &off, st.packets_skipped);
+  put_u32(out, &off, st.build_errors);
+  put_u32(out, &off, st.notify_errors);
+  put_u32(out, &off, st.tx_deferred);
+  return off;
+}
+
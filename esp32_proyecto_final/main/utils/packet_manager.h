@@ -1,5 +1,7 @@
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -11,38 +13,141 @@ extern "C" {
  *
  * Formato compacto (Option A):
  *  byte0: flags (uint8)
- *  bytes1..8: timestamp (uint64 LE)
- *  byte9: count_imu (uint8)
- *  byte10: count_pulse (uint8)
- *  following: for each imu sample -> ax,ay,az,gx,gy,gz (int16 LE each)
- *             for each pulse sample -> uint16 LE
+ *  byte1: seq (uint8, +1 por paquete construido; un hueco = paquete perdido)
+ *  [epoch]: uint32 LE, solo si flags lleva PM_FLAG_EPOCH
+ *  ts_delta: uint16 LE, ms del paquete respecto a la última epoch
+ *  count_imu (uint8)
+ *  count_pulse (uint8)
+ *  following: for each imu sample -> [dt] ax,ay,az,gx,gy,gz (int16 LE each)
+ *             for each pulse sample -> [dt] uint16 LE
+ *
+ * Base de tiempos: la epoch es el tick absoluto del dispositivo en ms
+ * (uint32, da la vuelta a los ~49 días). Se manda en el primer paquete,
+ * cada PM_EPOCH_PERIOD_MS y cuando alguien la pide (pm_request_epoch, p.ej.
+ * al suscribirse un cliente). Timestamp del paquete = epoch + ts_delta.
+ *
+ * Si flags lleva PM_FLAG_SAMPLE_DT, cada muestra va precedida de un
+ * uint16 LE "dt": milisegundos respecto al timestamp del paquete (que es
+ * el de la muestra más antigua del lote).
+ *
+ * Si flags lleva PM_FLAG_IMU_DELTA, el bloque IMU va comprimido con
+ * imu_codec (primera muestra cruda, resto deltas zig-zag varint por eje;
+ * los dt también van en varint). Los pulsos no cambian.
  */
 
+/* Bits de flags */
+#define PM_FLAG_IMU        0x80  /* hay muestras IMU */
+#define PM_FLAG_PULSE      0x40  /* hay muestras de pulso */
+#define PM_FLAG_SAMPLE_DT  0x20  /* cada muestra lleva su dt (uint16 ms) */
+#define PM_FLAG_IMU_DELTA  0x10  /* bloque IMU comprimido (imu_codec.h) */
+#define PM_FLAG_EPOCH      0x08  /* el paquete lleva epoch absoluta (uint32) */
+
+#define PM_HEADER_LEN      6     /* flags + seq + ts_delta + count_imu + count_pulse */
+#define PM_EPOCH_LEN       4
+#define PM_IMU_SAMPLE_LEN  12
+#define PM_PULSE_SAMPLE_LEN 2
+#define PM_SAMPLE_DT_LEN   2
+
+/* Muestra IMU tal como se encola (6 int16 escalados x100 + tick en ms) */
+typedef struct {
+  int16_t ax;
+  int16_t ay;
+  int16_t az;
+  int16_t gx;
+  int16_t gy;
+  int16_t gz;
+  uint32_t ts32;
+} pm_imu_sample_t;
+
+/* Contadores de entrega (muestras entregadas a BLE vs descartadas) */
+typedef struct {
+  uint32_t imu_delivered;
+  uint32_t imu_dropped;     /* cola llena, sustituida en modo "última muestra", notify fallido
+                               o pendiente al quedarse sin suscriptores */
+  uint32_t imu_queue_full;  /* de las anteriores, pm_feed_imu_compact con la cola llena */
+  uint32_t pulse_delivered;
+  uint32_t pulse_dropped;
+  uint32_t pulse_queue_full;
+  uint32_t packets_sent;    /* notificados sin error */
+  uint32_t packets_skipped; /* construidos sin nadie suscrito (carrera con la desuscripción) */
+  uint32_t build_errors;    /* packet_manager_build_compact devolvió -1 */
+  uint32_t notify_errors;   /* fallo de mbuf o de ble_gattc_notify_custom */
+  uint32_t tx_deferred;     /* ciclos sin construir por back-pressure del enlace */
+  uint8_t last_seq;         /* seq del último paquete construido */
+} pm_stats_t;
+
+/* Contadores serializados para la característica de estadísticas (GATT):
+ *  byte0: versión, byte1: last_seq, y después los uint32 LE en el orden
+ *  de pm_stats_t (imu_delivered ... tx_deferred). La v2 añade tx_deferred
+ *  al final. */
+#define PM_STATS_WIRE_VERSION 2
+#define PM_STATS_WIRE_LEN     (2 + 11 * 4)
+
 /* Inicializa colas y tarea del packet manager. */
 esp_err_t pm_init(void);
 
+/* Modo lote (por defecto): cada paquete se llena con todas las muestras
+ * encoladas que quepan en el MTU negociado. Con false se vuelve al modo
+ * antiguo (solo la última muestra de cada tipo, sin dt). */
+void pm_set_batch_mode(bool enable);
+
+/* Modo lote: comprime el bloque IMU con deltas (por defecto activado). */
+void pm_set_imu_compression(bool enable);
+
+/* Fuerza una epoch absoluta en el siguiente paquete. */
+void pm_request_epoch(void);
+
+/* Con false (estado inicial) nadie está suscrito a las notificaciones:
+ * pm_task deja de construir paquetes y duerme, y pm_feed_* descartan las
+ * muestras sin encolarlas ni contarlas. La capa BLE lo activa con el primer
+ * suscriptor y lo desactiva con el último. */
+void pm_set_transmit(bool enable);
+
+/* Copia los contadores de entrega/descarte. */
+void pm_get_stats(pm_stats_t *out);
+
+/* Serializa los contadores (ver PM_STATS_WIRE_*). Devuelve longitud o -1. */
+int pm_stats_serialize(uint8_t *out, size_t max_len);
+
+/* Las funciones pm_feed_* escriben en rings SPSC lock-free (spsc_ring.h):
+ * cada tipo de muestra admite UNA sola tarea productora a la vez. */
+
 /* Encolar muestra de pulso (no bloqueante). Devuelve 0=ok, -1=drop */
 int pm_feed_pulse(uint16_t value);
 
-/* Encolar muestra compacta de IMU (6 int16 escalados x100) */
+/* Encolar muestra compacta de IMU (6 int16 escalados x100).
+ * timestamp_ms: tick de dispositivo en ms (esp_timer_get_time() / 1000). */
 int pm_feed_imu_compact(int16_t ax, int16_t ay, int16_t az,
                         int16_t gx, int16_t gy, int16_t gz,
-                        uint64_t timestamp_ms);
+                        uint32_t timestamp_ms);
 
-/* Función para construir paquete compacto en buffer (devuelve longitud o -1) */
-int packet_manager_build_compact(uint8_t *out, uint8_t max_len,
-                                 uint8_t flags, uint64_t timestamp,
+/* Encolar un bloque de muestras IMU de una vez. Devuelve cuántas entraron
+ * (el resto se cuenta como descartado por cola llena). */
+size_t pm_feed_imu_block(const pm_imu_sample_t *samples, size_t count);
+
+/* Función para construir paquete compacto en buffer (devuelve longitud o -1).
+ * imu_dt / pulse_dt solo se usan si flags lleva PM_FLAG_SAMPLE_DT
+ * (NULL = dt 0 para todas). */
+int packet_manager_build_compact(uint8_t *out, uint16_t max_len,
+                                 uint8_t flags, uint8_t seq,
+                                 uint32_t epoch_ms, uint16_t ts_delta,
                                  const int16_t *imu_flat /* ptr to 6*imu_count int16 */,
+                                 const uint16_t *imu_dt,
                                  uint8_t imu_count,
                                  const uint16_t *pulses,
+                                 const uint16_t *pulse_dt,
                                  uint8_t pulse_count);
 
-/* Enviar paquete compacto directamente (usa bluetooth send_notification_binary) */
-void packet_manager_send_compact(uint8_t flags, uint64_t timestamp,
-                                 const int16_t *imu_flat, uint8_t imu_count,
-                                 const uint16_t *pulses, uint8_t pulse_count);
+/* Enviar paquete compacto: se serializa directamente en un mbuf de NimBLE
+ * (bluetooth_notify_mbuf_alloc) limitado a MTU - 3, sin copia intermedia.
+ * Asigna el siguiente seq. ESP_OK si se notificó, ESP_ERR_INVALID_STATE si
+ * no hay cliente, otro error si falló la construcción o el envío. */
+esp_err_t packet_manager_send_compact(uint8_t flags, uint32_t epoch_ms, uint16_t ts_delta,
+                                      const int16_t *imu_flat, const uint16_t *imu_dt,
+                                      uint8_t imu_count,
+                                      const uint16_t *pulses, const uint16_t *pulse_dt,
+                                      uint8_t pulse_count);
 
 #ifdef __cplusplus
 }
 #endif
-
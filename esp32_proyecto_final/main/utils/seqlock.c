@@ -0,0 +1,52 @@
+#include "seqlock.h"
+#include <string.h>
+
+#define WORDS(len) (((len) + 3) / 4)
+
+void seqlock_init(seqlock_t *sl) {
+  atomic_init(&sl->seq, 0);
+  for (size_t i = 0; i < SEQLOCK_WORDS; i++) atomic_init(&sl->w[i], 0);
+}
+
+void seqlock_write(seqlock_t *sl, const void *src, size_t len) {
+  uint32_t tmp[SEQLOCK_WORDS] = {0};
+  if (len > sizeof(tmp)) len = sizeof(tmp);
+  memcpy(tmp, src, len);
+
+  uint32_t seq = atomic_load_explicit(&sl->seq, memory_order_relaxed);
+  atomic_store_explicit(&sl->seq, seq + 1, memory_order_relaxed);
+  /* seq impar visible antes que cualquier palabra nueva */
+  atomic_thread_fence(memory_order_release);
+
+  for (size_t i = 0; i < WORDS(len); i++) {
+    atomic_store_explicit(&sl->w[i], tmp[i], memory_order_relaxed);
+  }
+
+  /* palabras visibles antes que el seq par que las publica */
+  atomic_store_explicit(&sl->seq, seq + 2, memory_order_release);
+}
+
+bool seqlock_read(const seqlock_t *sl, void *dst, size_t len,
+                  uint32_t max_tries, uint32_t *seq) {
+  uint32_t tmp[SEQLOCK_WORDS];
+  if (len > sizeof(tmp)) len = sizeof(tmp);
+
+  for (uint32_t t = 0; t < max_tries; t++) {
+    uint32_t s1 = atomic_load_explicit(&sl->seq, memory_order_acquire);
+    if (s1 & 1) continue;   /* escritura en curso */
+
+    for (size_t i = 0; i < WORDS(len); i++) {
+      tmp[i] = atomic_load_explicit(&sl->w[i], memory_order_relaxed);
+    }
+
+    /* las palabras se leen antes que el segundo seq */
+    atomic_thread_fence(memory_order_acquire);
+    uint32_t s2 = atomic_load_explicit(&sl->seq, memory_order_relaxed);
+    if (s1 != s2) continue;   /* partida: hubo una escritura entre medias */
+
+    memcpy(dst, tmp, len);
+    if (seq) *seq = s1 / 2;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Seqlock de un escritor para publicar un valor pequeño (la última muestra)
+ * a cualquier número de lectores.
+ *
+ * No depende de ESP-IDF: se compila igual en el host (tools/).
+ *
+ * El escritor nunca espera: pone seq impar, copia y pone seq par otra vez.
+ * El lector copia entre dos lecturas de seq y repite si eran distintas o
+ * impares (lectura partida). El dato va en palabras atómicas relaxed, así
+ * que no hay carrera de datos en el sentido de C11; el orden lo dan las
+ * barreras release/acquire alrededor, igual en los dos cores Xtensa del
+ * ESP32 que en x86.
+ *
+ * Un lector de más prioridad en el mismo core que el escritor podría girar
+ * sin dejarle terminar: por eso seqlock_read se rinde tras max_tries y es
+ * el llamante quien cede la CPU (p.ej. vTaskDelay) antes de volver a
+ * intentarlo.
+ */
+
+#define SEQLOCK_WORDS 8   /* hasta 32 bytes */
+
+typedef struct {
+  _Atomic uint32_t seq;   /* par = estable; sube de 2 en 2 por escritura */
+  _Atomic uint32_t w[SEQLOCK_WORDS];
+} seqlock_t;
+
+void seqlock_init(seqlock_t *sl);
+
+/* Solo UNA tarea escribe. len <= SEQLOCK_WORDS * 4. */
+void seqlock_write(seqlock_t *sl, const void *src, size_t len);
+
+/* Copia una versión completa en dst. false si tras max_tries intentos solo
+ * vio escrituras a medias. seq (opcional) = versión leída (0 = nunca
+ * escrito). */
+bool seqlock_read(const seqlock_t *sl, void *dst, size_t len,
+                  uint32_t max_tries, uint32_t *seq);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,126 @@
+#include "spsc_ring.h"
+#include <string.h>
+
+bool spsc_ring_init(spsc_ring_t *r, void *storage, size_t capacity, size_t elem_size) {
+  if (!r || !storage || elem_size == 0) return false;
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) return false;
+
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  r->tail_cache = 0;
+  r->head_cache = 0;
+  r->buf = (uint8_t *)storage;
+  r->mask = (uint32_t)(capacity - 1);
+  r->elem_size = (uint32_t)elem_size;
+  return true;
+}
+
+/* Parte [idx, idx + n) en hasta dos tramos contiguos */
+static size_t split_spans(const spsc_ring_t *r, uint32_t idx, size_t n, spsc_span_t span[2]) {
+  size_t cap = (size_t)r->mask + 1;
+  size_t start = idx & r->mask;
+  size_t first = (n < cap - start) ? n : cap - start;
+
+  span[0].ptr = r->buf + start * r->elem_size;
+  span[0].count = first;
+  span[1].ptr = r->buf;
+  span[1].count = n - first;
+  return n;
+}
+
+/* ============================
+   Productor
+   ============================ */
+
+/* Huecos libres; solo relee tail (línea del consumidor) si la copia local
+ * no alcanza para want */
+static size_t producer_room(spsc_ring_t *r, uint32_t head, size_t want) {
+  uint32_t cap = r->mask + 1;
+  size_t room = cap - (head - r->tail_cache);
+  if (room < want) {
+    r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    room = cap - (head - r->tail_cache);
+  }
+  return room;
+}
+
+size_t spsc_ring_write_spans(spsc_ring_t *r, spsc_span_t span[2]) {
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  return split_spans(r, head, producer_room(r, head, r->mask + 1), span);
+}
+
+void spsc_ring_commit_write(spsc_ring_t *r, size_t n) {
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  atomic_store_explicit(&r->head, head + (uint32_t)n, memory_order_release);
+}
+
+size_t spsc_ring_push(spsc_ring_t *r, const void *items, size_t n) {
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  size_t room = producer_room(r, head, n);
+  if (n > room) n = room;
+  if (n == 0) return 0;
+
+  spsc_span_t span[2];
+  split_spans(r, head, n, span);
+
+  size_t first = (n < span[0].count) ? n : span[0].count;
+  memcpy(span[0].ptr, items, first * r->elem_size);
+  if (n > first) {
+    memcpy(span[1].ptr, (const uint8_t *)items + first * r->elem_size,
+           (n - first) * r->elem_size);
+  }
+
+  spsc_ring_commit_write(r, n);
+  return n;
+}
+
+/* ============================
+   Consumidor
+   ============================ */
+
+/* Elementos disponibles; solo relee head (línea del productor) si la copia
+ * local no alcanza para want */
+static size_t consumer_avail(spsc_ring_t *r, uint32_t tail, size_t want) {
+  size_t avail = r->head_cache - tail;
+  if (avail < want) {
+    r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    avail = r->head_cache - tail;
+  }
+  return avail;
+}
+
+size_t spsc_ring_read_spans(spsc_ring_t *r, spsc_span_t span[2]) {
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  return split_spans(r, tail, consumer_avail(r, tail, r->mask + 1), span);
+}
+
+void spsc_ring_commit_read(spsc_ring_t *r, size_t n) {
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  atomic_store_explicit(&r->tail, tail + (uint32_t)n, memory_order_release);
+}
+
+size_t spsc_ring_pop(spsc_ring_t *r, void *items, size_t n) {
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  size_t avail = consumer_avail(r, tail, n);
+  if (n > avail) n = avail;
+  if (n == 0) return 0;
+
+  spsc_span_t span[2];
+  split_spans(r, tail, n, span);
+
+  size_t first = (n < span[0].count) ? n : span[0].count;
+  memcpy(items, span[0].ptr, first * r->elem_size);
+  if (n > first) {
+    memcpy((uint8_t *)items + first * r->elem_size, span[1].ptr,
+           (n - first) * r->elem_size);
+  }
+
+  spsc_ring_commit_read(r, n);
+  return n;
+}
+
+size_t spsc_ring_count(spsc_ring_t *r) {
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  return (size_t)(head - tail);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Ring buffer lock-free de un productor y un consumidor (SPSC).
+ *
+ * Sustituye a las colas FreeRTOS entre las tareas de sensores y pm_task:
+ * no entra en sección crítica y permite mover bloques enteros de muestras
+ * sin copias intermedias (API de spans).
+ *
+ * Reglas:
+ *  - Solo UNA tarea escribe (push / write_spans + commit_write) y solo UNA
+ *    lee (pop / read_spans + commit_read). Pueden estar en cores distintos.
+ *  - Índices de 32 bits que corren libres; capacidad potencia de 2.
+ *  - Publicación con release/acquire: los datos de un elemento son
+ *    visibles antes que el índice que lo publica, tanto en el ESP32
+ *    (dos cores Xtensa) como en x86 para las pruebas en host.
+ *  - No se compila en el ESP32 sin <stdatomic.h> (GCC >= 4.9).
+ *
+ * Cada índice va en su propia línea para que productor y consumidor no se
+ * pisen la misma línea (falso compartido); cada lado guarda además una
+ * copia del índice del otro para no releerlo en cada operación.
+ */
+
+#if defined(__XTENSA__)
+#define SPSC_RING_CACHE_LINE 32
+#else
+#define SPSC_RING_CACHE_LINE 64
+#endif
+
+/* Tramo contiguo dentro del ring */
+typedef struct {
+  void *ptr;
+  size_t count;   /* elementos */
+} spsc_span_t;
+
+typedef struct {
+  /* lado productor */
+  alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t head;
+  uint32_t tail_cache;
+
+  /* lado consumidor */
+  alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t tail;
+  uint32_t head_cache;
+
+  /* constante tras spsc_ring_init */
+  alignas(SPSC_RING_CACHE_LINE) uint8_t *buf;
+  uint32_t mask;
+  uint32_t elem_size;
+} spsc_ring_t;
+
+/* storage debe tener capacity * elem_size bytes; capacity potencia de 2.
+ * Devuelve false si los parámetros no son válidos. */
+bool spsc_ring_init(spsc_ring_t *r, void *storage, size_t capacity, size_t elem_size);
+
+/* ---- Productor ---- */
+
+/* Huecos libres como hasta dos tramos contiguos. Devuelve el total. */
+size_t spsc_ring_write_spans(spsc_ring_t *r, spsc_span_t span[2]);
+
+/* Publica n elementos ya escritos en los tramos de write_spans. */
+void spsc_ring_commit_write(spsc_ring_t *r, size_t n);
+
+/* Copia hasta n elementos. Devuelve cuántos entraron. */
+size_t spsc_ring_push(spsc_ring_t *r, const void *items, size_t n);
+
+/* ---- Consumidor ---- */
+
+/* Elementos disponibles como hasta dos tramos contiguos. Devuelve el total. */
+size_t spsc_ring_read_spans(spsc_ring_t *r, spsc_span_t span[2]);
+
+/* Libera n elementos ya leídos de los tramos de read_spans. */
+void spsc_ring_commit_read(spsc_ring_t *r, size_t n);
+
+/* Copia y libera hasta n elementos. Devuelve cuántos salieron. */
+size_t spsc_ring_pop(spsc_ring_t *r, void *items, size_t n);
+
+/* Ocupación aproximada (exacta solo desde productor o consumidor). */
+size_t spsc_ring_count(spsc_ring_t *r);
+
+static inline size_t spsc_ring_capacity(const spsc_ring_t *r) {
+  return (size_t)r->mask + 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
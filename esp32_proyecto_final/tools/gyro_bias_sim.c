@@ -0,0 +1,169 @@
+// gyro_bias_sim.c
+// Simulación en host del seguimiento del sesgo del giróscopo
+// (main/utils/gyro_bias.c) durante una noche.
+//
+// Uso: gyro_bias_sim [horas] [semilla]
+//   horas:   duración simulada (def. 10)
+//   semilla: del generador aleatorio (def. 1)
+//
+// Genera muestras crudas de MPU6050 a 100 Hz (±2 g, ±250 °/s) con:
+//  - temperatura que sube al encender y luego oscila (TEMP_OUT incluido);
+//  - sesgo real = inicial + coeficiente térmico * ΔT + paseo aleatorio;
+//  - tramos en reposo, en movimiento y girando despacio a velocidad
+//    constante (acelerómetro quieto: solo la innovación lo delata);
+//  - ruido blanco en acelerómetro y giróscopo.
+// Compara el error de sesgo de la calibración del arranque (fija) con el
+// del estimador, por hora. Sale con 2 si el estimador pasa de 0,1 °/s RMS
+// en alguna hora o no mejora a la calibración fija.
+
+#include "gyro_bias.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RATE_HZ    100
+#define GYRO_LSB   131.0
+#define ACCEL_LSB  16384.0
+#define MAX_ERR    0.1   /* °/s RMS */
+
+typedef enum { SEG_STILL, SEG_MOVE, SEG_ROTATE } seg_t;
+
+static double now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+static double uniform(void) {
+  return (rand() + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+static double gauss(void) {
+  return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static void put16(uint8_t *b, double v) {
+  long r = lrint(v);
+  if (r > INT16_MAX) r = INT16_MAX;
+  if (r < INT16_MIN) r = INT16_MIN;
+  b[0] = (uint8_t)((uint16_t)r >> 8);
+  b[1] = (uint8_t)r;
+}
+
+/* Calentamiento de 8 °C en la primera hora y luego ±2 °C cada 3 h */
+static double temp_at(double t) {
+  return 25.0 + 8.0 * (1.0 - exp(-t / 3600.0)) + 2.0 * sin(2.0 * M_PI * t / 10800.0);
+}
+
+int main(int argc, char **argv) {
+  double hours = (argc > 1) ? atof(argv[1]) : 10.0;
+  srand((argc > 2) ? (unsigned)atoi(argv[2]) : 1u);
+  if (hours <= 0) hours = 10.0;
+
+  const double bias0[3] = {40.0, -25.0, 12.0};   /* LSB */
+  const double coef[3] = {4.0, -3.0, 2.0};       /* LSB/°C (~0,03 °/s/°C) */
+  const double walk = 0.05 * GYRO_LSB / sqrt(3600.0 * RATE_HZ);   /* 0,05 °/s/√h */
+  double drift[3] = {0};
+
+  /* Calibración del arranque: el sesgo real con un error pequeño */
+  int16_t cal[3];
+  for (int i = 0; i < 3; i++) cal[i] = (int16_t)lrint(bias0[i] + 5.0);
+
+  gyro_bias_config_t cfg;
+  gyro_bias_config_default(&cfg, RATE_HZ, (float)GYRO_LSB, (float)ACCEL_LSB);
+  gyro_bias_t gb;
+  gyro_bias_init(&gb, &cfg, cal, true);
+  double est[3] = {cal[0], cal[1], cal[2]};
+
+  size_t total = (size_t)(hours * 3600.0 * RATE_HZ);
+  size_t per_hour = 3600u * RATE_HZ;
+  double err_cal = 0, err_est = 0, worst_est = 0, worst_cal = 0, worst_h = 0;
+  double sum_cal = 0, sum_est = 0;
+  int bad = 0;
+
+  seg_t seg = SEG_STILL;
+  size_t seg_left = 0;
+  double rot[3] = {0}, freq = 1.0, amp = 0;
+  double update_ns = 0;
+
+  printf("hora  calibración fija  estimador (RMS °/s)  temp\n");
+  for (size_t k = 0; k < total; k++) {
+    double t = (double)k / RATE_HZ;
+
+    if (seg_left == 0) {
+      double r = uniform();
+      seg = r < 0.55 ? SEG_STILL : r < 0.9 ? SEG_MOVE : SEG_ROTATE;
+      double len = seg == SEG_STILL ? 5 + 115 * uniform() : 2 + 18 * uniform();
+      seg_left = (size_t)(len * RATE_HZ);
+      freq = 0.2 + 2.0 * uniform();
+      amp = 10.0 + 60.0 * uniform();
+      for (int i = 0; i < 3; i++) rot[i] = (uniform() - 0.5) * 2.0;   /* ±1 °/s */
+    }
+    seg_left--;
+
+    double temp = temp_at(t);
+    double truth[3], gyro[3], accel[3] = {0, 0, ACCEL_LSB};
+    for (int i = 0; i < 3; i++) {
+      drift[i] += walk * gauss();
+      truth[i] = bias0[i] + coef[i] * (temp - 25.0) + drift[i];
+      gyro[i] = truth[i];
+      if (seg == SEG_MOVE) {
+        double ph = 2.0 * M_PI * freq * t + i;
+        gyro[i] += amp * GYRO_LSB * sin(ph);
+        accel[i] += 0.2 * ACCEL_LSB * cos(ph);
+      } else if (seg == SEG_ROTATE) {
+        gyro[i] += rot[i] * GYRO_LSB;
+      }
+      gyro[i] += 0.05 * GYRO_LSB * gauss();
+      accel[i] += 0.004 * ACCEL_LSB * gauss();
+    }
+
+    uint8_t raw[14];
+    for (int i = 0; i < 3; i++) {
+      put16(&raw[2 * i], accel[i]);
+      put16(&raw[8 + 2 * i], gyro[i]);
+    }
+    put16(&raw[6], (temp - 36.53) * 340.0);
+
+    int32_t q8[3];
+    double t0 = now_ns();
+    bool closed = gyro_bias_update(&gb, raw, q8);
+    update_ns += now_ns() - t0;
+    if (closed) {
+      for (int i = 0; i < 3; i++) est[i] = q8[i] / 256.0;
+    }
+
+    for (int i = 0; i < 3; i++) {
+      double ec = (cal[i] - truth[i]) / GYRO_LSB;
+      double ee = (est[i] - truth[i]) / GYRO_LSB;
+      err_cal += ec * ec;
+      err_est += ee * ee;
+      if (fabs(ee) > worst_est) worst_est = fabs(ee);
+      if (fabs(ec) > worst_cal) worst_cal = fabs(ec);
+    }
+
+    if ((k + 1) % per_hour == 0 || k + 1 == total) {
+      size_t n = (k % per_hour) + 1;
+      double rc = sqrt(err_cal / (3.0 * n)), re = sqrt(err_est / (3.0 * n));
+      printf("%4.0f  %16.3f  %19.3f  %4.1f\n", ceil((k + 1.0) / per_hour), rc, re, temp);
+      if (re > MAX_ERR) bad = 1;
+      if (re > worst_h) worst_h = re;
+      sum_cal += err_cal;
+      sum_est += err_est;
+      err_cal = err_est = 0;
+    }
+  }
+
+  printf("ventanas:            %lu (%lu de reposo, %lu descartadas)\n",
+         (unsigned long)gb.windows, (unsigned long)gb.still, (unsigned long)gb.rejected);
+  printf("error máx.:          fija %.3f °/s, estimador %.3f °/s\n", worst_cal, worst_est);
+  printf("coef. térmico:       %.2f %.2f %.2f LSB/°C (real %.1f %.1f %.1f)\n",
+         gb.b[0], gb.b[1], gb.b[2], coef[0], coef[1], coef[2]);
+  printf("coste:               %.1f ns/muestra (con el cierre de ventana)\n",
+         update_ns / (double)total);
+
+  if (sum_est >= sum_cal) bad = 1;
+  return bad ? 2 : 0;
+}
@@ -0,0 +1,157 @@
+// imu_codec_bench.c
+// Benchmark en host del codec delta IMU (main/utils/imu_codec.c).
+//
+// Uso: imu_codec_bench [traza.csv] [mtu]
+//   traza.csv: una muestra por línea "ax,ay,az,gx,gy,gz" (int16 x100, como
+//              los envía pm_feed_imu_compact) o "ts_ms,ax,ay,az,gx,gy,gz".
+//              Sin fichero se genera una traza sintética de sueño.
+//   mtu:       ATT MTU a simular (por defecto 247).
+//
+// Empaqueta la traza en bloques como pm_task, decodifica cada bloque y
+// comprueba que la reconstrucción sea exacta bit a bit.
+
+#include "imu_codec.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HEADER_LEN   6     /* flags + seq + ts_delta + counts (sin epoch) */
+#define RAW_SAMPLE   (2 + IMU_CODEC_RAW_LEN)   /* dt + 6 int16 */
+#define MAX_BLOCK    255
+
+typedef struct {
+  int16_t v[IMU_CODEC_AXES];
+  uint32_t ts;
+} sample_t;
+
+static double now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+static size_t load_csv(const char *path, sample_t **out) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+
+  size_t cap = 4096, n = 0;
+  sample_t *s = malloc(cap * sizeof(*s));
+  char line[256];
+
+  while (fgets(line, sizeof(line), f)) {
+    long v[7];
+    int k = sscanf(line, "%ld,%ld,%ld,%ld,%ld,%ld,%ld",
+                   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]);
+    if (k != 6 && k != 7) continue;   /* cabecera o línea vacía */
+
+    if (n == cap) {
+      cap *= 2;
+      s = realloc(s, cap * sizeof(*s));
+    }
+    int first = (k == 7) ? 1 : 0;
+    for (int a = 0; a < IMU_CODEC_AXES; a++) s[n].v[a] = (int16_t)v[first + a];
+    s[n].ts = (k == 7) ? (uint32_t)v[0] : (uint32_t)(n * 10);
+    n++;
+  }
+
+  fclose(f);
+  *out = s;
+  return n;
+}
+
+/* Paciente quieto: ruido de unos pocos LSB + respiración lenta en az/gx */
+static size_t synth_trace(size_t n, sample_t **out) {
+  sample_t *s = malloc(n * sizeof(*s));
+  srand(1234);
+  for (size_t i = 0; i < n; i++) {
+    double t = (double)i / 100.0;   /* 100 Hz */
+    double breath = sin(2.0 * M_PI * 0.25 * t);
+    int noise[IMU_CODEC_AXES];
+    for (int a = 0; a < IMU_CODEC_AXES; a++) noise[a] = (rand() % 5) - 2;
+
+    s[i].v[0] = (int16_t)(3 + noise[0]);
+    s[i].v[1] = (int16_t)(-5 + noise[1]);
+    s[i].v[2] = (int16_t)(981 + lrint(4.0 * breath) + noise[2]);
+    s[i].v[3] = (int16_t)(lrint(6.0 * breath) + noise[3]);
+    s[i].v[4] = (int16_t)noise[4];
+    s[i].v[5] = (int16_t)noise[5];
+    s[i].ts = (uint32_t)(i * 10);
+  }
+  *out = s;
+  return n;
+}
+
+int main(int argc, char **argv) {
+  sample_t *trace = NULL;
+  size_t n = (argc > 1) ? load_csv(argv[1], &trace) : synth_trace(100000, &trace);
+  int mtu = (argc > 2) ? atoi(argv[2]) : 247;
+  int room = mtu - 3 - HEADER_LEN;
+
+  if (n == 0 || room < RAW_SAMPLE) {
+    fprintf(stderr, "traza vacía o MTU demasiado pequeño\n");
+    return 1;
+  }
+
+  uint8_t *block = malloc(mtu);
+  int16_t dec[IMU_CODEC_AXES * MAX_BLOCK];
+  uint16_t dec_dt[MAX_BLOCK];
+
+  size_t blocks = 0, enc_bytes = 0, mismatches = 0;
+  double enc_ns = 0, dec_ns = 0;
+
+  for (size_t i = 0; i < n;) {
+    imu_codec_state_t st;
+    imu_codec_reset(&st, true);
+    size_t first = i;
+    int used = 0;
+
+    double t0 = now_ns();
+    while (i < n && st.count < MAX_BLOCK) {
+      uint16_t dt = (uint16_t)(trace[i].ts - trace[first].ts);
+      int w = imu_codec_put(&st, block + used, room - used, trace[i].v, dt);
+      if (w < 0) break;
+      used += w;
+      i++;
+    }
+    enc_ns += now_ns() - t0;
+
+    uint8_t count = st.count;
+    t0 = now_ns();
+    int consumed = imu_codec_decode(block, used, count, true, dec, dec_dt);
+    dec_ns += now_ns() - t0;
+
+    if (consumed != used) mismatches++;
+    for (uint8_t k = 0; k < count; k++) {
+      if (memcmp(&dec[IMU_CODEC_AXES * k], trace[first + k].v, IMU_CODEC_RAW_LEN) != 0 ||
+          dec_dt[k] != (uint16_t)(trace[first + k].ts - trace[first].ts)) {
+        mismatches++;
+      }
+    }
+
+    enc_bytes += used;
+    blocks++;
+  }
+
+  size_t raw_bytes = n * RAW_SAMPLE;
+  int raw_per_pkt = room / RAW_SAMPLE;
+
+  printf("muestras:            %zu\n", n);
+  printf("MTU simulado:        %d (bloque IMU %d bytes)\n", mtu, room);
+  printf("bytes crudos:        %zu (%d B/muestra)\n", raw_bytes, RAW_SAMPLE);
+  printf("bytes delta:         %zu (%.2f B/muestra)\n", enc_bytes, (double)enc_bytes / n);
+  printf("ratio compresión:    %.2fx\n", (double)raw_bytes / enc_bytes);
+  printf("muestras/paquete:    crudo %d, delta %.1f\n", raw_per_pkt, (double)n / blocks);
+  printf("encode:              %.1f ns/muestra\n", enc_ns / n);
+  printf("decode:              %.1f ns/muestra\n", dec_ns / n);
+  printf("errores round-trip:  %zu\n", mismatches);
+
+  free(block);
+  free(trace);
+  return mismatches ? 2 : 0;
+}
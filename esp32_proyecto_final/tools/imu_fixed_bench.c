@@ -0,0 +1,204 @@
+// imu_fixed_bench.c
+// Prueba y benchmark en host de la conversión IMU en punto fijo
+// (main/utils/imu_fixed.c) frente a la referencia en float del firmware.
+//
+// Uso: imu_fixed_bench [muestras]
+//   muestras: tamaño de la traza aleatoria del benchmark (por defecto 1e6).
+//
+// Exactitud: para cada fondo de escala y unidad, varias matrices de ejes y
+// offsets, recorre los 65536 valores crudos de cada eje y compara
+//  - punto fijo con el entero más cercano al valor exacto (double): debe
+//    coincidir siempre (y saturar fuera de int16);
+//  - punto fijo con la referencia float (lrintf(x * 100) como hacía
+//    mpu_convert + mpu_to_compact): solo puede diferir en 1 LSB donde el
+//    propio float redondea mal, con el valor exacto a menos de unos
+//    FLT_EPSILON relativos de .5;
+//  - imu_fixed_set_offset con los mismos offsets deja el mismo sesgo.
+// Sale con 2 si algo de lo anterior falla.
+
+#include "imu_fixed.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define G_TO_MS2  9.80665f
+
+/* Cerca de .5 el float (24 bits de mantisa) puede redondear al otro lado:
+ * unas pocas operaciones con error relativo de FLT_EPSILON / 2 cada una */
+#define TIE_TOL(x) (4.0 * FLT_EPSILON * fabs(x))
+
+typedef struct {
+  size_t checked;
+  size_t saturated;       /* valor exacto fuera de int16 */
+  size_t exact_errors;    /* punto fijo != entero más cercano: fallo */
+  size_t float_diffs;     /* float != punto fijo, con el exacto junto a .5 */
+  size_t float_errors;    /* float != punto fijo en otro caso: fallo */
+  double worst_tie;       /* mayor distancia a .5 de las float_diffs */
+} check_t;
+
+static double now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+/* Referencia: las mismas operaciones float que hacía el firmware */
+static float ref_axis(const imu_fixed_config_t *cfg, int gyro, int32_t d) {
+  if (gyro) {
+    float dps = (float)d / imu_fixed_gyro_lsb(cfg->gyro_fs);
+    return (cfg->gyro_unit == IMU_GYRO_MRADS) ? dps * (float)(M_PI / 180.0) * 1000.0f
+                                              : dps * 100.0f;
+  }
+  float g = (float)d / imu_fixed_accel_lsb(cfg->accel_fs);
+  return (cfg->accel_unit == IMU_ACCEL_MG) ? g * 1000.0f : g * G_TO_MS2 * 100.0f;
+}
+
+static void ref_convert(const imu_fixed_config_t *cfg, const int16_t off[IMU_FIXED_AXES],
+                        const uint8_t *raw, int16_t out[IMU_FIXED_AXES]) {
+  static const uint8_t pos[IMU_FIXED_AXES] = {0, 2, 4, 8, 10, 12};
+  int32_t d[IMU_FIXED_AXES];
+  for (int a = 0; a < IMU_FIXED_AXES; a++) {
+    d[a] = (int16_t)((raw[pos[a]] << 8) | raw[pos[a] + 1]) - off[a];
+  }
+  for (int i = 0; i < IMU_FIXED_AXES; i++) {
+    int8_t ax = cfg->axis[i % 3];
+    int src = 3 * (i / 3) + abs(ax) - 1;
+    float v = ref_axis(cfg, i / 3, ax < 0 ? -d[src] : d[src]);
+    out[i] = (int16_t)lrintf(v);
+  }
+}
+
+static void put_raw(uint8_t *raw, int16_t v) {
+  static const uint8_t pos[IMU_FIXED_AXES] = {0, 2, 4, 8, 10, 12};
+  for (int a = 0; a < IMU_FIXED_AXES; a++) {
+    raw[pos[a]] = (uint8_t)((uint16_t)v >> 8);
+    raw[pos[a] + 1] = (uint8_t)v;
+  }
+}
+
+static void check_config(const imu_fixed_config_t *cfg, const int16_t off[IMU_FIXED_AXES],
+                         check_t *c) {
+  imu_fixed_t fx;
+  if (imu_fixed_init(&fx, cfg, off) != 0) {
+    fprintf(stderr, "configuración rechazada\n");
+    exit(1);
+  }
+  /* imu_fixed_set_offset con offsets enteros debe dejarlo idéntico */
+  imu_fixed_t fx2;
+  imu_fixed_init(&fx2, cfg, NULL);
+  for (int a = 0; a < IMU_FIXED_AXES; a++) imu_fixed_set_offset(&fx2, a, off[a] * 256);
+  if (memcmp(fx.bias, fx2.bias, sizeof(fx.bias)) != 0) c->exact_errors++;
+
+  double scale[2] = {imu_fixed_scale(cfg, 0), imu_fixed_scale(cfg, 1)};
+
+  uint8_t raw[IMU_FIXED_RAW_LEN] = {0};
+  for (int32_t v = INT16_MIN; v <= INT16_MAX; v++) {
+    int16_t fixed[IMU_FIXED_AXES], ref[IMU_FIXED_AXES];
+    put_raw(raw, (int16_t)v);
+    imu_fixed_convert(&fx, raw, fixed);
+    ref_convert(cfg, off, raw, ref);
+
+    for (int i = 0; i < IMU_FIXED_AXES; i++) {
+      int8_t ax = cfg->axis[i % 3];
+      int src = 3 * (i / 3) + abs(ax) - 1;
+      double exact = (double)(v - off[src]) * (ax < 0 ? -1 : 1) * scale[i / 3];
+      double r = nearbyint(exact);
+      c->checked++;
+
+      if (r > INT16_MAX || r < INT16_MIN) {
+        c->saturated++;
+        if (fixed[i] != (r > 0 ? INT16_MAX : INT16_MIN)) c->exact_errors++;
+        continue;
+      }
+      if (fixed[i] != (int16_t)r) c->exact_errors++;
+
+      if (ref[i] != fixed[i]) {
+        double tie = fabs(fabs(exact - floor(exact)) - 0.5);
+        if (abs(ref[i] - fixed[i]) == 1 && tie <= TIE_TOL(exact)) {
+          c->float_diffs++;
+          if (tie > c->worst_tie) c->worst_tie = tie;
+        } else {
+          c->float_errors++;
+        }
+      }
+    }
+  }
+}
+
+static void bench(size_t n) {
+  const imu_fixed_config_t cfg = {
+    .accel_fs = IMU_ACCEL_FS_2G, .gyro_fs = IMU_GYRO_FS_250,
+    .accel_unit = IMU_ACCEL_CMS2, .gyro_unit = IMU_GYRO_CDPS,
+    .axis = {2, 1, 3},
+  };
+  const int16_t off[IMU_FIXED_AXES] = {-120, 85, -16384 + 240, 31, -12, 7};
+  imu_fixed_t fx;
+  imu_fixed_init(&fx, &cfg, off);
+
+  uint8_t *trace = malloc(n * IMU_FIXED_RAW_LEN);
+  srand(1234);
+  for (size_t i = 0; i < n * IMU_FIXED_RAW_LEN; i++) trace[i] = (uint8_t)rand();
+
+  int16_t out[IMU_FIXED_AXES];
+  volatile int32_t sink = 0;
+
+  double t0 = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    imu_fixed_convert(&fx, &trace[i * IMU_FIXED_RAW_LEN], out);
+    sink += out[0] + out[5];
+  }
+  double fixed_ns = (now_ns() - t0) / n;
+
+  t0 = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    ref_convert(&cfg, off, &trace[i * IMU_FIXED_RAW_LEN], out);
+    sink += out[0] + out[5];
+  }
+  double float_ns = (now_ns() - t0) / n;
+
+  printf("benchmark:           %zu muestras aleatorias\n", n);
+  printf("punto fijo:          %.1f ns/muestra\n", fixed_ns);
+  printf("float + lrintf:      %.1f ns/muestra (%.2fx)\n", float_ns, float_ns / fixed_ns);
+  (void)sink;
+  free(trace);
+}
+
+int main(int argc, char **argv) {
+  size_t n = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+
+  static const int8_t maps[][3] = {{1, 2, 3}, {2, 1, 3}, {-3, 1, -2}};
+  static const int16_t offs[][IMU_FIXED_AXES] = {
+    {0, 0, 0, 0, 0, 0},
+    {-120, 85, -16384 + 240, 31, -12, 7},
+    {1234, -4321, 2048, -300, 299, -1},
+  };
+
+  check_t c = {0};
+  for (int fs = 0; fs < 4; fs++) {
+    for (int unit = 0; unit < 2; unit++) {
+      for (size_t m = 0; m < sizeof(maps) / sizeof(maps[0]); m++) {
+        for (size_t o = 0; o < sizeof(offs) / sizeof(offs[0]); o++) {
+          imu_fixed_config_t cfg = {
+            .accel_fs = (uint8_t)fs, .gyro_fs = (uint8_t)fs,
+            .accel_unit = (uint8_t)unit, .gyro_unit = (uint8_t)unit,
+          };
+          memcpy(cfg.axis, maps[m], sizeof(cfg.axis));
+          check_config(&cfg, offs[o], &c);
+        }
+      }
+    }
+  }
+
+  printf("valores comprobados: %zu (%zu saturados)\n", c.checked, c.saturated);
+  printf("errores vs exacto:   %zu\n", c.exact_errors);
+  printf("difs. con float:     %zu (float mal redondeado junto a .5, a <= %.2g)\n",
+         c.float_diffs, c.worst_tie);
+  printf("errores vs float:    %zu\n", c.float_errors);
+
+  if (n > 0) bench(n);
+  return (c.exact_errors || c.float_errors) ? 2 : 0;
+}
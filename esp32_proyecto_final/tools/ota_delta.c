@@ -0,0 +1,375 @@
+// ota_delta.c
+// Generador en host de parches OTA delta (OTA_V2_FLAG_DELTA, formato en
+// main/utils/ota/ota_delta.h).
+//
+// Uso: ota_delta [-n] [-l nivel] base.bin nueva.bin [salida.otaz]
+//   base.bin:  imagen que está ejecutando el dispositivo (la que dio el
+//              app_elf_sha256 de OTA_V2_INFO_RSP)
+//   nueva.bin: imagen a instalar
+//   -n:        no comprimir el parche (por defecto va con deflate, ventana
+//              de 4 KB como ota_pack)
+//   -l:        nivel de zlib (por defecto 9)
+//
+// Formato de salida (contenedor de la app, v2):
+//   "OTAZ", u8 versión (2), u8 wbits, u8 flags de OTA_V2_BEGIN, u8 reservado,
+//   u32 tamaño de la imagen nueva (LE) y después el parche (comprimido o no).
+//   La v1 (ota_pack) es la misma cabecera con flags implícito = deflate.
+//
+// El parche se aplica aquí con el mismo ota_delta.c del firmware y se
+// compara con nueva.bin antes de escribirlo.
+
+#include "ota_delta.h"
+
+#include <openssl/sha.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define OTA_DEFLATE_WBITS   12     /* = ota.h */
+#define OTA_V2_FLAG_DEFLATE 0x01
+#define OTA_V2_FLAG_DELTA   0x02
+
+/* esp_image_header_t (24) + esp_image_segment_header_t (8) y, dentro de
+ * esp_app_desc_t, el offset de app_elf_sha256 */
+#define APP_DESC_OFFSET     32
+#define APP_DESC_MAGIC      0xABCD5432u
+#define APP_DESC_ELF_SHA    144
+
+#define KEY_LEN      8             /* bytes que indexan la base */
+#define HASH_BITS    20
+#define BUCKET_WAYS  4
+#define MIN_MATCH    32            /* coincidencia exacta para cambiar de alineación */
+#define MAX_MISS     64            /* bytes seguidos sin coincidir: fin de ADD */
+
+typedef struct {
+  uint8_t *p;
+  size_t len, cap;
+} buf_t;
+
+static void buf_put(buf_t *b, const void *src, size_t len) {
+  if (b->len + len > b->cap) {
+    b->cap = (b->cap ? b->cap * 2 : 4096) + len;
+    b->p = realloc(b->p, b->cap);
+    if (!b->p) {
+      fprintf(stderr, "sin memoria\n");
+      exit(1);
+    }
+  }
+  memcpy(b->p + b->len, src, len);
+  b->len += len;
+}
+
+static void buf_u32(buf_t *b, uint32_t v) {
+  uint8_t p[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+  buf_put(b, p, 4);
+}
+
+static uint8_t *load(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  long n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = malloc(n > 0 ? (size_t)n : 1);
+  if (!buf || fread(buf, 1, (size_t)n, f) != (size_t)n) {
+    fprintf(stderr, "%s: lectura fallida\n", path);
+    exit(1);
+  }
+  fclose(f);
+  *len = (size_t)n;
+  return buf;
+}
+
+static uint32_t key_hash(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return (uint32_t)((v * 0x9E3779B97F4A7C15ull) >> (64 - HASH_BITS));
+}
+
+/* ============================
+   Generación del parche
+   ============================ */
+
+typedef struct {
+  const uint8_t *old;
+  size_t old_len;
+  const uint8_t *new_;
+  size_t new_len;
+  int32_t *index;        /* (1 << HASH_BITS) * BUCKET_WAYS posiciones, -1 = vacío */
+  buf_t out;
+  size_t n_copy, n_add, n_data;
+} gen_t;
+
+static void build_index(gen_t *g) {
+  size_t slots = (size_t)BUCKET_WAYS << HASH_BITS;
+  g->index = malloc(slots * sizeof(int32_t));
+  memset(g->index, 0xFF, slots * sizeof(int32_t));
+  /* de atrás hacia delante: en cada cubo quedan las posiciones más bajas */
+  for (size_t i = g->old_len >= KEY_LEN ? g->old_len - KEY_LEN + 1 : 0; i-- > 0; ) {
+    int32_t *b = &g->index[(size_t)key_hash(g->old + i) * BUCKET_WAYS];
+    memmove(b + 1, b, (BUCKET_WAYS - 1) * sizeof(int32_t));
+    b[0] = (int32_t)i;
+  }
+}
+
+static size_t match_len(const gen_t *g, size_t old_off, size_t new_off) {
+  size_t n = 0;
+  while (old_off + n < g->old_len && new_off + n < g->new_len &&
+         g->old[old_off + n] == g->new_[new_off + n]) {
+    n++;
+  }
+  return n;
+}
+
+static void emit_op(gen_t *g, uint8_t op, size_t src, size_t s, size_t len) {
+  buf_put(&g->out, &op, 1);
+  if (op != OTA_DELTA_OP_DATA) buf_u32(&g->out, (uint32_t)src);
+  buf_u32(&g->out, (uint32_t)len);
+
+  if (op == OTA_DELTA_OP_COPY) {
+    g->n_copy += len;
+  } else if (op == OTA_DELTA_OP_DATA) {
+    buf_put(&g->out, g->new_ + s, len);
+    g->n_data += len;
+  } else {
+    for (size_t i = 0; i < len; i++) {
+      uint8_t diff = (uint8_t)(g->new_[s + i] - g->old[src + i]);
+      buf_put(&g->out, &diff, 1);
+    }
+    g->n_add += len;
+  }
+}
+
+/* Tramo [s, e) de la imagen nueva: literal, o alineado con la base. En un
+ * tramo alineado los trozos idénticos de al menos COPY_MIN bytes van como
+ * COPY y el resto como ADD (así el parche es pequeño también sin deflate). */
+#define COPY_MIN 16
+
+static void emit_run(gen_t *g, size_t s, size_t e, int aligned, long d) {
+  if (e <= s) return;
+  if (!aligned) {
+    emit_op(g, OTA_DELTA_OP_DATA, 0, s, e - s);
+    return;
+  }
+
+  size_t add = s;           /* inicio del ADD pendiente */
+  size_t i = s;
+  while (i < e) {
+    size_t src = (size_t)((long)i + d);
+    size_t n = 0;
+    while (i + n < e && g->old[src + n] == g->new_[i + n]) n++;
+    if (n >= COPY_MIN) {
+      if (i > add) emit_op(g, OTA_DELTA_OP_ADD, (size_t)((long)add + d), add, i - add);
+      emit_op(g, OTA_DELTA_OP_COPY, src, i, n);
+      add = i + n;
+    }
+    i += n ? n : 1;
+  }
+  if (e > add) emit_op(g, OTA_DELTA_OP_ADD, (size_t)((long)add + d), add, e - add);
+}
+
+/* Estilo bsdiff simplificado: se sigue la alineación actual mientras haya
+ * coincidencias cerca (las diferencias van en ADD) y se salta a otra cuando
+ * aparece una coincidencia exacta larga. */
+static void generate(gen_t *g) {
+  size_t pos = 0, run = 0, last_hit = 0;
+  int aligned = 0;
+  long d = 0;
+
+  while (pos < g->new_len) {
+    long src = (long)pos + d;
+    if (aligned && src >= 0 && (size_t)src < g->old_len && g->old[src] == g->new_[pos]) {
+      last_hit = pos++;
+      continue;
+    }
+
+    size_t best_len = 0, best_off = 0;
+    if (pos + KEY_LEN <= g->new_len) {
+      const int32_t *b = &g->index[(size_t)key_hash(g->new_ + pos) * BUCKET_WAYS];
+      for (int w = 0; w < BUCKET_WAYS && b[w] >= 0; w++) {
+        size_t n = match_len(g, (size_t)b[w], pos);
+        if (n > best_len) {
+          best_len = n;
+          best_off = (size_t)b[w];
+        }
+      }
+    }
+    if (best_len >= MIN_MATCH) {
+      emit_run(g, run, pos, aligned, d);
+      run = pos;
+      aligned = 1;
+      d = (long)best_off - (long)pos;
+      pos += best_len;
+      last_hit = pos - 1;
+      continue;
+    }
+
+    /* La alineación ya no aporta (o se sale de la base): literal desde aquí */
+    if (aligned && (pos - last_hit > MAX_MISS || src < 0 || (size_t)src >= g->old_len)) {
+      size_t end = last_hit + 1;
+      emit_run(g, run, end, 1, d);
+      run = end;
+      aligned = 0;
+    }
+    pos++;
+  }
+  emit_run(g, run, g->new_len, aligned, d);
+}
+
+/* ============================
+   Verificación (aplicador del firmware)
+   ============================ */
+
+typedef struct {
+  const uint8_t *old;
+  buf_t out;
+} apply_ctx_t;
+
+static int apply_read(void *ctx, uint32_t off, uint8_t *dst, size_t len) {
+  apply_ctx_t *a = ctx;
+  memcpy(dst, a->old + off, len);
+  return 0;
+}
+
+static int apply_write(void *ctx, const uint8_t *src, size_t len) {
+  buf_put(&((apply_ctx_t *)ctx)->out, src, len);
+  return 0;
+}
+
+static int verify(const uint8_t *patch, size_t len, const uint8_t *old, size_t old_len,
+                  const uint8_t base_sha[32], const uint8_t *new_, size_t new_len) {
+  static ota_delta_t d;
+  apply_ctx_t a = { .old = old };
+  ota_delta_init(&d, base_sha, (uint32_t)old_len, apply_read, apply_write, &a);
+
+  /* en trozos irregulares, como llegan las tramas */
+  ota_delta_err_t err = OTA_DELTA_OK;
+  for (size_t off = 0, step = 1; off < len && err == OTA_DELTA_OK; step = step * 7 % 509 + 1) {
+    size_t n = (len - off > step) ? step : len - off;
+    err = ota_delta_feed(&d, patch + off, n);
+    off += n;
+  }
+  int ok = err == OTA_DELTA_OK && ota_delta_idle(&d) && a.out.len == new_len &&
+           memcmp(a.out.p, new_, new_len) == 0;
+  free(a.out.p);
+  return ok ? 0 : -1;
+}
+
+static size_t deflate_buf(const uint8_t *in, size_t len, int level, uint8_t **out) {
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, level, Z_DEFLATED, OTA_DEFLATE_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    fprintf(stderr, "deflateInit2 falló\n");
+    exit(1);
+  }
+  size_t cap = deflateBound(&z, len);
+  *out = malloc(cap);
+  z.next_in = (Bytef *)in;
+  z.avail_in = (uInt)len;
+  z.next_out = *out;
+  z.avail_out = (uInt)cap;
+  if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+    fprintf(stderr, "deflate falló\n");
+    exit(1);
+  }
+  size_t n = z.total_out;
+  deflateEnd(&z);
+  return n;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Uso: ota_delta [-n] [-l nivel] base.bin nueva.bin [salida.otaz]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int compress = 1, level = 9, c;
+  while ((c = getopt(argc, argv, "nl:")) != -1) {
+    switch (c) {
+      case 'n': compress = 0; break;
+      case 'l': level = atoi(optarg); break;
+      default: usage();
+    }
+  }
+  if (argc - optind < 2) usage();
+
+  gen_t g;
+  memset(&g, 0, sizeof(g));
+  uint8_t *old = load(argv[optind], &g.old_len);
+  uint8_t *new_ = load(argv[optind + 1], &g.new_len);
+  g.old = old;
+  g.new_ = new_;
+
+  uint32_t magic = 0;
+  if (g.old_len < APP_DESC_OFFSET + APP_DESC_ELF_SHA + 32 ||
+      (memcpy(&magic, old + APP_DESC_OFFSET, 4), magic != APP_DESC_MAGIC)) {
+    fprintf(stderr, "%s: no parece una imagen de app ESP-IDF (sin esp_app_desc_t)\n",
+            argv[optind]);
+    return 1;
+  }
+  const uint8_t *base_sha = old + APP_DESC_OFFSET + APP_DESC_ELF_SHA;
+
+  /* Cabecera del parche */
+  uint8_t hdr[OTA_DELTA_HDR_LEN] = { 0 };
+  memcpy(hdr, OTA_DELTA_MAGIC, 4);
+  hdr[4] = OTA_DELTA_VERSION;
+  memcpy(&hdr[OTA_DELTA_SHA_BASE], base_sha, 32);
+  SHA256(new_, g.new_len, &hdr[OTA_DELTA_SHA_NEW]);
+  buf_put(&g.out, hdr, sizeof(hdr));
+
+  build_index(&g);
+  generate(&g);
+
+  if (verify(g.out.p, g.out.len, old, g.old_len, base_sha, new_, g.new_len) != 0) {
+    fprintf(stderr, "El parche no reproduce la imagen nueva\n");
+    return 1;
+  }
+
+  uint8_t *z = NULL, *z_full = NULL;
+  size_t z_len = compress ? deflate_buf(g.out.p, g.out.len, level, &z) : 0;
+  size_t z_full_len = deflate_buf(new_, g.new_len, level, &z_full);
+
+  printf("base:          %zu B\n", g.old_len);
+  printf("nueva:         %zu B (comprimida entera: %zu B)\n", g.new_len, z_full_len);
+  printf("parche:        %zu B (COPY %zu B, ADD %zu B, DATA %zu B)\n", g.out.len,
+         g.n_copy, g.n_add, g.n_data);
+  if (compress) {
+    printf("comprimido:    %zu B (%.1f %% de la imagen, %.1f %% de la imagen comprimida)\n",
+           z_len, 100.0 * (double)z_len / (double)g.new_len,
+           100.0 * (double)z_len / (double)z_full_len);
+  }
+
+  if (argc - optind > 2) {
+    const char *path = argv[optind + 2];
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+      perror(path);
+      return 1;
+    }
+    uint8_t flags = OTA_V2_FLAG_DELTA | (compress ? OTA_V2_FLAG_DEFLATE : 0);
+    uint8_t ch[12] = { 'O', 'T', 'A', 'Z', 2, OTA_DEFLATE_WBITS, flags, 0,
+                       (uint8_t)g.new_len, (uint8_t)(g.new_len >> 8),
+                       (uint8_t)(g.new_len >> 16), (uint8_t)(g.new_len >> 24) };
+    const uint8_t *body = compress ? z : g.out.p;
+    size_t body_len = compress ? z_len : g.out.len;
+    if (fwrite(ch, 1, sizeof(ch), f) != sizeof(ch) || fwrite(body, 1, body_len, f) != body_len) {
+      fprintf(stderr, "%s: escritura fallida\n", path);
+      return 1;
+    }
+    fclose(f);
+    printf("escrito %s (%zu B)\n", path, body_len + sizeof(ch));
+  }
+
+  free(old);
+  free(new_);
+  free(g.index);
+  free(g.out.p);
+  free(z);
+  free(z_full);
+  return 0;
+}
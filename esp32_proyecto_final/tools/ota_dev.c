@@ -0,0 +1,111 @@
+// ota_dev.c
+// Dispositivo de pruebas para OTA v2: el mismo main/utils/ota/ota.c del
+// firmware compilado en host (ota_host/), con la partición de actualización
+// en un fichero y el enlace BLE sustituido por stdin/stdout. Lo lanza
+// ota_send -x; también sirve cualquier otro transporte con el mismo framing.
+//
+// Uso: ota_dev [-f flash.bin] [-b base.bin] [-s bytes] [-E µs] [-W µs] [-v]
+//   -f: fichero de la partición ota_0 (por defecto ota_flash.bin); el NVS
+//       (checkpoint de reanudación) va en <fichero>.nvs
+//   -b: imagen en ejecución, base de los parches delta (por defecto vacía)
+//   -s: tamaño de partición (por defecto 0x140000, como partitions.csv)
+//   -E: µs por sector de 4 KB borrado (por defecto 0)
+//   -W: µs por KB escrito (por defecto 0). Para parecerse al ESP32, sacar
+//       ambos de lo que mide "BLE_OTA_TEST" en el dispositivo real.
+//   -v: logs de ota.c hasta nivel info (-vv debug)
+//
+// Framing en ambos sentidos: u16 longitud (LE) + trama OTA v2. El hilo
+// principal hace de tarea del host BLE (ota_process_frame); la escritora es
+// otro hilo. Al cerrarse stdin se llama a ota_link_lost(), como al
+// desconectarse el cliente; tras un OTA_V2_END correcto el proceso termina
+// en esp_restart().
+
+#include "ota.h"
+#include "ota_host.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FRAME_MAX  1024
+
+extern int ota_host_log_level;
+
+static pthread_mutex_t s_out_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int read_full(int fd, uint8_t *p, size_t len) {
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n <= 0) return -1;
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+/* Respuestas desde el hilo receptor y desde la escritora: una sola write()
+ * por trama para que no se intercalen */
+static void send_reply(const uint8_t *data, size_t len) {
+  uint8_t buf[2 + FRAME_MAX];
+  if (len > FRAME_MAX) return;
+  buf[0] = (uint8_t)(len & 0xFF);
+  buf[1] = (uint8_t)(len >> 8);
+  memcpy(&buf[2], data, len);
+  pthread_mutex_lock(&s_out_lock);
+  ssize_t n = write(STDOUT_FILENO, buf, len + 2);
+  pthread_mutex_unlock(&s_out_lock);
+  (void)n;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Uso: ota_dev [-f flash.bin] [-b base.bin] [-s bytes] [-E µs] [-W µs] [-v]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  ota_host_cfg_t cfg = {
+    .flash_path = "ota_flash.bin",
+    .part_size = 0x140000,
+  };
+  int c;
+
+  while ((c = getopt(argc, argv, "f:b:s:E:W:v")) != -1) {
+    switch (c) {
+      case 'f': cfg.flash_path = optarg; break;
+      case 'b': cfg.base_path = optarg; break;
+      case 's': cfg.part_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'E': cfg.erase_us = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 'W': cfg.write_us_per_kib = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 'v': ota_host_log_level++; break;
+      default: usage();
+    }
+  }
+  if (optind != argc || cfg.part_size == 0 || cfg.part_size % 4096) usage();
+
+  signal(SIGPIPE, SIG_IGN);
+  if (ota_host_init(&cfg) != 0 || ota_init() != ESP_OK) return 1;
+  ota_set_reply_cb(send_reply);
+
+  uint8_t frame[FRAME_MAX];
+  for (;;) {
+    uint8_t hdr[2];
+    if (read_full(STDIN_FILENO, hdr, sizeof(hdr)) != 0) break;
+    size_t len = hdr[0] | ((size_t)hdr[1] << 8);
+    if (len > sizeof(frame) || read_full(STDIN_FILENO, frame, len) != 0) break;
+    ota_process_frame(frame, len);
+  }
+
+  /* Enlace cerrado */
+  ota_link_lost();
+  size_t written = 0;
+  esp_err_t err = ota_wait_idle(10000, &written);
+  ota_host_stats_t st;
+  ota_host_stats(&st);
+  fprintf(stderr, "ota_dev: %zu B en la sesión, %llu B escritos, %u sectores borrados%s%s\n",
+          written, (unsigned long long)st.bytes_written, (unsigned)st.sectors_erased,
+          st.boot_set ? ", arranque cambiado" : "", err == ESP_OK ? "" : " (fallo)");
+  return 0;
+}
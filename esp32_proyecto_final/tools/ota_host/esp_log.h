@@ -0,0 +1,15 @@
+#pragma once
+#include <stdio.h>
+
+/* 0 = solo errores, 1 = + avisos, 2 = + info (ota_dev -v) */
+extern int ota_host_log_level;
+
+#define OTA_HOST_LOG(lvl, c, tag, fmt, ...)                                   \
+  do {                                                                        \
+    if (ota_host_log_level >= (lvl)) fprintf(stderr, c " %s: " fmt "\n", tag, ##__VA_ARGS__); \
+  } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) OTA_HOST_LOG(0, "E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) OTA_HOST_LOG(1, "W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) OTA_HOST_LOG(2, "I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) OTA_HOST_LOG(3, "D", tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,23 @@
+#pragma once
+// FreeRTOS sobre pthreads: tick de 1 ms, secciones críticas con mutex.
+#include <pthread.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE             0
+#define pdTRUE              1
+#define pdPASS              1
+#define portMAX_DELAY       0xffffffffu
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+typedef struct {
+  pthread_mutex_t m;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED  { PTHREAD_MUTEX_INITIALIZER }
+#define portENTER_CRITICAL(mux)       pthread_mutex_lock(&(mux)->m)
+#define portEXIT_CRITICAL(mux)        pthread_mutex_unlock(&(mux)->m)
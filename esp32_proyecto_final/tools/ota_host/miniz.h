@@ -0,0 +1,29 @@
+#pragma once
+// tinfl de la ROM del ESP32 sobre zlib: mismo contrato (ventana circular
+// del llamador, NEEDS_MORE_INPUT / HAS_MORE_OUTPUT), otra implementación.
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+
+typedef enum {
+  TINFL_STATUS_BAD_PARAM = -3,
+  TINFL_STATUS_ADLER32_MISMATCH = -2,
+  TINFL_STATUS_FAILED = -1,
+  TINFL_STATUS_DONE = 0,
+  TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+  TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+#define TINFL_FLAG_PARSE_ZLIB_HEADER  1
+#define TINFL_FLAG_HAS_MORE_INPUT     2
+
+typedef struct {
+  z_stream z;
+} tinfl_decompressor;
+
+/* tinfl no tiene free: el estado de zlib de cada sesión comprimida se pierde
+ * (una por proceso en la práctica, el "dispositivo" se reinicia al acabar) */
+void tinfl_init(tinfl_decompressor *r);
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *in, size_t *in_n,
+                              uint8_t *out_start, uint8_t *out_next, size_t *out_n,
+                              uint32_t flags);
@@ -0,0 +1,551 @@
+// ota_host.c
+// Implementación en host de las APIs de ESP-IDF / FreeRTOS que usa
+// main/utils/ota/ota.c (ver ota_host.h). Solo lo necesario para que el
+// mismo ota.c corra en Linux con un comportamiento de flash parecido:
+//  - esp_ota_write exige 0xE9 como primer byte, igual que ESP-IDF.
+//  - Escribir solo baja bits (AND con lo que hay): escribir sobre un sector
+//    sin borrar deja basura, como en la flash real.
+//  - esp_ota_begin con tamaño borra por adelantado; esp_ota_resume con
+//    OTA_WITH_SEQUENTIAL_WRITES borra sector a sector según avanza.
+//  - esp_ota_end no valida la imagen (no hay bootloader que la lea).
+
+#include "ota_host.h"
+
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+#include "miniz.h"
+#include "nvs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SECTOR            4096
+#define APP_DESC_OFFSET   32          /* = tools/ota_delta.c */
+#define APP_DESC_MAGIC    0xABCD5432u
+#define APP_DESC_ELF_SHA  144
+
+int ota_host_log_level = 1;
+
+static const char *TAG = "OTA_HOST";
+static ota_host_cfg_t s_cfg;
+static ota_host_stats_t s_stats;
+static int s_flash_fd = -1;
+static uint8_t *s_base;
+static esp_app_desc_t s_app_desc;
+
+/* Como partitions.csv: factory en ejecución, ota_0 de actualización */
+static esp_partition_t s_running = { .address = 0x20000, .label = "factory" };
+static esp_partition_t s_update = { .address = 0x160000, .label = "ota_0" };
+
+/* ============================
+   Tiempo
+   ============================ */
+
+static int64_t now_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static int64_t s_t0_us;
+
+int64_t esp_timer_get_time(void) {
+  return now_us() - s_t0_us;
+}
+
+static void sleep_us(int64_t us) {
+  if (us <= 0) return;
+  struct timespec t = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+  while (nanosleep(&t, &t) != 0 && errno == EINTR) {
+  }
+}
+
+/* El coste simulado de flash se acumula y se duerme por encima de 1 ms:
+ * nanosleep no sirve para esperas de pocos µs por escritura */
+static int64_t s_flash_debt_us;
+
+static void flash_cost(int64_t us) {
+  s_flash_debt_us += us;
+  if (s_flash_debt_us < 1000) return;
+  int64_t t0 = now_us();
+  sleep_us(s_flash_debt_us);
+  s_flash_debt_us -= now_us() - t0;
+}
+
+/* ============================
+   Errores, reinicio, heap
+   ============================ */
+
+const char *esp_err_to_name(esp_err_t err) {
+  switch (err) {
+    case ESP_OK:                      return "ESP_OK";
+    case ESP_FAIL:                    return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:              return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:         return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:       return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:           return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:             return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+    case ESP_ERR_NVS_NOT_FOUND:       return "ESP_ERR_NVS_NOT_FOUND";
+    default:                          return "ESP_ERR_?";
+  }
+}
+
+void esp_restart(void) {
+  ESP_LOGI(TAG, "esp_restart(): fin del proceso.");
+  exit(0);
+}
+
+/* ============================
+   Tareas
+   ============================ */
+
+struct ota_host_task {
+  pthread_t th;
+  pthread_mutex_t m;
+  pthread_cond_t c;
+  uint32_t notify;
+  TaskFunction_t fn;
+  void *arg;
+};
+
+static _Thread_local struct ota_host_task *s_self;
+
+static void *task_main(void *p) {
+  s_self = p;
+  s_self->fn(s_self->arg);
+  return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack,
+                                   void *arg, UBaseType_t prio, TaskHandle_t *out,
+                                   BaseType_t core) {
+  struct ota_host_task *t = calloc(1, sizeof(*t));
+  if (!t) return pdFALSE;
+  pthread_mutex_init(&t->m, NULL);
+  pthread_cond_init(&t->c, NULL);
+  t->fn = fn;
+  t->arg = arg;
+  if (out) *out = t;
+  if (pthread_create(&t->th, NULL, task_main, t) != 0) {
+    free(t);
+    if (out) *out = NULL;
+    return pdFALSE;
+  }
+  pthread_detach(t->th);
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+  struct ota_host_task *t = s_self;
+  struct timespec until;
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += ticks / 1000;
+  until.tv_nsec += (long)(ticks % 1000) * 1000000;
+  if (until.tv_nsec >= 1000000000) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&t->m);
+  while (t->notify == 0) {
+    if (ticks == portMAX_DELAY) {
+      pthread_cond_wait(&t->c, &t->m);
+    } else if (pthread_cond_timedwait(&t->c, &t->m, &until) != 0) {
+      break;
+    }
+  }
+  uint32_t v = t->notify;
+  if (v) t->notify = clear ? 0 : v - 1;
+  pthread_mutex_unlock(&t->m);
+  return v;
+}
+
+void xTaskNotifyGive(TaskHandle_t t) {
+  pthread_mutex_lock(&t->m);
+  t->notify++;
+  pthread_cond_signal(&t->c);
+  pthread_mutex_unlock(&t->m);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  sleep_us((int64_t)ticks * 1000);
+}
+
+/* ============================
+   Particiones y OTA
+   ============================ */
+
+static struct {
+  bool open;
+  esp_ota_handle_t id;
+  size_t wrote;
+  size_t erased_to;       /* [0, erased_to) borrado en esta sesión */
+  bool sequential;        /* borrar sector a sector al escribir */
+} s_ota;
+
+static esp_ota_handle_t s_next_handle = 1;
+
+static esp_err_t erase_range(size_t from, size_t to) {
+  static uint8_t ff[SECTOR];
+  memset(ff, 0xFF, sizeof(ff));
+  for (size_t off = from; off < to; off += SECTOR) {
+    if (pwrite(s_flash_fd, ff, SECTOR, (off_t)off) != SECTOR) return ESP_FAIL;
+    s_stats.sectors_erased++;
+    flash_cost(s_cfg.erase_us);
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t off, void *dst, size_t len) {
+  if (off > part->size || len > part->size - off) return ESP_ERR_INVALID_SIZE;
+  if (part == &s_running) {
+    memcpy(dst, s_base + off, len);
+    return ESP_OK;
+  }
+  return pread(s_flash_fd, dst, len, (off_t)off) == (ssize_t)len ? ESP_OK : ESP_FAIL;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start) {
+  return (s_flash_fd >= 0) ? &s_update : NULL;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+  return &s_running;
+}
+
+static esp_err_t ota_open(const esp_partition_t *part, esp_ota_handle_t *out) {
+  if (part != &s_update) return ESP_ERR_INVALID_ARG;
+  memset(&s_ota, 0, sizeof(s_ota));
+  s_ota.open = true;
+  s_ota.id = s_next_handle++;
+  *out = s_ota.id;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *part, size_t image_size, esp_ota_handle_t *out) {
+  esp_err_t err = ota_open(part, out);
+  if (err != ESP_OK) return err;
+  if (image_size == OTA_WITH_SEQUENTIAL_WRITES) {
+    s_ota.sequential = true;
+    return ESP_OK;
+  }
+  if (image_size != OTA_SIZE_UNKNOWN && image_size > part->size) return ESP_ERR_INVALID_SIZE;
+  size_t to = (image_size == OTA_SIZE_UNKNOWN) ? part->size
+                                               : (image_size + SECTOR - 1) & ~(size_t)(SECTOR - 1);
+  s_ota.erased_to = to;
+  return erase_range(0, to);
+}
+
+esp_err_t esp_ota_resume(const esp_partition_t *part, size_t erase_size, size_t offset,
+                         esp_ota_handle_t *out) {
+  if (offset > part->size) return ESP_ERR_INVALID_SIZE;
+  esp_err_t err = ota_open(part, out);
+  if (err != ESP_OK) return err;
+  /* lo ya escrito se conserva; un sector a medias no se vuelve a borrar */
+  s_ota.wrote = offset;
+  s_ota.erased_to = (offset + SECTOR - 1) & ~(size_t)(SECTOR - 1);
+  s_ota.sequential = erase_size == OTA_WITH_SEQUENTIAL_WRITES;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t h, const void *data, size_t size) {
+  if (!s_ota.open || h != s_ota.id) return ESP_ERR_INVALID_ARG;
+  const uint8_t *p = data;
+  if (s_ota.wrote == 0 && size > 0 && p[0] != 0xE9) return ESP_ERR_OTA_VALIDATE_FAILED;
+  if (size > s_update.size - s_ota.wrote) return ESP_ERR_INVALID_SIZE;
+
+  if (s_ota.sequential && s_ota.wrote + size > s_ota.erased_to) {
+    size_t to = (s_ota.wrote + size + SECTOR - 1) & ~(size_t)(SECTOR - 1);
+    if (erase_range(s_ota.erased_to, to) != ESP_OK) return ESP_FAIL;
+    s_ota.erased_to = to;
+  }
+
+  uint8_t cur[512];
+  for (size_t done = 0; done < size; ) {
+    size_t n = (size - done > sizeof(cur)) ? sizeof(cur) : size - done;
+    off_t off = (off_t)(s_ota.wrote + done);
+    if (pread(s_flash_fd, cur, n, off) != (ssize_t)n) return ESP_FAIL;
+    for (size_t i = 0; i < n; i++) cur[i] &= p[done + i];
+    if (pwrite(s_flash_fd, cur, n, off) != (ssize_t)n) return ESP_FAIL;
+    done += n;
+  }
+  s_ota.wrote += size;
+  s_stats.bytes_written += size;
+  flash_cost((int64_t)s_cfg.write_us_per_kib * (int64_t)size / 1024);
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t h) {
+  if (!s_ota.open || h != s_ota.id) return ESP_ERR_INVALID_ARG;
+  s_ota.open = false;
+  return s_ota.wrote ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t h) {
+  if (!s_ota.open || h != s_ota.id) return ESP_ERR_INVALID_ARG;
+  s_ota.open = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *part) {
+  if (part != &s_update) return ESP_ERR_INVALID_ARG;
+  fsync(s_flash_fd);
+  s_stats.boot_set = true;
+  ESP_LOGI(TAG, "Partición de arranque: %s", part->label);
+  return ESP_OK;
+}
+
+const esp_app_desc_t *esp_app_get_description(void) {
+  return &s_app_desc;
+}
+
+/* ============================
+   NVS (tabla en memoria, volcada a fichero en nvs_commit)
+   ============================ */
+
+#define NVS_ENTRIES  8
+#define NVS_HANDLES  4
+#define NVS_NAME     16
+#define NVS_VALUE    64
+
+typedef struct {
+  char ns[NVS_NAME];
+  char key[NVS_NAME];
+  uint32_t len;           /* 0 = libre */
+  uint8_t value[NVS_VALUE];
+} nvs_entry_t;
+
+static nvs_entry_t s_nvs[NVS_ENTRIES];
+static char s_nvs_open[NVS_HANDLES][NVS_NAME];
+static char s_nvs_path[4096];
+static pthread_mutex_t s_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static nvs_entry_t *nvs_find(nvs_handle_t h, const char *key) {
+  for (int i = 0; i < NVS_ENTRIES; i++) {
+    if (s_nvs[i].len && strcmp(s_nvs[i].ns, s_nvs_open[h - 1]) == 0 &&
+        strcmp(s_nvs[i].key, key) == 0) {
+      return &s_nvs[i];
+    }
+  }
+  return NULL;
+}
+
+static bool nvs_handle_ok(nvs_handle_t h) {
+  return h >= 1 && h <= NVS_HANDLES && s_nvs_open[h - 1][0];
+}
+
+esp_err_t nvs_open(const char *ns, nvs_open_mode_t mode, nvs_handle_t *out) {
+  if (strlen(ns) >= NVS_NAME) return ESP_ERR_INVALID_ARG;
+  pthread_mutex_lock(&s_nvs_lock);
+  for (int i = 0; i < NVS_HANDLES; i++) {
+    if (!s_nvs_open[i][0]) {
+      strcpy(s_nvs_open[i], ns);
+      *out = (nvs_handle_t)(i + 1);
+      pthread_mutex_unlock(&s_nvs_lock);
+      return ESP_OK;
+    }
+  }
+  pthread_mutex_unlock(&s_nvs_lock);
+  return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t h, const char *key, void *out, size_t *len) {
+  esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+  pthread_mutex_lock(&s_nvs_lock);
+  nvs_entry_t *e = nvs_handle_ok(h) ? nvs_find(h, key) : NULL;
+  if (e) {
+    if (out && *len < e->len) {
+      err = ESP_ERR_INVALID_SIZE;
+    } else {
+      if (out) memcpy(out, e->value, e->len);
+      *len = e->len;
+      err = ESP_OK;
+    }
+  }
+  pthread_mutex_unlock(&s_nvs_lock);
+  return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t h, const char *key, const void *value, size_t len) {
+  if (len == 0 || len > NVS_VALUE || strlen(key) >= NVS_NAME) return ESP_ERR_INVALID_SIZE;
+  esp_err_t err = ESP_ERR_NO_MEM;
+  pthread_mutex_lock(&s_nvs_lock);
+  if (!nvs_handle_ok(h)) {
+    err = ESP_ERR_INVALID_ARG;
+  } else {
+    nvs_entry_t *e = nvs_find(h, key);
+    for (int i = 0; !e && i < NVS_ENTRIES; i++) {
+      if (!s_nvs[i].len) e = &s_nvs[i];
+    }
+    if (e) {
+      strcpy(e->ns, s_nvs_open[h - 1]);
+      strcpy(e->key, key);
+      memcpy(e->value, value, len);
+      e->len = (uint32_t)len;
+      err = ESP_OK;
+    }
+  }
+  pthread_mutex_unlock(&s_nvs_lock);
+  return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t h, const char *key) {
+  esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+  pthread_mutex_lock(&s_nvs_lock);
+  nvs_entry_t *e = nvs_handle_ok(h) ? nvs_find(h, key) : NULL;
+  if (e) {
+    memset(e, 0, sizeof(*e));
+    err = ESP_OK;
+  }
+  pthread_mutex_unlock(&s_nvs_lock);
+  return err;
+}
+
+esp_err_t nvs_commit(nvs_handle_t h) {
+  esp_err_t err = ESP_OK;
+  pthread_mutex_lock(&s_nvs_lock);
+  FILE *f = fopen(s_nvs_path, "wb");
+  if (!f || fwrite(s_nvs, sizeof(s_nvs), 1, f) != 1) err = ESP_FAIL;
+  if (f) fclose(f);
+  pthread_mutex_unlock(&s_nvs_lock);
+  return err;
+}
+
+void nvs_close(nvs_handle_t h) {
+  pthread_mutex_lock(&s_nvs_lock);
+  if (nvs_handle_ok(h)) s_nvs_open[h - 1][0] = '\0';
+  pthread_mutex_unlock(&s_nvs_lock);
+}
+
+/* ============================
+   SHA-256 (OpenSSL)
+   ============================ */
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx) {
+  ctx->md = EVP_MD_CTX_new();
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {
+  EVP_MD_CTX_free(ctx->md);
+  ctx->md = NULL;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224) {
+  return EVP_DigestInit_ex(ctx->md, is224 ? EVP_sha224() : EVP_sha256(), NULL) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *in, size_t len) {
+  return EVP_DigestUpdate(ctx->md, in, len) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char out[32]) {
+  return EVP_DigestFinal_ex(ctx->md, out, NULL) == 1 ? 0 : -1;
+}
+
+/* ============================
+   tinfl (zlib)
+   ============================ */
+
+void tinfl_init(tinfl_decompressor *r) {
+  memset(&r->z, 0, sizeof(r->z));
+  inflateInit(&r->z);                  /* ventana de 32 KB: admite la de 4 KB */
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *in, size_t *in_n,
+                              uint8_t *out_start, uint8_t *out_next, size_t *out_n,
+                              uint32_t flags) {
+  if (!(flags & TINFL_FLAG_PARSE_ZLIB_HEADER)) return TINFL_STATUS_BAD_PARAM;
+  r->z.next_in = (Bytef *)in;
+  r->z.avail_in = (uInt)*in_n;
+  r->z.next_out = out_next;
+  r->z.avail_out = (uInt)*out_n;
+  int rc = inflate(&r->z, Z_NO_FLUSH);
+  *in_n -= r->z.avail_in;
+  *out_n -= r->z.avail_out;
+
+  if (rc == Z_STREAM_END) return TINFL_STATUS_DONE;
+  if (rc == Z_DATA_ERROR) {
+    return (r->z.msg && strstr(r->z.msg, "check")) ? TINFL_STATUS_ADLER32_MISMATCH
+                                                   : TINFL_STATUS_FAILED;
+  }
+  if (rc != Z_OK && rc != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+  return r->z.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+/* ============================
+   Arranque
+   ============================ */
+
+int ota_host_init(const ota_host_cfg_t *cfg) {
+  s_cfg = *cfg;
+  s_t0_us = now_us();
+  s_running.size = s_update.size = cfg->part_size;
+
+  /* Imagen en ejecución: el resto de la partición queda borrado */
+  s_base = malloc(cfg->part_size);
+  if (!s_base) return -1;
+  memset(s_base, 0xFF, cfg->part_size);
+  if (cfg->base_path) {
+    FILE *f = fopen(cfg->base_path, "rb");
+    if (!f) {
+      perror(cfg->base_path);
+      return -1;
+    }
+    size_t n = fread(s_base, 1, cfg->part_size, f);
+    fclose(f);
+    const uint8_t *d = s_base + APP_DESC_OFFSET;
+    uint32_t magic = (uint32_t)d[0] | ((uint32_t)d[1] << 8) | ((uint32_t)d[2] << 16) |
+                     ((uint32_t)d[3] << 24);
+    if (n >= APP_DESC_OFFSET + APP_DESC_ELF_SHA + 32 && magic == APP_DESC_MAGIC) {
+      memcpy(s_app_desc.app_elf_sha256, d + APP_DESC_ELF_SHA, 32);
+    } else {
+      fprintf(stderr, "%s: sin descriptor de app, app_elf_sha256 = 0\n", cfg->base_path);
+    }
+  }
+
+  /* Partición de actualización: un fichero nuevo empieza borrado */
+  s_flash_fd = open(cfg->flash_path, O_RDWR | O_CREAT, 0644);
+  if (s_flash_fd < 0) {
+    perror(cfg->flash_path);
+    return -1;
+  }
+  off_t cur = lseek(s_flash_fd, 0, SEEK_END);
+  if (cur < (off_t)cfg->part_size) {
+    static uint8_t ff[SECTOR];
+    memset(ff, 0xFF, sizeof(ff));
+    for (off_t off = cur; off < (off_t)cfg->part_size; off += SECTOR) {
+      size_t n = (size_t)((off_t)cfg->part_size - off < SECTOR ? (off_t)cfg->part_size - off
+                                                               : SECTOR);
+      if (pwrite(s_flash_fd, ff, n, off) != (ssize_t)n) {
+        perror(cfg->flash_path);
+        return -1;
+      }
+    }
+  }
+
+  snprintf(s_nvs_path, sizeof(s_nvs_path), "%s.nvs", cfg->flash_path);
+  FILE *f = fopen(s_nvs_path, "rb");
+  if (f) {
+    if (fread(s_nvs, sizeof(s_nvs), 1, f) != 1) memset(s_nvs, 0, sizeof(s_nvs));
+    fclose(f);
+  }
+  return 0;
+}
+
+void ota_host_stats(ota_host_stats_t *out) {
+  *out = s_stats;
+}
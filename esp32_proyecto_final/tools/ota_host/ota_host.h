@@ -0,0 +1,24 @@
+#pragma once
+// Entorno de host para main/utils/ota/ota.c (tools/ota_dev): flash de la
+// partición de actualización en un fichero, imagen en ejecución leída de
+// otro, NVS en memoria + fichero, tareas FreeRTOS como hilos.
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  const char *flash_path;     /* partición ota_0; se crea borrada (0xFF) si no existe */
+  const char *base_path;      /* imagen en ejecución (base de los parches); NULL = vacía */
+  uint32_t part_size;         /* tamaño de las particiones de app */
+  uint32_t erase_us;          /* coste de borrar un sector de 4 KB */
+  uint32_t write_us_per_kib;  /* coste de escribir 1 KB */
+} ota_host_cfg_t;
+
+typedef struct {
+  uint64_t bytes_written;
+  uint32_t sectors_erased;
+  bool boot_set;              /* esp_ota_set_boot_partition llamado */
+} ota_host_stats_t;
+
+/* El NVS se guarda en "<flash_path>.nvs" para poder reanudar entre procesos */
+int ota_host_init(const ota_host_cfg_t *cfg);
+void ota_host_stats(ota_host_stats_t *out);
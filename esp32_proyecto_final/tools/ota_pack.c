@@ -0,0 +1,205 @@
+// ota_pack.c
+// Empaquetador en host de imágenes OTA comprimidas (OTA_V2_FLAG_DEFLATE,
+// ver main/utils/ota/ota.h) y comparación con la imagen sin comprimir.
+//
+// Uso: ota_pack [-l nivel] [-m mtu] [-r B/s] [-a ack_every] imagen.bin [salida.otaz]
+//   -l: nivel de zlib (por defecto 9)
+//   -m: ATT MTU negociado (por defecto 247, como la app)
+//   -r: B/s en el aire del enlace para estimar el tiempo (del orden de lo
+//       que mide "BLE_BENCH NOTIFY"; por defecto 20000)
+//   -a: ack_every de la sesión (por defecto 8)
+//
+// Formato de salida (lo lee la app antes de mandar OTA_V2_BEGIN):
+//   "OTAZ", u8 versión (1), u8 wbits, u16 reservado, u32 tamaño descomprimido
+//   (LE) y después el flujo zlib.
+//
+// La ventana es de 2^OTA_DEFLATE_WBITS bytes: el firmware descomprime con
+// un buffer circular de ese tamaño, así que el compresor no puede usar
+// distancias mayores. El flujo se descomprime aquí con la misma ventana para
+// comprobarlo antes de escribirlo.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define OTA_DEFLATE_WBITS  12    /* = ota.h */
+#define OTA_V2_DATA_HDR    3
+#define OTA_V2_MAX_DATA    509
+#define OTA_V2_ACK_LEN     8
+#define ATT_HDR            3     /* opcode + handle */
+#define L2CAP_HDR          4
+
+#define PACK_MAGIC         "OTAZ"
+#define PACK_VERSION       1
+#define PACK_HDR_LEN       12
+
+static double now_ms(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e3 + (double)t.tv_nsec / 1e6;
+}
+
+static uint8_t *load(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  long n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = malloc(n > 0 ? (size_t)n : 1);
+  if (!buf || fread(buf, 1, (size_t)n, f) != (size_t)n) {
+    fprintf(stderr, "%s: lectura fallida\n", path);
+    exit(1);
+  }
+  fclose(f);
+  *len = (size_t)n;
+  return buf;
+}
+
+static size_t pack(const uint8_t *in, size_t len, int level, uint8_t **out) {
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, level, Z_DEFLATED, OTA_DEFLATE_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    fprintf(stderr, "deflateInit2 falló\n");
+    exit(1);
+  }
+  size_t cap = deflateBound(&z, len);
+  *out = malloc(cap);
+  z.next_in = (Bytef *)in;
+  z.avail_in = (uInt)len;
+  z.next_out = *out;
+  z.avail_out = (uInt)cap;
+  if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+    fprintf(stderr, "deflate falló\n");
+    exit(1);
+  }
+  size_t n = z.total_out;
+  deflateEnd(&z);
+  return n;
+}
+
+/* Descomprime con la ventana del firmware y compara con el original */
+static int verify(const uint8_t *z_in, size_t z_len, const uint8_t *orig, size_t len) {
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, OTA_DEFLATE_WBITS) != Z_OK) return -1;
+
+  uint8_t *out = malloc(len + 1);
+  z.next_in = (Bytef *)z_in;
+  z.avail_in = (uInt)z_len;
+  z.next_out = out;
+  z.avail_out = (uInt)(len + 1);
+  int rc = inflate(&z, Z_FINISH);
+  int ok = rc == Z_STREAM_END && z.total_out == len && z.avail_in == 0 &&
+           memcmp(out, orig, len) == 0;
+  inflateEnd(&z);
+  free(out);
+  return ok ? 0 : -1;
+}
+
+typedef struct {
+  size_t frames;
+  size_t on_air;      /* bytes en el aire hacia el ESP32 + ACKs de vuelta */
+} air_t;
+
+/* Tramas DATA de hasta min(MTU - 3 - 3, OTA_V2_MAX_DATA), como la app */
+static air_t on_air(size_t bytes, unsigned mtu, unsigned ack_every) {
+  size_t chunk = mtu - ATT_HDR - OTA_V2_DATA_HDR;
+  if (chunk > OTA_V2_MAX_DATA) chunk = OTA_V2_MAX_DATA;
+
+  air_t a;
+  a.frames = (bytes + chunk - 1) / chunk;
+  size_t acks = (a.frames + ack_every - 1) / ack_every;
+  a.on_air = bytes + a.frames * (OTA_V2_DATA_HDR + ATT_HDR + L2CAP_HDR) +
+             acks * (OTA_V2_ACK_LEN + ATT_HDR + L2CAP_HDR);
+  return a;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void usage(void) {
+  fprintf(stderr, "Uso: ota_pack [-l nivel] [-m mtu] [-r B/s] [-a ack_every] "
+                  "imagen.bin [salida.otaz]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int level = 9;
+  unsigned mtu = 247, ack_every = 8;
+  double rate = 20000.0;
+  int c;
+
+  while ((c = getopt(argc, argv, "l:m:r:a:")) != -1) {
+    switch (c) {
+      case 'l': level = atoi(optarg); break;
+      case 'm': mtu = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 'r': rate = strtod(optarg, NULL); break;
+      case 'a': ack_every = (unsigned)strtoul(optarg, NULL, 10); break;
+      default: usage();
+    }
+  }
+  if (optind >= argc || mtu < 23 || ack_every == 0 || rate <= 0) usage();
+
+  size_t raw_len;
+  uint8_t *raw = load(argv[optind], &raw_len);
+
+  uint8_t *z;
+  double t0 = now_ms();
+  size_t z_len = pack(raw, raw_len, level, &z);
+  double t_pack = now_ms() - t0;
+
+  t0 = now_ms();
+  if (verify(z, z_len, raw, raw_len) != 0) {
+    fprintf(stderr, "La verificación del flujo comprimido falló\n");
+    return 1;
+  }
+  double t_inflate = now_ms() - t0;
+
+  air_t a_raw = on_air(raw_len, mtu, ack_every);
+  air_t a_z = on_air(z_len, mtu, ack_every);
+
+  printf("imagen:        %zu B\n", raw_len);
+  printf("comprimida:    %zu B (%.1f %%, ventana %u B, nivel %d)\n", z_len,
+         raw_len ? 100.0 * (double)z_len / (double)raw_len : 0.0,
+         1u << OTA_DEFLATE_WBITS, level);
+  printf("host:          compresión %.1f ms, descompresión %.1f ms\n", t_pack, t_inflate);
+  printf("MTU %u, ack_every %u, %.0f B/s:\n", mtu, ack_every, rate);
+  printf("  sin comprimir: %6zu tramas, %8zu B en el aire, ~%.1f s\n",
+         a_raw.frames, a_raw.on_air, (double)a_raw.on_air / rate);
+  printf("  comprimida:    %6zu tramas, %8zu B en el aire, ~%.1f s\n",
+         a_z.frames, a_z.on_air, (double)a_z.on_air / rate);
+  printf("  ahorro:        %.1f %% del tiempo de enlace\n",
+         a_raw.on_air ? 100.0 * (1.0 - (double)a_z.on_air / (double)a_raw.on_air) : 0.0);
+  printf("(el tiempo total real lo registra el ESP32 al terminar: \"OTA completada\")\n");
+
+  if (optind + 1 < argc) {
+    FILE *f = fopen(argv[optind + 1], "wb");
+    if (!f) {
+      perror(argv[optind + 1]);
+      return 1;
+    }
+    uint8_t hdr[PACK_HDR_LEN] = { 0 };
+    memcpy(hdr, PACK_MAGIC, 4);
+    hdr[4] = PACK_VERSION;
+    hdr[5] = OTA_DEFLATE_WBITS;
+    put_u32(&hdr[8], (uint32_t)raw_len);
+    if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || fwrite(z, 1, z_len, f) != z_len) {
+      fprintf(stderr, "%s: escritura fallida\n", argv[optind + 1]);
+      return 1;
+    }
+    fclose(f);
+    printf("escrito %s (%zu B)\n", argv[optind + 1], z_len + sizeof(hdr));
+  }
+
+  free(raw);
+  free(z);
+  return 0;
+}
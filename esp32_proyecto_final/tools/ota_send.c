@@ -0,0 +1,426 @@
+// ota_send.c
+// Cliente OTA v2 en host para medir el protocolo sin dispositivo ni app:
+// hace lo mismo que OtaBleService.startOta (app_movil_sbc) contra ota_dev,
+// que es main/utils/ota/ota.c compilado en host.
+//
+// Uso: ota_send [opciones] imagen.bin|imagen.otaz
+//      ota_send [opciones] -g KiB
+//   -x cmd: dispositivo a lanzar (por defecto "./ota_dev"); se le conecta
+//           stdin/stdout a un socketpair con el framing de ota_dev
+//   -c n:   bytes de datos por trama (por defecto 241: MTU 247 como la app)
+//   -w n:   tramas sin confirmar como máximo (por defecto la ventana que
+//           ofrece BEGIN_RSP)
+//   -a n:   ack_every pedido en el BEGIN (por defecto 8)
+//   -i µs:  pausa entre tramas DATA (ritmo del enlace; por defecto 0)
+//   -p ‰:   tramas DATA que se "pierden" en el aire (por defecto 0)
+//   -t ms:  timeout de ACK antes de reenviar (por defecto 2000, como la app)
+//   -s n:   semilla de las pérdidas
+//   -n:     no mandar el SHA-256 en el BEGIN
+//   -k n:   cortar el enlace tras n tramas DATA (para probar la reanudación:
+//           repetir sin -k)
+//   -g KiB: imagen sintética (0xE9 + patrón) en vez de un fichero
+//
+// Las imágenes .otaz (tools/ota_pack, tools/ota_delta) se mandan con los
+// flags de su cabecera, como hace la app. Con image_id y sin flags la
+// sesión es reanudable: si una ejecución anterior se cortó, ota_dev
+// (con el mismo -f) contesta desde dónde seguir.
+//
+// Informe: throughput de la imagen, latencia por trama (primer envío -> ACK
+// que la cubre; las reenviadas no cuentan) en percentiles, reenvíos y el
+// tiempo de OTA_V2_END (verificación y esp_ota_end). Sale con 0 solo si el
+// END_RSP es OK.
+
+#include <errno.h>
+#include <openssl/sha.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* = main/utils/ota/ota.h */
+#define OTA_V2_BEGIN       0x01
+#define OTA_V2_DATA        0x02
+#define OTA_V2_END         0x03
+#define OTA_V2_BEGIN_RSP   0x81
+#define OTA_V2_ACK         0x82
+#define OTA_V2_END_RSP     0x84
+#define OTA_V2_DATA_HDR    3
+#define OTA_V2_FLAG_DEFLATE 0x01
+#define OTA_ST_OK          0
+#define OTA_ST_BAD_SEQ     3
+#define OTA_ST_OVERFLOW    8
+
+#define BEGIN_LEN          11
+#define BEGIN_SHA_LEN      (BEGIN_LEN + 32)
+#define PACK_HDR_LEN       12
+#define FRAME_MAX          1024
+#define BEGIN_TIMEOUT_MS   10000
+#define END_TIMEOUT_MS     30000
+#define MAX_RETRIES        8      /* seguidos sin avanzar, como la app */
+
+typedef struct {
+  int fd;
+  pid_t pid;
+} link_t;
+
+static int64_t now_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void sleep_us(int64_t us) {
+  struct timespec t = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+  while (nanosleep(&t, &t) != 0 && errno == EINTR) {
+  }
+}
+
+static uint8_t *load(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  long n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = malloc(n > 0 ? (size_t)n : 1);
+  if (!buf || fread(buf, 1, (size_t)n, f) != (size_t)n) {
+    fprintf(stderr, "%s: lectura fallida\n", path);
+    exit(1);
+  }
+  fclose(f);
+  *len = (size_t)n;
+  return buf;
+}
+
+/* Mismo patrón que la autoprueba BLE_OTA_TEST: 0xE9 delante para esp_ota_write */
+static uint8_t *synth(size_t len) {
+  uint8_t *buf = malloc(len);
+  for (size_t i = 0; i < len; i++) buf[i] = (uint8_t)(i * 31u + (i >> 8));
+  if (len) buf[0] = 0xE9;
+  return buf;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+/* FNV-1a de 32 bits, nunca 0 (= OtaBleService._imageId) */
+static uint32_t image_id(const uint8_t *p, size_t len) {
+  uint32_t h = 0x811C9DC5u;
+  for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 0x01000193u;
+  return h ? h : 1;
+}
+
+/* ============================
+   Enlace con ota_dev
+   ============================ */
+
+static link_t spawn(const char *cmd) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+    perror("socketpair");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    dup2(sv[1], STDIN_FILENO);
+    dup2(sv[1], STDOUT_FILENO);
+    close(sv[0]);
+    close(sv[1]);
+    execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+    _exit(127);
+  }
+  close(sv[1]);
+  return (link_t){ .fd = sv[0], .pid = pid };
+}
+
+static void send_frame(const link_t *l, const uint8_t *data, size_t len) {
+  uint8_t buf[2 + FRAME_MAX];
+  buf[0] = (uint8_t)(len & 0xFF);
+  buf[1] = (uint8_t)(len >> 8);
+  memcpy(&buf[2], data, len);
+  size_t off = 0;
+  while (off < len + 2) {
+    ssize_t n = write(l->fd, buf + off, len + 2 - off);
+    if (n <= 0) {
+      fprintf(stderr, "ota_send: el dispositivo cerró el enlace\n");
+      exit(1);
+    }
+    off += (size_t)n;
+  }
+}
+
+static int read_full(int fd, uint8_t *p, size_t len) {
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n <= 0) return -1;
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+/* Siguiente respuesta de tipo type (descarta las demás) o 0 si vence el
+ * plazo. Devuelve su longitud. */
+static size_t wait_reply(const link_t *l, uint8_t type, int64_t deadline_us, uint8_t *out) {
+  for (;;) {
+    int64_t left = deadline_us - now_us();
+    if (left <= 0) return 0;
+    struct pollfd p = { .fd = l->fd, .events = POLLIN };
+    int rc = poll(&p, 1, (int)((left + 999) / 1000));
+    if (rc < 0 && errno == EINTR) continue;
+    if (rc <= 0) return 0;
+
+    uint8_t hdr[2];
+    if (read_full(l->fd, hdr, sizeof(hdr)) != 0) {
+      fprintf(stderr, "ota_send: el dispositivo cerró el enlace\n");
+      exit(1);
+    }
+    size_t len = hdr[0] | ((size_t)hdr[1] << 8);
+    if (len == 0 || len > FRAME_MAX || read_full(l->fd, out, len) != 0) {
+      fprintf(stderr, "ota_send: trama inválida del dispositivo\n");
+      exit(1);
+    }
+    if (out[0] == type) return len;
+  }
+}
+
+/* ============================
+   Informe
+   ============================ */
+
+static int cmp_i64(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double pct_ms(const int64_t *v, size_t n, double p) {
+  if (n == 0) return 0.0;
+  size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+  return (double)v[i] / 1000.0;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Uso: ota_send [-x cmd] [-c bytes] [-w ventana] [-a ack_every] [-i µs] "
+                  "[-p ‰] [-t ms] [-s semilla] [-n] [-k n] imagen | -g KiB\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *cmd = "./ota_dev";
+  unsigned chunk = 241, window = 0, ack_every = 8, loss = 0, timeout_ms = 2000, seed = 1;
+  unsigned gen_kib = 0, cut = 0;
+  int64_t pace_us = 0;
+  int with_sha = 1;
+  int c;
+
+  while ((c = getopt(argc, argv, "x:c:w:a:i:p:t:s:nk:g:")) != -1) {
+    switch (c) {
+      case 'x': cmd = optarg; break;
+      case 'c': chunk = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 'w': window = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 'a': ack_every = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 'i': pace_us = strtoll(optarg, NULL, 10); break;
+      case 'p': loss = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 't': timeout_ms = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 's': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 'n': with_sha = 0; break;
+      case 'k': cut = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 'g': gen_kib = (unsigned)strtoul(optarg, NULL, 10); break;
+      default: usage();
+    }
+  }
+  if ((gen_kib == 0) == (optind >= argc) || chunk == 0 || ack_every == 0 || ack_every > 255 ||
+      loss >= 1000 || timeout_ms == 0) {
+    usage();
+  }
+
+  size_t file_len;
+  uint8_t *file = gen_kib ? synth(file_len = (size_t)gen_kib * 1024) : load(argv[optind], &file_len);
+
+  /* Contenedor "OTAZ": se manda el cuerpo con los flags de la cabecera */
+  const uint8_t *img = file;
+  size_t img_len = file_len;
+  uint32_t image_size = (uint32_t)file_len;
+  uint8_t flags = 0;
+  if (file_len > PACK_HDR_LEN && memcmp(file, "OTAZ", 4) == 0 && (file[4] == 1 || file[4] == 2)) {
+    flags = (file[4] == 1) ? OTA_V2_FLAG_DEFLATE : file[6];
+    image_size = get_u32(&file[8]);
+    img += PACK_HDR_LEN;
+    img_len -= PACK_HDR_LEN;
+  }
+  with_sha = with_sha && flags == 0;
+
+  signal(SIGPIPE, SIG_IGN);
+  srand(seed);
+  link_t l = spawn(cmd);
+  uint8_t rsp[FRAME_MAX];
+
+  /* BEGIN */
+  uint8_t begin[BEGIN_SHA_LEN];
+  begin[0] = OTA_V2_BEGIN;
+  put_u32(&begin[1], image_size);
+  begin[5] = (uint8_t)ack_every;
+  begin[6] = flags;
+  put_u32(&begin[7], image_id(img, img_len));
+  if (with_sha) SHA256(img, img_len, &begin[BEGIN_LEN]);
+
+  int64_t t_begin = now_us();
+  send_frame(&l, begin, with_sha ? BEGIN_SHA_LEN : BEGIN_LEN);
+  size_t n = wait_reply(&l, OTA_V2_BEGIN_RSP, t_begin + BEGIN_TIMEOUT_MS * 1000, rsp);
+  if (n < 5 || rsp[1] != OTA_ST_OK) {
+    fprintf(stderr, "ota_send: BEGIN %s\n", n ? "rechazado" : "sin respuesta");
+    if (n >= 2) fprintf(stderr, "  estado %u\n", rsp[1]);
+    return 1;
+  }
+  if (flags && (n < 6 || (rsp[5] & flags) != flags)) {
+    fprintf(stderr, "ota_send: el dispositivo no acepta flags 0x%02X\n", flags);
+    return 1;
+  }
+  int64_t t_data = now_us();
+
+  unsigned max_data = rsp[2] | (rsp[3] << 8);
+  if (chunk > max_data) chunk = max_data;
+  if (window == 0 || window > rsp[4]) window = rsp[4] ? rsp[4] : 1;
+  size_t offset = (n >= 10) ? get_u32(&rsp[6]) : 0;
+  if (offset >= img_len) offset = 0;
+
+  const uint8_t *data = img + offset;
+  size_t data_len = img_len - offset;
+  size_t frames = (data_len + chunk - 1) / chunk;
+
+  int64_t *sent_us = calloc(frames + 1, sizeof(int64_t));
+  uint8_t *resent = calloc(frames + 1, 1);
+  int64_t *lat = calloc(frames + 1, sizeof(int64_t));
+  size_t lat_n = 0;
+  unsigned long n_retx = 0, n_timeouts = 0, n_bad_seq = 0, n_overflow = 0, n_lost = 0;
+
+  /* Go-back-N como la app: hasta window tramas sin confirmar */
+  size_t base = 0, next = 0;
+  unsigned retries = 0;
+  uint8_t frame[OTA_V2_DATA_HDR + FRAME_MAX];
+  while (base < frames) {
+    while (next < frames && next - base < window) {
+      size_t start = next * chunk;
+      size_t len = (data_len - start < chunk) ? data_len - start : chunk;
+      frame[0] = OTA_V2_DATA;
+      frame[1] = (uint8_t)(next & 0xFF);
+      frame[2] = (uint8_t)((next >> 8) & 0xFF);
+      memcpy(&frame[OTA_V2_DATA_HDR], data + start, len);
+
+      if (sent_us[next]) {
+        resent[next] = 1;
+        n_retx++;
+      } else {
+        sent_us[next] = now_us();
+      }
+      if (cut && next >= cut) {
+        /* como una desconexión: ota_dev ve EOF y suspende la sesión */
+        close(l.fd);
+        waitpid(l.pid, NULL, 0);
+        printf("enlace cortado tras %u tramas (%zu B desde %zu)\n", cut, start, offset);
+        return 1;
+      }
+      if (loss && (unsigned)(rand() % 1000) < loss) {
+        n_lost++;
+      } else {
+        send_frame(&l, frame, OTA_V2_DATA_HDR + len);
+      }
+      next++;
+      if (pace_us) sleep_us(pace_us);
+    }
+
+    n = wait_reply(&l, OTA_V2_ACK, now_us() + (int64_t)timeout_ms * 1000, rsp);
+    if (n < 8) {
+      n_timeouts++;
+      if (++retries > MAX_RETRIES) {
+        fprintf(stderr, "ota_send: sin ACK\n");
+        return 1;
+      }
+      next = base;
+      continue;
+    }
+
+    unsigned seq16 = rsp[2] | (rsp[3] << 8);
+    size_t acked = base + ((seq16 - base) & 0xFFFF);
+    if (rsp[1] == OTA_ST_OK) {
+      if (acked > base && acked <= next) {
+        int64_t t = now_us();
+        for (size_t i = base; i < acked; i++) {
+          if (!resent[i]) lat[lat_n++] = t - sent_us[i];
+        }
+        base = acked;
+        retries = 0;
+      }
+    } else if (rsp[1] == OTA_ST_BAD_SEQ || rsp[1] == OTA_ST_OVERFLOW) {
+      if (rsp[1] == OTA_ST_BAD_SEQ) n_bad_seq++;
+      else n_overflow++;
+      if (++retries > MAX_RETRIES) {
+        fprintf(stderr, "ota_send: demasiados reenvíos\n");
+        return 1;
+      }
+      if (acked >= base && acked < next) next = acked;
+    } else {
+      fprintf(stderr, "ota_send: OTA rechazada (estado %u)\n", rsp[1]);
+      return 1;
+    }
+  }
+
+  /* END: verificación y esp_ota_end en el dispositivo */
+  int64_t t_end = now_us();
+  uint8_t end = OTA_V2_END;
+  send_frame(&l, &end, 1);
+  n = wait_reply(&l, OTA_V2_END_RSP, t_end + END_TIMEOUT_MS * 1000, rsp);
+  int64_t t_done = now_us();
+  int ok = n >= 2 && rsp[1] == OTA_ST_OK;
+
+  close(l.fd);
+  waitpid(l.pid, NULL, 0);
+
+  qsort(lat, lat_n, sizeof(lat[0]), cmp_i64);
+  double total_s = (double)(t_done - t_begin) / 1e6;
+  double data_s = (double)(t_end - t_data) / 1e6;
+
+  printf("imagen:      %u B%s%s, enviados %zu B desde %zu\n", image_size,
+         (flags & OTA_V2_FLAG_DEFLATE) ? " (comprimida)" : "", (flags & 0x02) ? " (delta)" : "",
+         data_len, offset);
+  printf("sesión:      %zu tramas de %u B, ventana %u, ack_every %u, pausa %lld µs, "
+         "pérdida %u ‰\n", frames, chunk, window, ack_every, (long long)pace_us, loss);
+  printf("tiempo:      BEGIN %.1f ms, datos %.1f ms, END %.1f ms, total %.1f ms\n",
+         (double)(t_data - t_begin) / 1e3, data_s * 1e3, (double)(t_done - t_end) / 1e3,
+         total_s * 1e3);
+  printf("throughput:  %.1f KB/s de imagen (%.1f KB/s en la fase de datos)\n",
+         total_s > 0 ? (double)image_size / 1024.0 / total_s : 0.0,
+         data_s > 0 ? (double)data_len / 1024.0 / data_s : 0.0);
+  printf("latencia:    p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, máx %.2f ms (%zu tramas)\n",
+         pct_ms(lat, lat_n, 0.50), pct_ms(lat, lat_n, 0.90), pct_ms(lat, lat_n, 0.99),
+         pct_ms(lat, lat_n, 1.0), lat_n);
+  printf("reenvíos:    %lu tramas (%lu timeouts, %lu BAD_SEQ, %lu OVERFLOW, %lu perdidas)\n",
+         n_retx, n_timeouts, n_bad_seq, n_overflow, n_lost);
+  printf("resultado:   %s", ok ? "OK" : "FALLO");
+  if (n >= 2 && !ok) printf(" (estado %u)", rsp[1]);
+  printf("\n");
+
+  free(file);
+  free(sent_us);
+  free(resent);
+  free(lat);
+  return ok ? 0 : 1;
+}
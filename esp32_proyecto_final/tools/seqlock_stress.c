@@ -0,0 +1,173 @@
+// seqlock_stress.c
+// Prueba de estrés en host del seqlock (main/utils/seqlock.c) con el que
+// mpu6050 publica la última muestra.
+//
+// Uso: seqlock_stress [segundos] [lectores]
+//   segundos: duración de cada prueba (def. 2)
+//   lectores: hilos lectores (def. 3; el escritor es uno más)
+//
+// El escritor publica sin parar valores de 24 bytes (como mpu6050_data_t)
+// en los que cada palabra se deriva del mismo contador; los lectores
+// comprueban que nunca ven palabras de dos escrituras distintas y que la
+// versión no va hacia atrás. Se repite con un mutex (lo que hacía
+// mpu6050_get_latest) para comparar cuánto llega a esperar el escritor.
+
+#include "seqlock.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WORDS       6      /* 24 bytes */
+#define MAX_READERS 16
+
+typedef struct {
+  uint32_t w[WORDS];
+} value_t;
+
+static inline void value_make(value_t *v, uint32_t k) {
+  for (int i = 0; i < WORDS; i++) v->w[i] = k * 2654435761u + (uint32_t)i * 0x9E3779B9u;
+}
+
+/* Devuelve el contador o UINT32_MAX si las palabras no cuadran (partida) */
+static inline uint32_t value_check(const value_t *v) {
+  uint32_t k = v->w[0] * 244002641u;   /* inverso de 2654435761 mod 2^32 */
+  value_t ref;
+  value_make(&ref, k);
+  return memcmp(&ref, v, sizeof(ref)) == 0 ? k : UINT32_MAX;
+}
+
+static double now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+typedef struct {
+  int use_mutex;
+  atomic_bool stop;
+  seqlock_t sl;
+  pthread_mutex_t mtx;
+  value_t shared;        /* modo mutex */
+
+  /* escritor */
+  uint64_t writes;
+  double write_max_ns;
+
+  /* lectores (sumados al terminar) */
+  pthread_mutex_t stats_mtx;
+  uint64_t reads, gave_up, torn, backwards;
+} ctx_t;
+
+static void *writer(void *arg) {
+  ctx_t *c = arg;
+  value_t v;
+  uint32_t k = 1;
+
+  while (!atomic_load_explicit(&c->stop, memory_order_relaxed)) {
+    value_make(&v, k++);
+    double t0 = now_ns();
+    if (c->use_mutex) {
+      pthread_mutex_lock(&c->mtx);
+      c->shared = v;
+      pthread_mutex_unlock(&c->mtx);
+    } else {
+      seqlock_write(&c->sl, &v, sizeof(v));
+    }
+    double dt = now_ns() - t0;
+    if (dt > c->write_max_ns) c->write_max_ns = dt;
+    c->writes++;
+  }
+  return NULL;
+}
+
+static void *reader(void *arg) {
+  ctx_t *c = arg;
+  uint64_t reads = 0, gave_up = 0, torn = 0, backwards = 0;
+  uint32_t last = 0;
+  value_t v;
+
+  while (!atomic_load_explicit(&c->stop, memory_order_relaxed)) {
+    if (c->use_mutex) {
+      pthread_mutex_lock(&c->mtx);
+      v = c->shared;
+      pthread_mutex_unlock(&c->mtx);
+    } else if (!seqlock_read(&c->sl, &v, sizeof(v), 16, NULL)) {
+      gave_up++;
+      sched_yield();   /* como el vTaskDelay de mpu6050_get_latest */
+      continue;
+    }
+
+    reads++;
+    uint32_t k = value_check(&v);
+    if (k == UINT32_MAX) {
+      torn++;
+    } else {
+      if (k < last) backwards++;
+      last = k;
+    }
+  }
+
+  pthread_mutex_lock(&c->stats_mtx);
+  c->reads += reads;
+  c->gave_up += gave_up;
+  c->torn += torn;
+  c->backwards += backwards;
+  pthread_mutex_unlock(&c->stats_mtx);
+  return NULL;
+}
+
+static int run(int use_mutex, double seconds, int readers) {
+  ctx_t *c = calloc(1, sizeof(*c));
+  c->use_mutex = use_mutex;
+  atomic_init(&c->stop, false);
+  seqlock_init(&c->sl);
+  pthread_mutex_init(&c->mtx, NULL);
+  pthread_mutex_init(&c->stats_mtx, NULL);
+  value_make(&c->shared, 0);
+
+  /* versión 0 coherente para el seqlock también */
+  value_t v0;
+  value_make(&v0, 0);
+  seqlock_write(&c->sl, &v0, sizeof(v0));
+
+  pthread_t w, r[MAX_READERS];
+  pthread_create(&w, NULL, writer, c);
+  for (int i = 0; i < readers; i++) pthread_create(&r[i], NULL, reader, c);
+
+  struct timespec ts = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+  nanosleep(&ts, NULL);
+  atomic_store(&c->stop, true);
+
+  pthread_join(w, NULL);
+  for (int i = 0; i < readers; i++) pthread_join(r[i], NULL);
+
+  printf("%s\n", use_mutex ? "mutex:" : "seqlock:");
+  printf("  escrituras:        %.2f M/s\n", c->writes / seconds / 1e6);
+  printf("  escritura máx.:    %.1f us\n", c->write_max_ns / 1000.0);
+  printf("  lecturas:          %.2f M/s (%d lectores)\n", c->reads / seconds / 1e6, readers);
+  if (!use_mutex) printf("  lecturas rendidas: %llu\n", (unsigned long long)c->gave_up);
+  printf("  partidas:          %llu\n", (unsigned long long)c->torn);
+  printf("  hacia atrás:       %llu\n", (unsigned long long)c->backwards);
+
+  int bad = c->torn || c->backwards || c->reads == 0 || c->writes == 0;
+  pthread_mutex_destroy(&c->mtx);
+  pthread_mutex_destroy(&c->stats_mtx);
+  free(c);
+  return bad;
+}
+
+int main(int argc, char **argv) {
+  double seconds = (argc > 1) ? atof(argv[1]) : 2.0;
+  int readers = (argc > 2) ? atoi(argv[2]) : 3;
+  if (readers < 1) readers = 1;
+  if (readers > MAX_READERS) readers = MAX_READERS;
+
+  int bad = run(0, seconds, readers);
+  run(1, seconds, readers);
+  return bad ? 2 : 0;
+}
@@ -0,0 +1,234 @@
+// spsc_ring_bench.c
+// Prueba de estrés y benchmark en host del ring SPSC (main/utils/spsc_ring.c).
+//
+// Uso: spsc_ring_bench [muestras] [capacidad]
+//   muestras:  elementos a pasar de productor a consumidor (def. 2000000)
+//   capacidad: tamaño del ring, potencia de 2 (def. 64, como PM_PULSE_Q_LEN)
+//
+// Un hilo productor y uno consumidor (pthread) se pasan muestras del mismo
+// tamaño que las IMU de pm_task con un contador de secuencia; el consumidor
+// comprueba que no falte, se repita ni se corrompa ninguna. Se compara con
+// una cola mutex + condvar, que es lo que hace una cola FreeRTOS por dentro
+// (sección crítica por elemento); no es la cola real, solo su equivalente
+// en host.
+
+#include "spsc_ring.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCK 16   /* muestras por push/pop en el modo bloque */
+
+typedef struct {
+  uint32_t seq;
+  int16_t v[6];
+  uint32_t check;
+} item_t;   /* 20 bytes, como pm_imu_sample_t + seq */
+
+static inline uint32_t item_check(uint32_t seq) {
+  return seq * 2654435761u;
+}
+
+static inline void item_make(item_t *it, uint32_t seq) {
+  it->seq = seq;
+  for (int a = 0; a < 6; a++) it->v[a] = (int16_t)(seq + (uint32_t)a);
+  it->check = item_check(seq);
+}
+
+static inline int item_ok(const item_t *it, uint32_t seq) {
+  if (it->seq != seq || it->check != item_check(seq)) return 0;
+  for (int a = 0; a < 6; a++) {
+    if (it->v[a] != (int16_t)(seq + (uint32_t)a)) return 0;
+  }
+  return 1;
+}
+
+static double now_s(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+/* ============================
+   Ring SPSC
+   ============================ */
+
+typedef struct {
+  spsc_ring_t ring;
+  uint32_t total;
+  int block;
+  uint64_t errors;
+} ring_ctx_t;
+
+static void *ring_producer(void *arg) {
+  ring_ctx_t *c = arg;
+  item_t tmp[BLOCK];
+  uint32_t seq = 0;
+
+  while (seq < c->total) {
+    int n = c->block;
+    if ((uint32_t)n > c->total - seq) n = (int)(c->total - seq);
+    for (int i = 0; i < n; i++) item_make(&tmp[i], seq + (uint32_t)i);
+
+    size_t done = 0;
+    while (done < (size_t)n) {
+      size_t k = spsc_ring_push(&c->ring, tmp + done, (size_t)n - done);
+      if (k == 0) sched_yield();   /* lleno: cede CPU (máquinas de 1 core) */
+      done += k;
+    }
+    seq += (uint32_t)n;
+  }
+  return NULL;
+}
+
+static void *ring_consumer(void *arg) {
+  ring_ctx_t *c = arg;
+  uint32_t seq = 0;
+
+  while (seq < c->total) {
+    spsc_span_t span[2];
+    size_t avail = spsc_ring_read_spans(&c->ring, span);
+    if (avail == 0) {
+      sched_yield();
+      continue;
+    }
+
+    for (int s = 0; s < 2; s++) {
+      const item_t *it = span[s].ptr;
+      for (size_t k = 0; k < span[s].count; k++) {
+        if (!item_ok(&it[k], seq)) c->errors++;
+        seq++;
+      }
+    }
+    spsc_ring_commit_read(&c->ring, avail);
+  }
+  return NULL;
+}
+
+static double run_ring(uint32_t total, size_t cap, int block, uint64_t *errors) {
+  ring_ctx_t c;
+  item_t *storage = calloc(cap, sizeof(item_t));
+  if (!storage || !spsc_ring_init(&c.ring, storage, cap, sizeof(item_t))) {
+    fprintf(stderr, "capacidad inválida: %zu\n", cap);
+    exit(1);
+  }
+  c.total = total;
+  c.block = block;
+  c.errors = 0;
+
+  pthread_t p, q;
+  double t0 = now_s();
+  pthread_create(&q, NULL, ring_consumer, &c);
+  pthread_create(&p, NULL, ring_producer, &c);
+  pthread_join(p, NULL);
+  pthread_join(q, NULL);
+  double dt = now_s() - t0;
+
+  if (spsc_ring_count(&c.ring) != 0) c.errors++;
+  *errors = c.errors;
+  free(storage);
+  return dt;
+}
+
+/* ============================
+   Cola mutex + condvar (equivalente de xQueueSend/xQueueReceive)
+   ============================ */
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  item_t *buf;
+  size_t cap, head, count;
+  uint32_t total;
+  uint64_t errors;
+} mq_ctx_t;
+
+static void *mq_producer(void *arg) {
+  mq_ctx_t *c = arg;
+  for (uint32_t seq = 0; seq < c->total; seq++) {
+    item_t it;
+    item_make(&it, seq);
+    pthread_mutex_lock(&c->lock);
+    while (c->count == c->cap) pthread_cond_wait(&c->not_full, &c->lock);
+    c->buf[(c->head + c->count) % c->cap] = it;
+    c->count++;
+    pthread_cond_signal(&c->not_empty);
+    pthread_mutex_unlock(&c->lock);
+  }
+  return NULL;
+}
+
+static void *mq_consumer(void *arg) {
+  mq_ctx_t *c = arg;
+  for (uint32_t seq = 0; seq < c->total; seq++) {
+    item_t it;
+    pthread_mutex_lock(&c->lock);
+    while (c->count == 0) pthread_cond_wait(&c->not_empty, &c->lock);
+    it = c->buf[c->head];
+    c->head = (c->head + 1) % c->cap;
+    c->count--;
+    pthread_cond_signal(&c->not_full);
+    pthread_mutex_unlock(&c->lock);
+    if (!item_ok(&it, seq)) c->errors++;
+  }
+  return NULL;
+}
+
+static double run_mq(uint32_t total, size_t cap, uint64_t *errors) {
+  mq_ctx_t c;
+  memset(&c, 0, sizeof(c));
+  pthread_mutex_init(&c.lock, NULL);
+  pthread_cond_init(&c.not_empty, NULL);
+  pthread_cond_init(&c.not_full, NULL);
+  c.buf = calloc(cap, sizeof(item_t));
+  c.cap = cap;
+  c.total = total;
+
+  pthread_t p, q;
+  double t0 = now_s();
+  pthread_create(&q, NULL, mq_consumer, &c);
+  pthread_create(&p, NULL, mq_producer, &c);
+  pthread_join(p, NULL);
+  pthread_join(q, NULL);
+  double dt = now_s() - t0;
+
+  *errors = c.errors;
+  free(c.buf);
+  pthread_cond_destroy(&c.not_full);
+  pthread_cond_destroy(&c.not_empty);
+  pthread_mutex_destroy(&c.lock);
+  return dt;
+}
+
+int main(int argc, char **argv) {
+  uint32_t total = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 2000000u;
+  size_t cap = (argc > 2) ? (size_t)strtoul(argv[2], NULL, 10) : 64;
+  uint64_t err;
+  int fail = 0;
+
+  printf("muestras: %lu, capacidad: %zu, elemento: %zu bytes\n",
+         (unsigned long)total, cap, sizeof(item_t));
+
+  double t = run_ring(total, cap, 1, &err);
+  printf("ring SPSC (1 a 1):      %8.2f Mmuestras/s  errores: %llu\n",
+         total / t / 1e6, (unsigned long long)err);
+  fail |= (err != 0);
+
+  t = run_ring(total, cap, BLOCK, &err);
+  printf("ring SPSC (bloque %2d):  %8.2f Mmuestras/s  errores: %llu\n",
+         BLOCK, total / t / 1e6, (unsigned long long)err);
+  fail |= (err != 0);
+
+  uint32_t mq_total = total / 10 ? total / 10 : total;
+  t = run_mq(mq_total, cap, &err);
+  printf("cola mutex+condvar:     %8.2f Mmuestras/s  errores: %llu  (%lu muestras)\n",
+         mq_total / t / 1e6, (unsigned long long)err, (unsigned long)mq_total);
+  fail |= (err != 0);
+
+  return fail ? 1 : 0;
+}